@@ -1,14 +1,1797 @@
 #include "sha256_digest.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-int main(int argc, char **argv){
-	if(2 != argc){
-		puts("[USAGE] ./bin/hash_me 'message to hash'");
+//sha256sum-style file hasher. The main thread walks the arguments (directories recursively) and queues
+//the files, worker threads claim them a few at a time and hash them, and a printer thread writes the
+//results in the order the files were queued.
+//With -c the arguments are sha256sum manifests instead: their files are queued biggest first (grouped by
+//device and inode among files of similar size) and the workers report each file as soon as it's checked.
+//Small files are read whole and hashed together through the multi-buffer engine. Bigger files are
+//streamed, and the biggest get a read-ahead thread so reading the next buffer overlaps the compression
+//of the current one.
+//With -l it's a daemon answering pipelined requests on a Unix domain socket instead (see hash_me_serve()).
+
+//Files claimed at once by a worker
+#define HASH_ME_CLAIM 16
+//Files up to this size are read whole and hashed together with the other small files of the claim
+#define HASH_ME_SMALL_FILE (64*1024)
+//Read size for bigger files, and alignment of all the buffers
+#define HASH_ME_READ_SIZE (1 << 20)
+#define HASH_ME_ALIGNMENT 4096
+//Files bigger than this are read by a read-ahead thread
+#define HASH_ME_READAHEAD_FILE (8 << 20)
+//Entries per block of the queue (blocks are never moved, so entries can be used without the lock)
+#define HASH_ME_BLOCK_ENTRIES 4096
+//Longest request line of the server (file requests carry a path)
+#define HASH_ME_LINE_SIZE (PATH_MAX + 16)
+
+struct hash_me_entry{
+	char *path;	//"-" = stdin
+	unsigned char hash[32];
+	unsigned char expected[32];	//Digest from the manifest (-c)
+	int64_t size;	//Size when known beforehand (-1 = unknown)
+	int error;	//errno of the failure (0 = hashed)
+	int ready;	//1 once hashed (or failed)
+};
+
+struct hash_me_queue{
+	struct hash_me_entry **blocks;
+	size_t block_capacity;
+	size_t count;	//Entries queued by the walker
+	size_t next;	//First entry no worker claimed yet
+	int walking;	//1 while the walker may queue more entries
+
+	pthread_mutex_t lock;
+	pthread_cond_t queued;	//Signaled when entries are queued or the walk ends
+	pthread_cond_t hashed;	//Signaled when entries are ready
+
+	struct sha256_base *base;
+	int failed;	//1 if any file couldn't be hashed
+
+	//Manifest verification (-c), updated under lock
+	int verify;	//1 = the workers check and report the entries themselves
+	int fail_fast;	//1 = stop at the first failure
+	int stop;	//1 = don't claim more entries
+	size_t mismatched;
+	size_t unreadable;
+};
+
+//Line of a manifest, sorted before being queued
+struct hash_me_check_line{
+	char *path;
+	unsigned char expected[32];
+	int64_t size;
+	dev_t device;
+	ino_t inode;
+};
+
+//Request read by the server, waiting for its reply
+struct hash_me_request{
+	struct hash_me_request *next;	//Next request of the same connection (replies are sent in order)
+	struct hash_me_request *next_file;	//Next request of the file queue
+	char kind;	//'d' = inline data, 'f' = file, 's' = statistics, 'e' = malformed request
+	int binary;	//1 = binary reply, 0 = hexadecimal
+	int ready;	//1 once the reply can be sent (updated under the server's lock for files)
+	int error;	//errno of the failure (0 = hashed)
+	unsigned char hash[32];
+	char *path;	//File requests
+	uint64_t start;	//When the request was read (sha256_stats_now())
+};
+
+struct hash_me_connection{
+	int fd;
+	unsigned char *input;
+	size_t input_offset;	//First byte not parsed yet
+	size_t input_length;
+	size_t input_capacity;
+	char *output;
+	size_t output_sent;
+	size_t output_length;
+	size_t output_capacity;
+	struct hash_me_request *first;	//Requests waiting for their reply, in order
+	struct hash_me_request *last;
+
+	//Inline data too big to be batched, hashed as it arrives
+	struct hash_me_request *streaming;
+	struct sha256_context context;
+	uint64_t stream_left;
+
+	int closing;	//1 once nothing more is read (end of the requests, malformed request or dead client)
+	int dead;	//1 if the client can't be written to anymore
+};
+
+struct hash_me_server{
+	struct sha256_base *base;
+	int listener;
+	int wake[2];	//Pipe written to when a file is hashed (or a signal arrives), to wake poll() up
+
+	pthread_mutex_t lock;
+	pthread_cond_t queued;	//Signaled when files are queued or the server stops
+	struct hash_me_request *files_first;	//File requests no worker claimed yet
+	struct hash_me_request *files_last;
+	int stopping;
+
+	struct hash_me_connection **connections;
+	size_t connection_count;
+	size_t connection_capacity;
+
+	//Small inline requests read in the current round, hashed together
+	struct sha256_job *jobs;
+	struct hash_me_request **batched;
+	size_t batch_count;
+	size_t batch_capacity;
+
+	//Statistics, only updated by the thread running the loop
+	uint64_t start;
+	uint64_t connections_accepted;
+	uint64_t data_requests;
+	uint64_t file_requests;
+	uint64_t stats_requests;
+	uint64_t failed;	//Replies reporting an error
+	uint64_t data_bytes;	//Inline bytes hashed
+	uint64_t batches;
+	uint64_t batched_requests;
+	uint64_t largest_batch;
+	uint64_t replies;
+	uint64_t latency_total;	//Nanoseconds between reading the requests and queuing their replies
+	uint64_t latency_max;
+	uint64_t latency[SHA256_STATS_BUCKETS];	//Histogram of the latencies (log2 of the nanoseconds)
+};
+
+//Double buffer filled by a read-ahead thread
+struct hash_me_reader{
+	int fd;
+	unsigned char *buffers[2];
+	ssize_t lengths[2];	//Bytes in each buffer (0 = end of file, -1 = error)
+	int full[2];
+	int error;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+static struct hash_me_entry *hash_me_entry_at(struct hash_me_queue *queue, size_t index){
+	return &queue->blocks[index/HASH_ME_BLOCK_ENTRIES][index%HASH_ME_BLOCK_ENTRIES];
+}
+
+//Queues a copy of model (taking ownership of its path). Returns 0 if it went OK, -1 otherwise.
+static int hash_me_queue_entry(struct hash_me_queue *queue, const struct hash_me_entry *model){
+	char *path = model->path;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if(0 == queue->count % HASH_ME_BLOCK_ENTRIES){
+		size_t block = queue->count/HASH_ME_BLOCK_ENTRIES;
+
+		if(block == queue->block_capacity){
+			size_t capacity = queue->block_capacity ? queue->block_capacity*2 : 64;
+			struct hash_me_entry **blocks = realloc(queue->blocks, capacity * sizeof(*blocks));
+
+			if(NULL == blocks){
+				pthread_mutex_unlock(&queue->lock);
+				sha256_error(MALLOC_ERROR);
+				free(path);
+				return -1;
+			}
+			queue->blocks = blocks;
+			queue->block_capacity = capacity;
+		}
+
+		queue->blocks[block] = malloc(HASH_ME_BLOCK_ENTRIES * sizeof(struct hash_me_entry));
+		if(NULL == queue->blocks[block]){
+			pthread_mutex_unlock(&queue->lock);
+			sha256_error(MALLOC_ERROR);
+			free(path);
+			return -1;
+		}
+	}
+
+	struct hash_me_entry *entry = hash_me_entry_at(queue, queue->count++);
+	*entry = *model;
+	entry->ready = 0;
+
+	pthread_cond_signal(&queue->queued);
+	pthread_mutex_unlock(&queue->lock);
+
+	return 0;
+}
+
+//Queues a path (taking ownership of it). error != 0 queues an entry that already failed, so its message
+//is printed in order. Returns 0 if it went OK, -1 otherwise.
+static int hash_me_queue_path(struct hash_me_queue *queue, char *path, int error){
+	struct hash_me_entry entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.path = path;
+	entry.error = error;
+	entry.size = -1;
+
+	return hash_me_queue_entry(queue, &entry);
+}
+
+//Queues every regular file under the directory path, recursively. Symbolic links to files are followed,
+//symbolic links to directories aren't (no loops).
+static void hash_me_walk(struct hash_me_queue *queue, const char *path){
+	DIR *directory = opendir(path);
+	struct dirent *dirent;
+	size_t path_length = strlen(path);
+
+	if(NULL == directory){
+		char *copy = strdup(path);
+		if(copy){
+			hash_me_queue_path(queue, copy, errno);
+		}
+		return;
+	}
+
+	while(NULL != (dirent = readdir(directory))){
+		if(0 == strcmp(dirent->d_name, ".") || 0 == strcmp(dirent->d_name, "..")){
+			continue;
+		}
+
+		size_t name_length = strlen(dirent->d_name);
+		char *child = malloc(path_length + name_length + 2);
+		if(NULL == child){
+			sha256_error(MALLOC_ERROR);
+			break;
+		}
+
+		memcpy(child, path, path_length);
+		size_t offset = path_length;
+		if(0 == path_length || '/' != path[path_length - 1]){
+			child[offset++] = '/';
+		}
+		memcpy(child + offset, dirent->d_name, name_length + 1);
+
+		unsigned char type = dirent->d_type;
+		struct stat st;
+
+		if(DT_UNKNOWN == type){
+			if(lstat(child, &st)){
+				hash_me_queue_path(queue, child, errno);
+				continue;
+			}
+			type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+		}
+
+		if(DT_LNK == type){
+			//Only links to regular files are hashed
+			type = (0 == stat(child, &st) && S_ISREG(st.st_mode)) ? DT_REG : DT_UNKNOWN;
+		}
+
+		if(DT_DIR == type){
+			hash_me_walk(queue, child);
+			free(child);
+		} else if(DT_REG == type){
+			hash_me_queue_path(queue, child, 0);
+		} else {
+			free(child);	//Devices, sockets, dangling links...
+		}
+	}
+
+	closedir(directory);
+}
+
+//Reads up to length bytes, retrying short reads. Returns the bytes read (less than length only at the
+//end of the file), or -1 on error.
+static ssize_t hash_me_read_full(int fd, unsigned char *buffer, size_t length){
+	size_t total = 0;
+
+	while(total < length){
+		ssize_t result = read(fd, buffer + total, length - total);
+
+		if(result < 0){
+			if(EINTR == errno){
+				continue;
+			}
+			return -1;
+		}
+		if(0 == result){
+			break;
+		}
+		total += (size_t) result;
+	}
+
+	return (ssize_t) total;
+}
+
+static void *hash_me_reader_run(void *argument){
+	struct hash_me_reader *reader = argument;
+
+	for(unsigned int c = 0; ; c = (c + 1) % 2){
+		pthread_mutex_lock(&reader->lock);
+		while(reader->full[c]){
+			pthread_cond_wait(&reader->changed, &reader->lock);
+		}
+		pthread_mutex_unlock(&reader->lock);
+
+		ssize_t length = hash_me_read_full(reader->fd, reader->buffers[c], HASH_ME_READ_SIZE);
+		int error = length < 0 ? errno : 0;
+
+		pthread_mutex_lock(&reader->lock);
+		reader->lengths[c] = length;
+		reader->error = error;
+		reader->full[c] = 1;
+		pthread_cond_signal(&reader->changed);
+		pthread_mutex_unlock(&reader->lock);
+
+		if(length <= 0){
+			return NULL;
+		}
+	}
+}
+
+//Hashes the rest of fd through the read-ahead thread. Returns 0 if it went OK, an errno value otherwise
+//(-1 if the thread couldn't be started, to fall back to plain reads).
+static int hash_me_stream_readahead(int fd, struct sha256_context *context, unsigned char *buffers){
+	struct hash_me_reader reader;
+	pthread_t thread;
+	int result = 0;
+
+	memset(&reader, 0, sizeof(reader));
+	reader.fd = fd;
+	reader.buffers[0] = buffers;
+	reader.buffers[1] = buffers + HASH_ME_READ_SIZE;
+	pthread_mutex_init(&reader.lock, NULL);
+	pthread_cond_init(&reader.changed, NULL);
+
+	if(pthread_create(&thread, NULL, hash_me_reader_run, &reader)){
+		pthread_cond_destroy(&reader.changed);
+		pthread_mutex_destroy(&reader.lock);
+		return -1;
+	}
+
+	for(unsigned int c = 0; ; c = (c + 1) % 2){
+		pthread_mutex_lock(&reader.lock);
+		while(!reader.full[c]){
+			pthread_cond_wait(&reader.changed, &reader.lock);
+		}
+		ssize_t length = reader.lengths[c];
+		pthread_mutex_unlock(&reader.lock);
+
+		if(length <= 0){
+			result = length < 0 ? reader.error : 0;
+			break;
+		}
+
+		sha256_context_update(context, reader.buffers[c], (size_t) length);
+
+		pthread_mutex_lock(&reader.lock);
+		reader.full[c] = 0;
+		pthread_cond_signal(&reader.changed);
+		pthread_mutex_unlock(&reader.lock);
+
+		//The reader stops after a short read, there's nothing left to wait for
+		if(length < HASH_ME_READ_SIZE){
+			break;
+		}
+	}
+
+	pthread_join(thread, NULL);
+	pthread_cond_destroy(&reader.changed);
+	pthread_mutex_destroy(&reader.lock);
+
+	return result;
+}
+
+//Hashes the rest of fd, prefix bytes being already read into the context. Returns 0 if it went OK,
+//an errno value otherwise.
+static int hash_me_stream(int fd, off_t size, struct sha256_context *context, unsigned char *buffers){
+	if(size > HASH_ME_READAHEAD_FILE){
+		int result = hash_me_stream_readahead(fd, context, buffers);
+
+		if(result >= 0){
+			return result;
+		}
+	}
+
+	for(;;){
+		ssize_t length = hash_me_read_full(fd, buffers, HASH_ME_READ_SIZE);
+
+		if(length < 0){
+			return errno;
+		}
+		if(0 == length){
+			return 0;
+		}
+		sha256_context_update(context, buffers, (size_t) length);
+	}
+}
+
+//Hashes an entry. Small regular files are only read into slot and a job is prepared for them (returns 1),
+//the rest are hashed right away (returns 0, the hash or the error are on the entry).
+static int hash_me_hash_entry(struct sha256_base *base, struct hash_me_entry *entry, unsigned char *slot, unsigned char *buffers,
+	struct sha256_job *job){
+	struct sha256_context context;
+	struct stat st;
+	int fd;
+	off_t size = 0;
+
+	if(entry->error){
+		return 0;
+	}
+
+	if(0 == strcmp(entry->path, "-")){
+		fd = STDIN_FILENO;
+	} else {
+		fd = open(entry->path, O_RDONLY);
+		if(fd < 0){
+			entry->error = errno;
+			return 0;
+		}
+
+		if(fstat(fd, &st)){
+			entry->error = errno;
+			close(fd);
+			return 0;
+		}
+		if(S_ISDIR(st.st_mode)){
+			entry->error = EISDIR;
+			close(fd);
+			return 0;
+		}
+		size = st.st_size;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	sha256_context_init(&context, base);
+
+	if(STDIN_FILENO != fd && S_ISREG(st.st_mode) && size <= HASH_ME_SMALL_FILE){
+		ssize_t length = hash_me_read_full(fd, slot, HASH_ME_SMALL_FILE);
+
+		if(length < 0){
+			entry->error = errno;
+			close(fd);
+			return 0;
+		}
+
+		//The file may have grown since fstat(), then it's streamed like the big ones
+		if(length < HASH_ME_SMALL_FILE){
+			close(fd);
+			sha256_job_init(job, sha256_default_hash_values, slot, (uint64_t) length*8, 0);
+			return 1;
+		}
+
+		sha256_context_update(&context, slot, (size_t) length);
+	}
+
+	entry->error = hash_me_stream(fd, size, &context, buffers);
+	if(0 == entry->error){
+		sha256_context_final(&context, entry->hash);
+	}
+
+	if(STDIN_FILENO != fd){
+		close(fd);
+	}
+
+	return 0;
+}
+
+//Prints a name escaped like sha256sum does (backslashes and newlines)
+static void hash_me_print_escaped(const char *path){
+	for(const char *c = path; *c; ++c){
+		if('\\' == *c){
+			fputs("\\\\", stdout);
+		} else if('\n' == *c){
+			fputs("\\n", stdout);
+		} else {
+			putchar(*c);
+		}
+	}
+}
+
+//Writes the hash as 64 lowercase hexadecimal digits and a null byte
+static void hash_me_to_hex(const unsigned char hash[32], char hex[65]){
+	static const char hex_digits[] = "0123456789abcdef";
+
+	for(int c = 0; c < 32; ++c){
+		hex[c*2] = hex_digits[hash[c] >> 4];
+		hex[c*2 + 1] = hex_digits[hash[c] & 0x0F];
+	}
+	hex[64] = '\0';
+}
+
+//Prints a result like sha256sum: names with a backslash or a newline are escaped and the line starts
+//with a backslash.
+static void hash_me_print(struct hash_me_queue *queue, struct hash_me_entry *entry){
+	char hex[65];
+
+	if(entry->error){
+		fprintf(stderr, "hash_me: %s: %s\n", entry->path, strerror(entry->error));
+		queue->failed = 1;
+		return;
+	}
+
+	hash_me_to_hex(entry->hash, hex);
+
+	if(NULL == strpbrk(entry->path, "\\\n")){
+		printf("%s  %s\n", hex, entry->path);
+		return;
+	}
+
+	printf("\\%s  ", hex);
+	hash_me_print_escaped(entry->path);
+	putchar('\n');
+}
+
+//Checks the entries a worker just hashed against their manifest digests and reports them (-c), like
+//sha256sum -c. The digests are compared as bytes, nothing is formatted but the names.
+static void hash_me_report(struct hash_me_queue *queue, struct hash_me_entry **entries, size_t count){
+	pthread_mutex_lock(&queue->lock);
+
+	for(size_t c = 0; c < count; ++c){
+		struct hash_me_entry *entry = entries[c];
+		const char *result = "OK";
+
+		//Another file already failed with -x: what's left of the claim isn't reported
+		if(queue->stop){
+			free(entry->path);
+			entry->path = NULL;
+			continue;
+		}
+
+		if(entry->error){
+			fprintf(stderr, "hash_me: %s: %s\n", entry->path, strerror(entry->error));
+			result = "FAILED open or read";
+			++queue->unreadable;
+		} else if(memcmp(entry->hash, entry->expected, 32)){
+			result = "FAILED";
+			++queue->mismatched;
+		}
+
+		//sha256sum -c only escapes the names with newlines
+		if(NULL != strchr(entry->path, '\n')){
+			putchar('\\');
+			hash_me_print_escaped(entry->path);
+		} else {
+			fputs(entry->path, stdout);
+		}
+		printf(": %s\n", result);
+
+		if('F' == result[0]){
+			queue->failed = 1;
+			queue->stop |= queue->fail_fast;
+		}
+
+		free(entry->path);
+		entry->path = NULL;
+	}
+
+	//Results are streamed as they come, one write per claim
+	fflush(stdout);
+
+	pthread_mutex_unlock(&queue->lock);
+}
+
+static void *hash_me_worker_run(void *argument){
+	struct hash_me_queue *queue = argument;
+	struct hash_me_entry *claimed[HASH_ME_CLAIM], *small[HASH_ME_CLAIM];
+	struct sha256_job jobs[HASH_ME_CLAIM];
+	unsigned char *slots = NULL, *buffers = NULL;
+
+	int no_memory = 0;
+
+	if(posix_memalign((void **) &slots, HASH_ME_ALIGNMENT, HASH_ME_CLAIM * HASH_ME_SMALL_FILE) ||
+		posix_memalign((void **) &buffers, HASH_ME_ALIGNMENT, 2 * HASH_ME_READ_SIZE)){
+		sha256_error(MALLOC_ERROR);
+		no_memory = 1;	//Still claim files, failing them, so the printer doesn't wait forever
+	}
+
+	for(;;){
+		size_t count = 0, jobs_count = 0;
+
+		pthread_mutex_lock(&queue->lock);
+		while(queue->next == queue->count && queue->walking){
+			pthread_cond_wait(&queue->queued, &queue->lock);
+		}
+		while(queue->next < queue->count && count < HASH_ME_CLAIM && !queue->stop){
+			struct hash_me_entry *entry = hash_me_entry_at(queue, queue->next++);
+
+			claimed[count++] = entry;
+
+			//A file known to be big is taken on its own, so the files behind it don't wait for it
+			if(entry->size > HASH_ME_SMALL_FILE){
+				break;
+			}
+		}
+		pthread_mutex_unlock(&queue->lock);
+
+		if(0 == count){
+			break;
+		}
+
+		for(size_t c = 0; c < count; ++c){
+			if(no_memory){
+				claimed[c]->error = claimed[c]->error ? claimed[c]->error : ENOMEM;
+			} else if(hash_me_hash_entry(queue->base, claimed[c], slots + jobs_count*HASH_ME_SMALL_FILE, buffers, &jobs[jobs_count])){
+				small[jobs_count++] = claimed[c];
+			}
+		}
+
+		sha256_compress_jobs(jobs, jobs_count);
+		for(size_t c = 0; c < jobs_count; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, small[c]->hash);
+		}
+
+		if(queue->verify){
+			hash_me_report(queue, claimed, count);
+			continue;
+		}
+
+		pthread_mutex_lock(&queue->lock);
+		for(size_t c = 0; c < count; ++c){
+			claimed[c]->ready = 1;
+		}
+		pthread_cond_broadcast(&queue->hashed);
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	free(buffers);
+	free(slots);
+
+	return NULL;
+}
+
+static void *hash_me_printer_run(void *argument){
+	struct hash_me_queue *queue = argument;
+
+	for(size_t printed = 0; ; ++printed){
+		pthread_mutex_lock(&queue->lock);
+		while(printed == queue->count && queue->walking){
+			pthread_cond_wait(&queue->queued, &queue->lock);
+		}
+		if(printed == queue->count){
+			pthread_mutex_unlock(&queue->lock);
+			break;
+		}
+
+		struct hash_me_entry *entry = hash_me_entry_at(queue, printed);
+		while(!entry->ready){
+			pthread_cond_wait(&queue->hashed, &queue->lock);
+		}
+		pthread_mutex_unlock(&queue->lock);
+
+		hash_me_print(queue, entry);
+		free(entry->path);
+	}
+
+	return NULL;
+}
+
+//Sets the queue up and starts thread_count workers. Returns the number of workers started (0 on error).
+static unsigned int hash_me_start(struct hash_me_queue *queue, unsigned int thread_count, pthread_t **workers){
+	unsigned int started;
+
+	memset(queue, 0, sizeof(*queue));
+	queue->walking = 1;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->queued, NULL);
+	pthread_cond_init(&queue->hashed, NULL);
+
+	queue->base = sha256_init();
+	*workers = malloc(thread_count * sizeof(**workers));
+	if(NULL == queue->base || NULL == *workers){
+		sha256_error(MALLOC_ERROR);
+		return 0;
+	}
+
+	setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+	for(started = 0; started < thread_count; ++started){
+		if(pthread_create(&(*workers)[started], NULL, hash_me_worker_run, queue)){
+			sha256_error(THREAD_ERROR);
+			break;
+		}
+	}
+
+	return started;
+}
+
+//Tells the workers nothing else will be queued, waits for them and frees the queue
+static void hash_me_finish(struct hash_me_queue *queue, pthread_t *workers, unsigned int started){
+	pthread_mutex_lock(&queue->lock);
+	queue->walking = 0;
+	pthread_cond_broadcast(&queue->queued);
+	pthread_mutex_unlock(&queue->lock);
+
+	for(unsigned int c = 0; c < started; ++c){
+		pthread_join(workers[c], NULL);
+	}
+}
+
+static void hash_me_destroy(struct hash_me_queue *queue, pthread_t *workers){
+	fflush(stdout);
+
+	for(size_t c = 0; c < queue->block_capacity && c*HASH_ME_BLOCK_ENTRIES < queue->count; ++c){
+		free(queue->blocks[c]);
+	}
+	free(queue->blocks);
+	free(workers);
+	pthread_cond_destroy(&queue->hashed);
+	pthread_cond_destroy(&queue->queued);
+	pthread_mutex_destroy(&queue->lock);
+	sha256_free(queue->base);
+}
+
+//Hashes the files and directories given (stdin if none) with thread_count workers.
+//Returns 0 if every file was hashed, 1 otherwise.
+static int hash_me_files(char **paths, int path_count, unsigned int thread_count){
+	static char stdin_path[] = "-";
+	char *stdin_paths[] = {stdin_path};
+	struct hash_me_queue queue;
+	pthread_t *workers = NULL;
+	pthread_t printer;
+	unsigned int started = hash_me_start(&queue, thread_count, &workers);
+
+	if(0 == started || pthread_create(&printer, NULL, hash_me_printer_run, &queue)){
+		sha256_error(THREAD_ERROR);
+		return 1;
+	}
+
+	if(0 == path_count){
+		paths = stdin_paths;
+		path_count = 1;
+	}
+
+	for(int c = 0; c < path_count; ++c){
+		struct stat st;
+
+		if(strcmp(paths[c], "-") && 0 == stat(paths[c], &st) && S_ISDIR(st.st_mode)){
+			hash_me_walk(&queue, paths[c]);
+		} else {
+			char *copy = strdup(paths[c]);
+			if(NULL == copy || hash_me_queue_path(&queue, copy, 0)){
+				break;
+			}
+		}
+	}
+
+	hash_me_finish(&queue, workers, started);
+	pthread_join(printer, NULL);
+	hash_me_destroy(&queue, workers);
+
+	return queue.failed;
+}
+
+//Value of a hexadecimal digit, -1 if it isn't one
+static int hash_me_hex_value(char digit){
+	if(digit >= '0' && digit <= '9'){
+		return digit - '0';
+	} else if(digit >= 'a' && digit <= 'f'){
+		return digit - 'a' + 10;
+	} else if(digit >= 'A' && digit <= 'F'){
+		return digit - 'A' + 10;
+	}
+	return -1;
+}
+
+//Parses a sha256sum line ("<hash>  <name>", "<hash> *<name>", or with a leading backslash if the name is
+//escaped). Returns 0 if it went OK, -1 if the line isn't properly formatted.
+static int hash_me_parse_line(char *line, struct hash_me_check_line *parsed){
+	size_t length = strlen(line);
+	int escaped = 0;
+
+	while(length && ('\n' == line[length - 1] || '\r' == line[length - 1])){
+		line[--length] = '\0';
+	}
+
+	if('\\' == line[0]){
+		escaped = 1;
+		++line;
+		--length;
+	}
+
+	if(length < 67 || ' ' != line[64] || (' ' != line[65] && '*' != line[65])){
+		return -1;
+	}
+
+	for(int c = 0; c < 32; ++c){
+		int high = hash_me_hex_value(line[c*2]), low = hash_me_hex_value(line[c*2 + 1]);
+
+		if(high < 0 || low < 0){
+			return -1;
+		}
+		parsed->expected[c] = (unsigned char) (high*16 + low);
+	}
+
+	//Undo the escaping in place, the name can only get shorter
+	char *name = line + 66;
+	if(escaped){
+		char *out = name;
+
+		for(char *in = name; *in; ++in){
+			if('\\' == *in){
+				++in;
+				if('n' == *in){
+					*out++ = '\n';
+				} else if('\\' == *in){
+					*out++ = '\\';
+				} else {
+					return -1;
+				}
+			} else {
+				*out++ = *in;
+			}
+		}
+		*out = '\0';
+	}
+
+	parsed->path = strdup(name);
+	if(NULL == parsed->path){
+		sha256_error(MALLOC_ERROR);
+		return -1;
+	}
+
+	return 0;
+}
+
+//Size class of a file: log2 of its size (files whose size couldn't be known go last)
+static int hash_me_size_class(int64_t size){
+	return size > 0 ? 64 - __builtin_clzll((unsigned long long) size) : 0;
+}
+
+//Biggest size class first (the biggest files can't be split, they must start early), then by device
+//and inode so files of a similar size are read in disk order
+static int hash_me_check_compare(const void *a, const void *b){
+	const struct hash_me_check_line *left = a, *right = b;
+	int left_class = hash_me_size_class(left->size), right_class = hash_me_size_class(right->size);
+
+	if(left_class != right_class){
+		return right_class - left_class;
+	}
+	if(left->device != right->device){
+		return left->device < right->device ? -1 : 1;
+	}
+	if(left->inode != right->inode){
+		return left->inode < right->inode ? -1 : 1;
+	}
+	return 0;
+}
+
+//Verifies the files listed on sha256sum manifests ('-' = stdin) with thread_count workers, reporting
+//each one as soon as it's checked. fail_fast stops at the first failure.
+//Returns 0 if every file matched, 1 otherwise.
+static int hash_me_check(char **manifests, int manifest_count, unsigned int thread_count, int fail_fast){
+	static char stdin_path[] = "-";
+	char *stdin_paths[] = {stdin_path};
+	struct hash_me_check_line *lines = NULL;
+	size_t count = 0, capacity = 0, improper = 0;
+	char *line = NULL;
+	size_t line_capacity = 0;
+
+	if(0 == manifest_count){
+		manifests = stdin_paths;
+		manifest_count = 1;
+	}
+
+	for(int c = 0; c < manifest_count; ++c){
+		FILE *manifest = strcmp(manifests[c], "-") ? fopen(manifests[c], "r") : stdin;
+
+		if(NULL == manifest){
+			fprintf(stderr, "hash_me: %s: %s\n", manifests[c], strerror(errno));
+			free(line);
+			return 1;
+		}
+
+		while(getline(&line, &line_capacity, manifest) > 0){
+			struct hash_me_check_line parsed;
+			struct stat st;
+
+			if(hash_me_parse_line(line, &parsed)){
+				++improper;
+				continue;
+			}
+
+			parsed.size = -1;
+			parsed.device = 0;
+			parsed.inode = 0;
+			if(0 == stat(parsed.path, &st)){
+				parsed.size = S_ISREG(st.st_mode) ? (int64_t) st.st_size : -1;
+				parsed.device = st.st_dev;
+				parsed.inode = st.st_ino;
+			}
+
+			if(count == capacity){
+				capacity = capacity ? capacity*2 : 1024;
+				struct hash_me_check_line *grown = realloc(lines, capacity * sizeof(*lines));
+				if(NULL == grown){
+					sha256_error(MALLOC_ERROR);
+					free(parsed.path);
+					break;
+				}
+				lines = grown;
+			}
+			lines[count++] = parsed;
+		}
+
+		if(stdin != manifest){
+			fclose(manifest);
+		}
+	}
+	free(line);
+
+	if(improper){
+		fprintf(stderr, "hash_me: WARNING: %zu line(s) improperly formatted\n", improper);
+	}
+	if(0 == count){
+		fprintf(stderr, "hash_me: no properly formatted checksum lines found\n");
+		free(lines);
+		return 1;
+	}
+
+	qsort(lines, count, sizeof(*lines), hash_me_check_compare);
+
+	struct hash_me_queue queue;
+	pthread_t *workers = NULL;
+	unsigned int started = hash_me_start(&queue, thread_count, &workers);
+
+	queue.verify = 1;
+	queue.fail_fast = fail_fast;
+
+	for(size_t c = 0; c < count; ++c){
+		struct hash_me_entry entry;
+
+		memset(&entry, 0, sizeof(entry));
+		entry.path = lines[c].path;
+		entry.size = lines[c].size;
+		memcpy(entry.expected, lines[c].expected, 32);
+
+		if(hash_me_queue_entry(&queue, &entry)){
+			for(++c; c < count; ++c){
+				free(lines[c].path);
+			}
+			queue.failed = 1;
+			break;
+		}
+	}
+	free(lines);
+
+	if(0 == started){
+		queue.failed = 1;
+	}
+
+	hash_me_finish(&queue, workers, started);
+
+	//Entries left behind by a failure with fail_fast (or by the lack of workers)
+	for(size_t c = queue.next; c < queue.count; ++c){
+		free(hash_me_entry_at(&queue, c)->path);
+	}
+
+	if(queue.unreadable){
+		fprintf(stderr, "hash_me: WARNING: %zu listed file(s) could not be read\n", queue.unreadable);
+	}
+	if(queue.mismatched){
+		fprintf(stderr, "hash_me: WARNING: %zu computed checksum(s) did NOT match\n", queue.mismatched);
+	}
+
+	hash_me_destroy(&queue, workers);
+
+	return queue.failed;
+}
+
+//Write end of the server's wake pipe, for the signal handler
+static int hash_me_wake_fd = -1;
+static volatile sig_atomic_t hash_me_interrupted = 0;
+
+static void hash_me_server_signal(int signal_number){
+	int saved = errno;
+	ssize_t ignored = write(hash_me_wake_fd, "", 1);
+
+	(void) ignored;
+	(void) signal_number;
+	hash_me_interrupted = 1;
+	errno = saved;
+}
+
+//Wakes the loop up (the pipe may be full, then it's already awake)
+static void hash_me_server_wake(struct hash_me_server *server){
+	ssize_t ignored = write(server->wake[1], "", 1);
+
+	(void) ignored;
+}
+
+static void *hash_me_server_worker_run(void *argument){
+	struct hash_me_server *server = argument;
+	struct hash_me_request *claimed[HASH_ME_CLAIM];
+	struct hash_me_entry entries[HASH_ME_CLAIM], *small[HASH_ME_CLAIM];
+	struct sha256_job jobs[HASH_ME_CLAIM];
+	unsigned char *slots = NULL, *buffers = NULL;
+
+	int no_memory = 0;
+
+	if(posix_memalign((void **) &slots, HASH_ME_ALIGNMENT, HASH_ME_CLAIM * HASH_ME_SMALL_FILE) ||
+		posix_memalign((void **) &buffers, HASH_ME_ALIGNMENT, 2 * HASH_ME_READ_SIZE)){
+		sha256_error(MALLOC_ERROR);
+		no_memory = 1;	//Still claim files, failing them, so their clients get a reply
+	}
+
+	for(;;){
+		size_t count = 0, jobs_count = 0;
+
+		pthread_mutex_lock(&server->lock);
+		while(NULL == server->files_first && !server->stopping){
+			pthread_cond_wait(&server->queued, &server->lock);
+		}
+		while(server->files_first && count < HASH_ME_CLAIM && !server->stopping){
+			claimed[count++] = server->files_first;
+			server->files_first = server->files_first->next_file;
+		}
+		pthread_mutex_unlock(&server->lock);
+
+		if(0 == count){
+			break;
+		}
+
+		for(size_t c = 0; c < count; ++c){
+			memset(&entries[c], 0, sizeof(entries[c]));
+			entries[c].path = claimed[c]->path;
+			entries[c].size = -1;
+
+			if(no_memory){
+				entries[c].error = ENOMEM;
+			} else if(hash_me_hash_entry(server->base, &entries[c], slots + jobs_count*HASH_ME_SMALL_FILE, buffers, &jobs[jobs_count])){
+				small[jobs_count++] = &entries[c];
+			}
+		}
+
+		sha256_compress_jobs(jobs, jobs_count);
+		for(size_t c = 0; c < jobs_count; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, small[c]->hash);
+		}
+
+		pthread_mutex_lock(&server->lock);
+		for(size_t c = 0; c < count; ++c){
+			claimed[c]->error = entries[c].error;
+			memcpy(claimed[c]->hash, entries[c].hash, 32);
+			claimed[c]->ready = 1;
+		}
+		pthread_mutex_unlock(&server->lock);
+
+		hash_me_server_wake(server);
+	}
+
+	free(buffers);
+	free(slots);
+
+	return NULL;
+}
+
+//Appends a request to the connection. Returns NULL if there's no memory (the connection is dropped then).
+static struct hash_me_request *hash_me_server_request(struct hash_me_connection *connection, char kind, int binary){
+	struct hash_me_request *request = calloc(1, sizeof(*request));
+
+	if(NULL == request){
+		sha256_error(MALLOC_ERROR);
+		connection->closing = 1;
+		connection->dead = 1;
+		return NULL;
+	}
+
+	request->kind = kind;
+	request->binary = binary;
+	request->start = sha256_stats_now();
+
+	if(connection->last){
+		connection->last->next = request;
+	} else {
+		connection->first = request;
+	}
+	connection->last = request;
+
+	return request;
+}
+
+//Adds a small inline request to the batch of the round, its data staying on the connection's input.
+//Returns 0 if it went OK, -1 otherwise.
+static int hash_me_server_batch(struct hash_me_server *server, struct hash_me_request *request, const unsigned char *data, size_t length){
+	if(server->batch_count == server->batch_capacity){
+		size_t capacity = server->batch_capacity ? server->batch_capacity*2 : 64;
+		struct sha256_job *jobs = realloc(server->jobs, capacity * sizeof(*jobs));
+
+		if(NULL == jobs){
+			sha256_error(MALLOC_ERROR);
+			return -1;
+		}
+		server->jobs = jobs;
+
+		struct hash_me_request **batched = realloc(server->batched, capacity * sizeof(*batched));
+		if(NULL == batched){
+			sha256_error(MALLOC_ERROR);
+			return -1;
+		}
+		server->batched = batched;
+		server->batch_capacity = capacity;
+	}
+
+	sha256_job_init(&server->jobs[server->batch_count], sha256_default_hash_values, data, (uint64_t) length*8, 0);
+	server->batched[server->batch_count++] = request;
+
+	return 0;
+}
+
+//Hashes the small inline requests of the round together through the multi-buffer engine
+static void hash_me_server_run_batch(struct hash_me_server *server){
+	if(0 == server->batch_count){
+		return;
+	}
+
+	sha256_compress_jobs(server->jobs, server->batch_count);
+	for(size_t c = 0; c < server->batch_count; ++c){
+		sha256_hash_values_to_bytes(server->jobs[c].hash_values, server->batched[c]->hash);
+		server->batched[c]->ready = 1;
+	}
+
+	++server->batches;
+	server->batched_requests += server->batch_count;
+	if(server->batch_count > server->largest_batch){
+		server->largest_batch = server->batch_count;
+	}
+	server->batch_count = 0;
+}
+
+//Answers a malformed request and stops reading the connection, nothing after it can be trusted
+static void hash_me_server_malformed(struct hash_me_connection *connection){
+	struct hash_me_request *request = hash_me_server_request(connection, 'e', 0);
+
+	if(request){
+		request->ready = 1;
+	}
+	connection->input_offset = connection->input_length;
+	connection->closing = 1;
+}
+
+//Parses the complete requests read on the connection. Small inline requests wait for their whole data
+//and join the batch, bigger ones are hashed as their data arrives and files are queued for the workers.
+static void hash_me_server_parse(struct hash_me_server *server, struct hash_me_connection *connection){
+	char line[HASH_ME_LINE_SIZE + 1];
+
+	while(!connection->dead){
+		unsigned char *pointer = connection->input + connection->input_offset;
+		size_t available = connection->input_length - connection->input_offset;
+
+		if(connection->streaming){
+			size_t length = available < connection->stream_left ? available : (size_t) connection->stream_left;
+
+			if(0 == length){
+				break;
+			}
+
+			sha256_context_update(&connection->context, pointer, length);
+			connection->input_offset += length;
+			connection->stream_left -= length;
+			server->data_bytes += length;
+
+			if(0 == connection->stream_left){
+				sha256_context_final(&connection->context, connection->streaming->hash);
+				connection->streaming->ready = 1;
+				connection->streaming = NULL;
+			}
+			continue;
+		}
+
+		unsigned char *end = memchr(pointer, '\n', available);
+		if(NULL == end){
+			if(available > HASH_ME_LINE_SIZE){
+				hash_me_server_malformed(connection);
+			}
+			break;
+		}
+
+		size_t consumed = (size_t) (end - pointer) + 1, line_length = consumed - 1;
+		if(line_length && '\r' == pointer[line_length - 1]){
+			--line_length;
+		}
+		if(0 == line_length || line_length > HASH_ME_LINE_SIZE){
+			hash_me_server_malformed(connection);
+			break;
+		}
+		memcpy(line, pointer, line_length);
+		line[line_length] = '\0';
+
+		char kind = (char) (line[0] | 0x20);	//Lowercase: hexadecimal reply, uppercase: binary
+		int binary = 'D' == line[0] || 'F' == line[0];
+		struct hash_me_request *request;
+
+		if('d' == kind && ' ' == line[1] && line[2] >= '0' && line[2] <= '9'){
+			char *number_end;
+			unsigned long long length;
+
+			errno = 0;
+			length = strtoull(line + 2, &number_end, 10);
+
+			if('\0' != *number_end || ERANGE == errno){
+				hash_me_server_malformed(connection);
+				break;
+			}
+
+			//Small data is hashed with the rest of the batch once it's all there
+			if(length <= HASH_ME_SMALL_FILE && available - consumed < length){
+				break;
+			}
+
+			request = hash_me_server_request(connection, 'd', binary);
+			if(NULL == request){
+				break;
+			}
+			++server->data_requests;
+			connection->input_offset += consumed;
+
+			if(length <= HASH_ME_SMALL_FILE){
+				if(hash_me_server_batch(server, request, pointer + consumed, (size_t) length)){
+					request->error = ENOMEM;
+					request->ready = 1;
+				}
+				connection->input_offset += (size_t) length;
+				server->data_bytes += length;
+			} else {
+				sha256_context_init(&connection->context, server->base);
+				connection->streaming = request;
+				connection->stream_left = length;
+			}
+		} else if('f' == kind && ' ' == line[1] && line_length > 2){
+			request = hash_me_server_request(connection, 'f', binary);
+			if(NULL == request){
+				break;
+			}
+			++server->file_requests;
+			connection->input_offset += consumed;
+
+			//"-" would be the server's stdin
+			request->path = strdup(strcmp(line + 2, "-") ? line + 2 : "./-");
+			if(NULL == request->path){
+				sha256_error(MALLOC_ERROR);
+				request->error = ENOMEM;
+				request->ready = 1;
+				continue;
+			}
+
+			pthread_mutex_lock(&server->lock);
+			if(server->files_last && server->files_first){
+				server->files_last->next_file = request;
+			} else {
+				server->files_first = request;
+			}
+			server->files_last = request;
+			pthread_cond_signal(&server->queued);
+			pthread_mutex_unlock(&server->lock);
+		} else if('s' == line[0] && 1 == line_length){
+			request = hash_me_server_request(connection, 's', 0);
+			if(NULL == request){
+				break;
+			}
+			++server->stats_requests;
+			connection->input_offset += consumed;
+			request->ready = 1;
+		} else {
+			hash_me_server_malformed(connection);
+			break;
+		}
+	}
+}
+
+//Reads what the client sent. Returns 0 if it went OK, -1 at the end of the requests or on error.
+static int hash_me_server_read(struct hash_me_connection *connection){
+	//Nothing on the input is referenced anymore: the batch of the previous round was hashed
+	if(connection->input_offset){
+		memmove(connection->input, connection->input + connection->input_offset, connection->input_length - connection->input_offset);
+		connection->input_length -= connection->input_offset;
+		connection->input_offset = 0;
+	}
+
+	if(connection->input_capacity - connection->input_length < HASH_ME_SMALL_FILE){
+		size_t capacity = connection->input_length + 2*HASH_ME_SMALL_FILE;
+		unsigned char *input = realloc(connection->input, capacity);
+
+		if(NULL == input){
+			sha256_error(MALLOC_ERROR);
+			connection->dead = 1;
+			return -1;
+		}
+		connection->input = input;
+		connection->input_capacity = capacity;
+	}
+
+	ssize_t length = read(connection->fd, connection->input + connection->input_length, connection->input_capacity - connection->input_length);
+
+	if(length < 0 && (EINTR == errno || EAGAIN == errno || EWOULDBLOCK == errno)){
+		return 0;
+	}
+	if(length <= 0){
+		if(length < 0){
+			connection->dead = 1;
+		}
+		return -1;
+	}
+
+	connection->input_length += (size_t) length;
+	return 0;
+}
+
+//Queues bytes on the connection's output
+static void hash_me_server_write(struct hash_me_connection *connection, const void *data, size_t length){
+	if(connection->dead){
+		return;
+	}
+
+	if(connection->output_capacity - connection->output_length < length){
+		size_t capacity = connection->output_capacity ? connection->output_capacity : 4096;
+		char *output;
+
+		while(capacity - connection->output_length < length){
+			capacity *= 2;
+		}
+
+		output = realloc(connection->output, capacity);
+		if(NULL == output){
+			sha256_error(MALLOC_ERROR);
+			connection->dead = 1;
+			return;
+		}
+		connection->output = output;
+		connection->output_capacity = capacity;
+	}
+
+	memcpy(connection->output + connection->output_length, data, length);
+	connection->output_length += length;
+}
+
+//Latency below which fraction of the replies were queued, in microseconds. The histogram only keeps
+//powers of two, so it's the upper bound of the bucket (never more than the slowest reply).
+static double hash_me_server_percentile(const struct hash_me_server *server, double fraction){
+	uint64_t rank = (uint64_t) (fraction*(double) server->replies), seen = 0;
+
+	for(unsigned int bucket = 0; bucket < SHA256_STATS_BUCKETS; ++bucket){
+		seen += server->latency[bucket];
+		if(seen > rank){
+			uint64_t bound = (uint64_t) 2 << bucket;
+			return (double) (bound < server->latency_max ? bound : server->latency_max)/1000;
+		}
+	}
+
+	return 0;
+}
+
+//Writes the statistics as "name value" lines followed by an empty line. Returns the length written.
+static int hash_me_server_stats(const struct hash_me_server *server, char *text, size_t size){
+	double seconds = (double) (sha256_stats_now() - server->start)/1e9;
+	uint64_t requests = server->data_requests + server->file_requests + server->stats_requests;
+
+	return snprintf(text, size,
+		"uptime_seconds %.3f\n"
+		"connections_accepted %llu\n"
+		"connections_open %zu\n"
+		"requests_data %llu\n"
+		"requests_file %llu\n"
+		"requests_stats %llu\n"
+		"replies %llu\n"
+		"replies_failed %llu\n"
+		"data_bytes %llu\n"
+		"batches %llu\n"
+		"batched_requests %llu\n"
+		"batch_largest %llu\n"
+		"requests_per_second %.1f\n"
+		"data_megabytes_per_second %.3f\n"
+		"latency_mean_us %.1f\n"
+		"latency_p50_us %.1f\n"
+		"latency_p99_us %.1f\n"
+		"latency_max_us %.1f\n"
+		"\n",
+		seconds, (unsigned long long) server->connections_accepted, server->connection_count,
+		(unsigned long long) server->data_requests, (unsigned long long) server->file_requests,
+		(unsigned long long) server->stats_requests, (unsigned long long) server->replies,
+		(unsigned long long) server->failed, (unsigned long long) server->data_bytes,
+		(unsigned long long) server->batches, (unsigned long long) server->batched_requests,
+		(unsigned long long) server->largest_batch,
+		seconds > 0 ? (double) requests/seconds : 0, seconds > 0 ? (double) server->data_bytes/seconds/1e6 : 0,
+		server->replies ? (double) server->latency_total/(double) server->replies/1000 : 0,
+		hash_me_server_percentile(server, 0.5), hash_me_server_percentile(server, 0.99), (double) server->latency_max/1000);
+}
+
+//Formats the reply of a request and accounts it
+static void hash_me_server_reply(struct hash_me_server *server, struct hash_me_connection *connection, struct hash_me_request *request){
+	char text[2048];
+	int length;
+
+	if('s' == request->kind){
+		length = hash_me_server_stats(server, text, sizeof(text));
+		hash_me_server_write(connection, text, (size_t) length);
+	} else if('e' == request->kind){
+		length = snprintf(text, sizeof(text), "error %s\n", strerror(EPROTO));
+		hash_me_server_write(connection, text, (size_t) length);
+		++server->failed;
+	} else if(request->binary){
+		//A status byte: 0 and the 32 bytes of the digest, or the errno of the failure alone
+		unsigned char reply[33] = {0};
+
+		reply[0] = (unsigned char) (request->error > 0 && request->error < 256 ? request->error : request->error ? 255 : 0);
+		memcpy(reply + 1, request->hash, 32);
+		hash_me_server_write(connection, reply, request->error ? 1 : sizeof(reply));
+		server->failed += 0 != request->error;
+	} else if(request->error){
+		length = snprintf(text, sizeof(text), "error %s\n", strerror(request->error));
+		hash_me_server_write(connection, text, (size_t) length);
+		++server->failed;
+	} else {
+		hash_me_to_hex(request->hash, text);
+		text[64] = '\n';
+		hash_me_server_write(connection, text, 65);
+	}
+
+	uint64_t elapsed = sha256_stats_now() - request->start;
+	unsigned int bucket = 0;
+
+	while(elapsed >> (bucket + 1) && bucket < SHA256_STATS_BUCKETS - 1){
+		++bucket;
+	}
+	++server->latency[bucket];
+	++server->replies;
+	server->latency_total += elapsed;
+	if(elapsed > server->latency_max){
+		server->latency_max = elapsed;
+	}
+}
+
+//Replies to the requests that are ready, in order, and sends as much as the socket takes
+static void hash_me_server_flush(struct hash_me_server *server, struct hash_me_connection *connection){
+	struct hash_me_request *ready = connection->first, *request;
+
+	//Files are hashed by the workers: their requests are only checked under the lock
+	pthread_mutex_lock(&server->lock);
+	while(connection->first && connection->first->ready){
+		connection->first = connection->first->next;
+	}
+	if(NULL == connection->first){
+		connection->last = NULL;
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	while(ready != connection->first){
+		request = ready;
+		ready = ready->next;
+
+		hash_me_server_reply(server, connection, request);
+		free(request->path);
+		free(request);
+	}
+
+	while(!connection->dead && connection->output_sent < connection->output_length){
+		ssize_t length = send(connection->fd, connection->output + connection->output_sent,
+			connection->output_length - connection->output_sent, MSG_NOSIGNAL);
+
+		if(length < 0){
+			if(EINTR == errno){
+				continue;
+			}
+			if(EAGAIN != errno && EWOULDBLOCK != errno){
+				connection->dead = 1;
+			}
+			break;
+		}
+		connection->output_sent += (size_t) length;
+	}
+
+	if(connection->dead){
+		connection->closing = 1;
+		connection->output_sent = connection->output_length;
+	}
+	if(connection->output_sent == connection->output_length){
+		connection->output_sent = 0;
+		connection->output_length = 0;
+	}
+}
+
+//Accepts the clients waiting on the listener
+static void hash_me_server_accept(struct hash_me_server *server){
+	for(;;){
+		int fd = accept(server->listener, NULL, NULL);
+
+		if(fd < 0){
+			if(EINTR == errno){
+				continue;
+			}
+			if(EAGAIN != errno && EWOULDBLOCK != errno){
+				fprintf(stderr, "hash_me: accept: %s\n", strerror(errno));
+			}
+			return;
+		}
+
+		if(server->connection_count == server->connection_capacity){
+			size_t capacity = server->connection_capacity ? server->connection_capacity*2 : 16;
+			struct hash_me_connection **connections = realloc(server->connections, capacity * sizeof(*connections));
+
+			if(NULL == connections){
+				sha256_error(MALLOC_ERROR);
+				close(fd);
+				return;
+			}
+			server->connections = connections;
+			server->connection_capacity = capacity;
+		}
+
+		struct hash_me_connection *connection = calloc(1, sizeof(*connection));
+		if(NULL == connection){
+			sha256_error(MALLOC_ERROR);
+			close(fd);
+			return;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		connection->fd = fd;
+		server->connections[server->connection_count++] = connection;
+		++server->connections_accepted;
+	}
+}
+
+static void hash_me_server_close(struct hash_me_connection *connection){
+	while(connection->first){
+		struct hash_me_request *next = connection->first->next;
+
+		free(connection->first->path);
+		free(connection->first);
+		connection->first = next;
+	}
+
+	close(connection->fd);
+	free(connection->input);
+	free(connection->output);
+	free(connection);
+}
+
+//Event loop: every round reads what every client sent, hashes the small inline requests of all of them
+//in one batch and sends the replies that are ready, until a signal stops the server
+static void hash_me_server_loop(struct hash_me_server *server){
+	struct pollfd *polls = NULL;
+	size_t poll_capacity = 0;
+
+	while(!hash_me_interrupted){
+		size_t polled = server->connection_count;
+
+		if(polled + 2 > poll_capacity){
+			struct pollfd *grown = realloc(polls, (polled + 2) * sizeof(*polls));
+
+			if(NULL == grown){
+				sha256_error(MALLOC_ERROR);
+				break;
+			}
+			polls = grown;
+			poll_capacity = polled + 2;
+		}
+
+		polls[0].fd = server->listener;
+		polls[0].events = POLLIN;
+		polls[1].fd = server->wake[0];
+		polls[1].events = POLLIN;
+		for(size_t c = 0; c < polled; ++c){
+			struct hash_me_connection *connection = server->connections[c];
+
+			//A connection that only waits for the workers isn't polled (it would keep reporting POLLHUP)
+			polls[c + 2].fd = connection->closing && 0 == connection->output_length ? -1 : connection->fd;
+			polls[c + 2].events = (short) ((connection->closing ? 0 : POLLIN) | (connection->output_length ? POLLOUT : 0));
+		}
+
+		if(poll(polls, polled + 2, -1) < 0){
+			if(EINTR == errno){
+				continue;
+			}
+			fprintf(stderr, "hash_me: poll: %s\n", strerror(errno));
+			break;
+		}
+
+		if(polls[1].revents & POLLIN){
+			char drain[256];
+
+			while(read(server->wake[0], drain, sizeof(drain)) > 0);
+		}
+
+		//Connections accepted now are only read in the next round, after the polled ones
+		if(polls[0].revents & POLLIN){
+			hash_me_server_accept(server);
+		}
+
+		for(size_t c = 0; c < polled; ++c){
+			struct hash_me_connection *connection = server->connections[c];
+
+			if(connection->closing || 0 == (polls[c + 2].revents & (POLLIN | POLLHUP | POLLERR))){
+				continue;
+			}
+
+			int end = hash_me_server_read(connection);
+			hash_me_server_parse(server, connection);
+
+			if(end && !connection->closing){
+				connection->closing = 1;
+
+				//The client stopped in the middle of a request
+				if(connection->streaming){
+					connection->streaming->error = EPROTO;
+					connection->streaming->ready = 1;
+					connection->streaming = NULL;
+				} else if(connection->input_offset < connection->input_length && !connection->dead){
+					hash_me_server_malformed(connection);
+				}
+			}
+		}
+
+		hash_me_server_run_batch(server);
+
+		//Backwards, so a finished connection can be replaced by the last one
+		for(size_t c = server->connection_count; c-- > 0;){
+			struct hash_me_connection *connection = server->connections[c];
+
+			hash_me_server_flush(server, connection);
+
+			//Requests still in the workers' hands keep the connection open
+			if(connection->closing && NULL == connection->first && 0 == connection->output_length){
+				hash_me_server_close(connection);
+				server->connections[c] = server->connections[--server->connection_count];
+			}
+		}
+	}
+
+	free(polls);
+}
+
+//Tells whether the socket at address is stale: 1 if nobody listens on it anymore (the connection is
+//refused), 0 if a server answers or it can't be known
+static int hash_me_server_stale(const struct sockaddr_un *address){
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0), stale = 0;
+
+	if(fd < 0){
+		return 0;
+	}
+	if(connect(fd, (const struct sockaddr *) address, sizeof(*address)) && ECONNREFUSED == errno){
+		stale = 1;
+	}
+	close(fd);
+
+	return stale;
+}
+
+//Removes the socket at path if it's still the one the server bound (it may have been replaced since)
+static void hash_me_server_unlink(const char *path, const struct stat *bound){
+	struct stat st;
+
+	if(0 == lstat(path, &st) && S_ISSOCK(st.st_mode) && st.st_dev == bound->st_dev && st.st_ino == bound->st_ino){
+		unlink(path);
+	}
+}
+
+//Serves hash requests on a Unix domain socket at path until SIGINT or SIGTERM, with thread_count
+//workers for the files. Clients may pipeline any number of requests, each one answered in order:
+//"d <length>\n" followed by length bytes hashes the bytes, "f <path>\n" hashes a file and "s\n" sends the
+//statistics. Uppercase 'D' and 'F' get a binary reply instead of a line of hexadecimal digits.
+//Returns 0 when stopped by a signal, 1 if the server couldn't run.
+static int hash_me_serve(const char *path, unsigned int thread_count){
+	struct hash_me_server server;
+	struct sockaddr_un address;
+	struct sigaction action;
+	struct stat st, bound;
+	pthread_t *workers;
+	unsigned int started;
+
+	memset(&server, 0, sizeof(server));
+	memset(&address, 0, sizeof(address));
+
+	if(strlen(path) >= sizeof(address.sun_path)){
+		fprintf(stderr, "hash_me: %s: %s\n", path, strerror(ENAMETOOLONG));
+		return 1;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	//A socket left behind by a server that didn't stop cleanly (nothing else is ever removed, and a
+	//server still listening keeps its socket: bind() fails then)
+	if(0 == lstat(path, &st) && S_ISSOCK(st.st_mode) && hash_me_server_stale(&address)){
+		unlink(path);
+	}
+
+	server.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(server.listener < 0 || bind(server.listener, (struct sockaddr *) &address, sizeof(address))){
+		fprintf(stderr, "hash_me: %s: %s\n", path, strerror(errno));
+		if(server.listener >= 0){
+			close(server.listener);
+		}
+		return 1;
+	}
+
+	//The socket this server owns, the only one it removes
+	memset(&bound, 0, sizeof(bound));
+	lstat(path, &bound);
+
+	if(listen(server.listener, SOMAXCONN) || pipe(server.wake)){
+		fprintf(stderr, "hash_me: %s: %s\n", path, strerror(errno));
+		hash_me_server_unlink(path, &bound);
+		close(server.listener);
 		return 1;
 	}
 
+	fcntl(server.listener, F_SETFL, fcntl(server.listener, F_GETFL) | O_NONBLOCK);
+	fcntl(server.wake[0], F_SETFL, fcntl(server.wake[0], F_GETFL) | O_NONBLOCK);
+	fcntl(server.wake[1], F_SETFL, fcntl(server.wake[1], F_GETFL) | O_NONBLOCK);
+
+	hash_me_wake_fd = server.wake[1];
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = hash_me_server_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.queued, NULL);
+	server.start = sha256_stats_now();
+	server.base = sha256_init();
+	workers = malloc(thread_count * sizeof(*workers));
+	if(NULL == server.base || NULL == workers){
+		sha256_error(MALLOC_ERROR);
+		thread_count = 0;
+	}
+
+	for(started = 0; started < thread_count; ++started){
+		if(pthread_create(&workers[started], NULL, hash_me_server_worker_run, &server)){
+			sha256_error(THREAD_ERROR);
+			break;
+		}
+	}
+
+	if(started){
+		fprintf(stderr, "hash_me: listening on %s\n", path);
+		hash_me_server_loop(&server);
+	}
+
+	pthread_mutex_lock(&server.lock);
+	server.stopping = 1;
+	pthread_cond_broadcast(&server.queued);
+	pthread_mutex_unlock(&server.lock);
+
+	for(unsigned int c = 0; c < started; ++c){
+		pthread_join(workers[c], NULL);
+	}
+
+	if(started){
+		char text[2048];
+
+		hash_me_server_stats(&server, text, sizeof(text));
+		fputs(text, stderr);
+	}
+
+	for(size_t c = 0; c < server.connection_count; ++c){
+		hash_me_server_close(server.connections[c]);
+	}
+
+	hash_me_server_unlink(path, &bound);
+	close(server.listener);
+	close(server.wake[0]);
+	close(server.wake[1]);
+	hash_me_wake_fd = -1;
+
+	free(server.connections);
+	free(server.jobs);
+	free(server.batched);
+	free(workers);
+	pthread_cond_destroy(&server.queued);
+	pthread_mutex_destroy(&server.lock);
+	sha256_free(server.base);
+
+	return started ? 0 : 1;
+}
+
+//Hashes a string given on the command line
+static int hash_me_string(const char *string){
 	struct sha256_base *handler = sha256_init();
 	//Function won't include the null byte in the message
-	struct sha256_message *msg = sha256_message_create_from_string(argv[1], handler);
+	struct sha256_message *msg = sha256_message_create_from_string(string, handler);
 
 	//Preprocess messages
 	sha256_message_preprocess(msg);
@@ -33,3 +1816,50 @@ int main(int argc, char **argv){
 
 	return 0;
 }
+
+int main(int argc, char **argv){
+	unsigned int thread_count = 0;
+	int check = 0, fail_fast = 0;
+	const char *socket_path = NULL;
+	int option;
+
+	while(-1 != (option = getopt(argc, argv, "s:j:l:cxh"))){
+		switch(option){
+			case 's':
+				return hash_me_string(optarg);
+			case 'j':
+				thread_count = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				check = 1;
+				break;
+			case 'x':
+				fail_fast = 1;
+				break;
+			case 'l':
+				socket_path = optarg;
+				break;
+			default:
+				puts("[USAGE] ./bin/hash_me [-j threads] [file or directory]... ('-' or nothing = stdin)");
+				puts("        ./bin/hash_me -c [-x] [-j threads] [manifest]... ('-' or nothing = stdin)");
+				puts("        ./bin/hash_me -s 'message to hash'");
+				puts("        ./bin/hash_me -l socket [-j threads] (server, stopped by SIGINT or SIGTERM)");
+				return 'h' == option ? 0 : 1;
+		}
+	}
+
+	if(0 == thread_count){
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = online > 0 ? (unsigned int) online : 1;
+	}
+
+	if(socket_path){
+		return hash_me_serve(socket_path, thread_count);
+	}
+
+	if(check){
+		return hash_me_check(argv + optind, argc - optind, thread_count, fail_fast);
+	}
+
+	return hash_me_files(argv + optind, argc - optind, thread_count);
+}
@@ -0,0 +1,214 @@
+#include "sha256_digest.h"
+
+//Arena allocator owned by a sha256_base. Small allocations are carved from big chunks with a bump
+//pointer, message structures deleted one by one are recycled through a free list, and
+//sha256_arena_reset() gives everything back at once.
+
+//Allocations are aligned to this many bytes
+#define SHA256_ARENA_ALIGNMENT 16
+//Allocations bigger than chunk_size/SHA256_ARENA_LARGE_FRACTION don't go to the arena
+#define SHA256_ARENA_LARGE_FRACTION 4
+//Chunk size used if 0 is given to sha256_arena_enable()
+#define SHA256_ARENA_DEFAULT_CHUNK (64*1024)
+//Smallest chunk size: below it not even an aligned allocation of chunk_size/SHA256_ARENA_LARGE_FRACTION
+//bytes would fit in a chunk
+#define SHA256_ARENA_MIN_CHUNK (SHA256_ARENA_ALIGNMENT*SHA256_ARENA_LARGE_FRACTION)
+
+struct sha256_arena_chunk{
+	struct sha256_arena_chunk *next;
+	size_t size;	//Usable bytes in data
+	size_t used;	//Bytes already handed out
+	unsigned char data[] __attribute__((aligned(SHA256_ARENA_ALIGNMENT)));
+};
+
+struct sha256_arena{
+	struct sha256_arena_chunk *chunks;	//All the chunks, kept for reuse after a reset
+	struct sha256_arena_chunk *current;	//Chunk we are bumping from
+	size_t chunk_size;
+	struct sha256_message *free_messages;	//Message structures deleted from the arena, ready to be reused
+};
+
+//Makes the base allocate its messages (and their buffers) from an arena of chunk_size bytes chunks
+//(0 = default size, sizes below SHA256_ARENA_MIN_CHUNK are raised to it). Returns 0 if it went OK, -1 if
+//any error occurred.
+int sha256_arena_enable(struct sha256_base *base, size_t chunk_size){
+	if(base->arena){
+		sha256_warning("The base already has an arena.");
+		return 0;
+	}
+	if(base->shards){
+		sha256_warning("A shared base can't have an arena.");
+		return -1;
+	}
+
+	base->arena = malloc(sizeof(struct sha256_arena));
+
+	if(NULL == base->arena){
+		sha256_error(MALLOC_ERROR);
+		return -1;
+	}
+
+	if(chunk_size && chunk_size < SHA256_ARENA_MIN_CHUNK){
+		sha256_warning("Arena chunk size too small, using the minimum size.");
+		chunk_size = SHA256_ARENA_MIN_CHUNK;
+	}
+
+	memset(base->arena, 0, sizeof(struct sha256_arena));
+	base->arena->chunk_size = chunk_size ? chunk_size : SHA256_ARENA_DEFAULT_CHUNK;
+
+	return 0;
+}
+
+//Rounds size up to the arena's alignment
+static size_t sha256_arena_round(size_t size){
+	return (size + SHA256_ARENA_ALIGNMENT - 1) & ~((size_t) SHA256_ARENA_ALIGNMENT - 1);
+}
+
+//Bumps size bytes from the arena, moving to the next chunk (or allocating a new one) if the current
+//one is full. size must fit in a chunk once rounded. Returns NULL if a new chunk couldn't be allocated.
+static void *sha256_arena_bump(struct sha256_arena *arena, size_t size){
+	size = sha256_arena_round(size);
+
+	while(NULL == arena->current || arena->current->size - arena->current->used < size){
+		//Reuse the chunks left from before a reset
+		if(arena->current && arena->current->next){
+			arena->current = arena->current->next;
+			continue;
+		}
+
+		struct sha256_arena_chunk *chunk = malloc(sizeof(struct sha256_arena_chunk) + arena->chunk_size);
+
+		if(NULL == chunk){
+			sha256_error(MALLOC_ERROR);
+			return NULL;
+		}
+
+		chunk->next = NULL;
+		chunk->size = arena->chunk_size;
+		chunk->used = 0;
+
+		if(arena->current){
+			arena->current->next = chunk;
+		} else {
+			arena->chunks = chunk;
+		}
+		arena->current = chunk;
+	}
+
+	void *pointer = arena->current->data + arena->current->used;
+	arena->current->used += size;
+
+	return pointer;
+}
+
+//Allocates size bytes for a message of the base. from_arena is set to 1 if the memory came from the
+//arena (it must not be given to free()), 0 if it came from malloc().
+void *sha256_base_alloc(struct sha256_base *base, size_t size, int *from_arena){
+	struct sha256_arena *arena = base->arena;
+
+	*from_arena = 0;
+
+	SHA256_STATS_ADD(base, allocations, 1);
+	SHA256_STATS_ADD(base, bytes_allocated, size);
+
+	//The rounded size is checked too, so a bump can never need more than a whole chunk
+	if(NULL == arena || size > arena->chunk_size/SHA256_ARENA_LARGE_FRACTION || sha256_arena_round(size) > arena->chunk_size){
+		return malloc(size);
+	}
+
+	*from_arena = 1;
+
+	return sha256_arena_bump(arena, size);
+}
+
+//Gives back memory from sha256_base_alloc(). Arena memory only returns on sha256_arena_reset().
+void sha256_base_dealloc(struct sha256_base *base, void *pointer, int from_arena){
+	(void) base;
+
+	if(pointer && !from_arena){
+		free(pointer);
+	}
+}
+
+//Allocates a message structure, reusing the ones deleted from the arena first. The structure is
+//returned filled with 0's (except for the allocation flags).
+struct sha256_message *sha256_base_alloc_message(struct sha256_base *base){
+	struct sha256_arena *arena = base->arena;
+	struct sha256_message *message;
+	int from_arena = 0;
+
+	if(arena && arena->free_messages){
+		message = arena->free_messages;
+		arena->free_messages = message->messages_list_entry.next;
+		from_arena = 1;
+	} else {
+		message = sha256_base_alloc(base, sizeof(struct sha256_message), &from_arena);
+	}
+
+	if(NULL == message){
+		return NULL;
+	}
+
+	memset(message, 0, sizeof(struct sha256_message));
+	if(from_arena){
+		message->allocation |= SHA256_ARENA_STRUCT;
+	}
+
+	return message;
+}
+
+//Gives back a message structure from sha256_base_alloc_message()
+void sha256_base_dealloc_message(struct sha256_base *base, struct sha256_message *message){
+	if(message->allocation & SHA256_ARENA_STRUCT){
+		message->messages_list_entry.next = base->arena->free_messages;
+		base->arena->free_messages = message;
+	} else {
+		free(message);
+	}
+}
+
+//Deletes every message of the base at once and rewinds the arena, keeping its chunks for the next
+//messages. Buffers too big for the arena are free'd one by one.
+void sha256_arena_reset(struct sha256_base *base){
+	struct sha256_list *list;
+
+	for(unsigned int c = 0; NULL != (list = sha256_base_list(base, c)); ++c){
+		struct sha256_message *entry = list->next;
+
+		while(NULL != entry){
+			struct sha256_message *next = entry->messages_list_entry.next;
+
+			sha256_message_release(entry, base);
+			entry = next;
+		}
+
+		list->next = NULL;
+		list->prev = NULL;
+	}
+
+	if(base->arena){
+		for(struct sha256_arena_chunk *chunk = base->arena->chunks; NULL != chunk; chunk = chunk->next){
+			chunk->used = 0;
+		}
+		base->arena->current = base->arena->chunks;
+		base->arena->free_messages = NULL;
+	}
+}
+
+//Frees the arena and all its chunks (the messages must be already gone)
+void sha256_arena_destroy(struct sha256_base *base){
+	if(NULL == base->arena){
+		return;
+	}
+
+	struct sha256_arena_chunk *chunk = base->arena->chunks;
+	while(NULL != chunk){
+		struct sha256_arena_chunk *next = chunk->next;
+
+		free(chunk);
+		chunk = next;
+	}
+
+	free(base->arena);
+	base->arena = NULL;
+}
@@ -0,0 +1,1394 @@
+#include "sha256_digest.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//Benchmarks for the library's digest paths. Built and run by 'make bench'.
+//The known-answer vectors are checked on every path before anything is timed. If a file name is given
+//as the first argument, every result is also written to it as a CSV line (group,variant,size,metric,value)
+//so the results of different runs can be compared.
+
+//Chunk size used for the tree-hash mode
+#define BENCH_TREE_CHUNK (1 << 20)
+
+static FILE *bench_results = NULL;
+
+static double bench_now(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+//Time stamp counter (reference cycles, not core cycles under frequency scaling). 0 where there's none.
+static uint64_t bench_cycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//Writes a result to the results file, if any
+static void bench_report(const char *group, const char *variant, uint64_t size, const char *metric, double value){
+	if(bench_results){
+		fprintf(bench_results, "%s,%s,%llu,%s,%.6g\n", group, variant, (unsigned long long) size, metric, value);
+	}
+}
+
+/*
+=============================
+	KNOWN-ANSWER VECTORS
+=============================
+*/
+
+struct bench_vector{
+	const char *message;	//NULL = million_a
+	const char *hash;
+	const char *hash512;	//SHA-512/256
+};
+
+static const struct bench_vector bench_vectors[] = {
+	{"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+		"c672b8d1ef56ed28ab87c3622c5114069bdd3ad7b8f9737498d0c01ecef0967a"},
+	{"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		"53048e2681941ef99b2e29b76b4c7dabe4c2d0c634fc6d46e0e2f13107e7af23"},
+	{"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+		"bde8e1f9f19bb9fd3406c90ec6bc47bd36d8ada9f11880dbc8a22a7078b6a461"},
+	{"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+		"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+		"3928e184fb8690f840da3988121d31be65cb9d3ef83ee6146feac861e19b563a"},
+	{NULL, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+		"9a59a052930187a97038cae692f30708aa6491923ef5194394dc68d56c74fb21"}
+};
+
+#define BENCH_VECTORS (sizeof(bench_vectors)/sizeof(bench_vectors[0]))
+
+//PBKDF2-HMAC-SHA256 vectors: RFC 7914 section 11 and the RFC 6070 inputs
+struct bench_pbkdf2_vector{
+	const char *password;
+	size_t password_length;
+	const char *salt;
+	size_t salt_length;
+	uint64_t iterations;
+	size_t key_length;
+	const char *key;
+};
+
+static const struct bench_pbkdf2_vector bench_pbkdf2_vectors[] = {
+	{"passwd", 6, "salt", 4, 1, 64, "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+		"49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783"},
+	{"Password", 8, "NaCl", 4, 80000, 64, "4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56"
+		"a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d"},
+	{"password", 8, "salt", 4, 1, 32, "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b"},
+	{"password", 8, "salt", 4, 2, 32, "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43"},
+	{"password", 8, "salt", 4, 4096, 32, "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a"},
+	{"passwordPASSWORDpassword", 24, "saltSALTsaltSALTsaltSALTsaltSALTsalt", 36, 4096, 40,
+		"348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1c635518c7dac47e9"},
+	{"pass\0word", 9, "sa\0lt", 5, 4096, 16, "89b69d0516f829893c696226650a8687"}
+};
+
+#define BENCH_PBKDF2_VECTORS (sizeof(bench_pbkdf2_vectors)/sizeof(bench_pbkdf2_vectors[0]))
+
+static int bench_failures = 0;
+
+static void bench_check_bytes(const char *path, size_t vector, const unsigned char *bytes, size_t length, const char *expected){
+	char hex[129];
+
+	for(size_t c = 0; c < length; ++c){
+		sprintf(hex + c*2, "%02x", bytes[c]);
+	}
+	hex[length*2] = '\0';
+
+	if(strcmp(hex, expected)){
+		fprintf(stderr, "known-answer: %s failed on vector %zu (%s instead of %s)\n", path, vector, hex, expected);
+		++bench_failures;
+	}
+}
+
+static void bench_check(const char *path, size_t vector, const unsigned char hash[32], const char *expected){
+	bench_check_bytes(path, vector, hash, 32, expected);
+}
+
+//Checks the vectors on every digest path. Returns 0 if they all match, -1 otherwise.
+static int bench_known_answers(void){
+	struct sha256_base *base = sha256_init();
+	struct sha256_message *copied[BENCH_VECTORS], *borrowed[BENCH_VECTORS], *batch[BENCH_VECTORS], *pending[BENCH_VECTORS];
+	char *million_a = malloc(1000000);
+	unsigned char hash[32];
+
+	if(NULL == base || NULL == million_a){
+		fprintf(stderr, "bench_known_answers: allocation failed\n");
+		exit(1);
+	}
+
+	memset(million_a, 'a', 1000000);
+
+	for(size_t c = 0; c < BENCH_VECTORS; ++c){
+		const char *message = bench_vectors[c].message ? bench_vectors[c].message : million_a;
+		size_t length = bench_vectors[c].message ? strlen(message) : 1000000;
+		struct sha256_context context;
+
+		copied[c] = sha256_message_create_from_buffer(message, length*8, base);
+		sha256_message_preprocess(copied[c]);
+		sha256_message_digest(copied[c], base);
+		bench_check("sha256_message_digest", c, copied[c]->hash, bench_vectors[c].hash);
+
+		borrowed[c] = sha256_message_create_borrowed(message, length*8, base);
+		sha256_message_preprocess(borrowed[c]);
+		sha256_message_digest(borrowed[c], base);
+		bench_check("sha256_message_create_borrowed", c, borrowed[c]->hash, bench_vectors[c].hash);
+
+		//Odd sized pieces, so the buffered partial block is exercised
+		sha256_context_init(&context, base);
+		for(size_t offset = 0; offset < length; offset += 7){
+			sha256_context_update(&context, message + offset, length - offset < 7 ? length - offset : 7);
+		}
+		sha256_context_final(&context, hash);
+		bench_check("sha256_context", c, hash, bench_vectors[c].hash);
+
+		sha256(message, length, hash);
+		bench_check("sha256", c, hash, bench_vectors[c].hash);
+
+		batch[c] = sha256_message_create_borrowed(message, length*8, base);
+		pending[c] = sha256_message_create_borrowed(message, length*8, base);
+	}
+
+	sha256_message_digest_batch(batch, BENCH_VECTORS, base);
+
+	//Only the pending messages are left undigested on the base
+	sha256_digest_pending(base, 0);
+
+	for(size_t c = 0; c < BENCH_VECTORS; ++c){
+		bench_check("sha256_message_digest_batch", c, batch[c]->hash, bench_vectors[c].hash);
+		bench_check("sha256_digest_pending", c, pending[c]->hash, bench_vectors[c].hash);
+	}
+
+	//SHA-512/256: one-shot, message, batch and streaming paths of a SHA-512/256 base
+	struct sha256_base *wide_base = sha256_init();
+	if(NULL == wide_base || sha256_base_set_algorithm(wide_base, SHA256_ALGORITHM_SHA512_256)){
+		exit(1);
+	}
+	for(size_t c = 0; c < BENCH_VECTORS; ++c){
+		const char *message = bench_vectors[c].message ? bench_vectors[c].message : million_a;
+		size_t length = bench_vectors[c].message ? strlen(message) : 1000000;
+		struct sha256_context context;
+
+		sha512_256(message, length, hash);
+		bench_check("sha512_256", c, hash, bench_vectors[c].hash512);
+
+		copied[c] = sha256_message_create_from_buffer(message, length*8, wide_base);
+		sha256_message_preprocess(copied[c]);
+		sha256_message_digest(copied[c], wide_base);
+		bench_check("sha256_message_digest (SHA-512/256)", c, copied[c]->hash, bench_vectors[c].hash512);
+
+		sha256_context_init(&context, wide_base);
+		for(size_t offset = 0; offset < length; offset += 7){
+			sha256_context_update(&context, message + offset, length - offset < 7 ? length - offset : 7);
+		}
+		sha256_context_final(&context, hash);
+		bench_check("sha256_context (SHA-512/256)", c, hash, bench_vectors[c].hash512);
+
+		batch[c] = sha256_message_create_borrowed(message, length*8, wide_base);
+	}
+	sha256_message_digest_batch(batch, BENCH_VECTORS, wide_base);
+	for(size_t c = 0; c < BENCH_VECTORS; ++c){
+		bench_check("sha256_message_digest_batch (SHA-512/256)", c, batch[c]->hash, bench_vectors[c].hash512);
+	}
+	sha256_free(wide_base);
+
+	sha256d("abc", 3, hash);
+	bench_check("sha256d", 0, hash, "4f8b42c22dd3729b519ba6f68d2da7cc5b2d606d05daed5ad5128cc03e6c6358");
+
+	//Midstate of a one block prefix, finished with a suffix, against the one-shot digest of both
+	unsigned char prefix[64 + 15];
+	struct sha256_midstate midstate;
+	struct sha256_context midstate_context;
+	for(int c = 0; c < 64; ++c){
+		prefix[c] = (unsigned char) (c * 3 + 1);
+	}
+	memcpy(prefix + 64, "midstate suffix", 15);
+	if(sha256_midstate_compute(&midstate, base, prefix, 64)){
+		fprintf(stderr, "known-answer: sha256_midstate_compute failed\n");
+		++bench_failures;
+	}
+	sha256_context_init_from_midstate(&midstate_context, &midstate);
+	sha256_context_update(&midstate_context, prefix + 64, 15);
+	sha256_context_final(&midstate_context, hash);
+	bench_check("sha256_context_init_from_midstate", 0, hash, "2ee5c8ebcb2fa54f38439119b170d7396a4331bcc031814e873fcabe17ac1e2d");
+	sha256(prefix, sizeof(prefix), hash);
+	bench_check("sha256 (midstate vector)", 0, hash, "2ee5c8ebcb2fa54f38439119b170d7396a4331bcc031814e873fcabe17ac1e2d");
+
+	//RFC 4231, test case 2
+	struct sha256_hmac_key key;
+	sha256_hmac_key_init(&key, "Jefe", 4);
+	sha256_hmac(&key, "what do ya want for nothing?", 28, hash);
+	bench_check("sha256_hmac", 0, hash, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+	//PBKDF2: one at a time, then all the vectors in one batch on each multi-buffer tier
+	unsigned char pbkdf2_keys[BENCH_PBKDF2_VECTORS][64];
+	struct sha256_pbkdf2_job pbkdf2_jobs[BENCH_PBKDF2_VECTORS];
+	for(size_t c = 0; c < BENCH_PBKDF2_VECTORS; ++c){
+		const struct bench_pbkdf2_vector *vector = &bench_pbkdf2_vectors[c];
+
+		sha256_pbkdf2(vector->password, vector->password_length, vector->salt, vector->salt_length, vector->iterations,
+			pbkdf2_keys[c], vector->key_length);
+		bench_check_bytes("sha256_pbkdf2", c, pbkdf2_keys[c], vector->key_length, vector->key);
+	}
+	for(unsigned int lanes = 1; lanes <= 16; lanes *= 2){
+		for(size_t c = 0; c < BENCH_PBKDF2_VECTORS; ++c){
+			const struct bench_pbkdf2_vector *vector = &bench_pbkdf2_vectors[c];
+			struct sha256_pbkdf2_job job = {vector->password, vector->password_length, vector->salt, vector->salt_length,
+				vector->iterations, pbkdf2_keys[c], vector->key_length};
+
+			pbkdf2_jobs[c] = job;
+		}
+		sha256_pbkdf2_lanes(pbkdf2_jobs, BENCH_PBKDF2_VECTORS, lanes);
+		for(size_t c = 0; c < BENCH_PBKDF2_VECTORS; ++c){
+			bench_check_bytes("sha256_pbkdf2_lanes", c, pbkdf2_keys[c], bench_pbkdf2_vectors[c].key_length, bench_pbkdf2_vectors[c].key);
+		}
+	}
+
+	//Nonce search: lowest nonce under a 16 bits target, with SHA-256 and sha256d, on every tier and with
+	//the range split among threads
+	static const uint32_t nonce_expected[2] = {126952, 137346};
+	static const char *nonce_hashes[2] = {"0000a3f8fee157c807f8f71cbe4380394168db5d98c033db331bc7daa692cbd0",
+		"000028cdff49bb11ecb6957478496fd5f4168bbb5984e9a5c73ce1884b7e025f"};
+	struct sha256_nonce_config nonce_config;
+	struct sha256_nonce_result nonce_result;
+	for(int c = 0; c < 80; ++c){
+		nonce_config.header[c] = (unsigned char) (c * 3 + 1);
+	}
+	nonce_config.nonce_offset = 76;
+	memset(nonce_config.target, 0xFF, 32);
+	nonce_config.target[0] = 0;
+	nonce_config.target[1] = 0;
+	nonce_config.first_nonce = 0;
+	nonce_config.nonce_count = 1 << 20;
+	for(int double_hash = 0; double_hash < 2; ++double_hash){
+		nonce_config.double_hash = double_hash;
+		for(unsigned int lanes = 1; lanes <= 16; lanes *= 2){
+			nonce_config.thread_count = lanes < 16 ? 1 : 4;
+			if(1 != sha256_nonce_search_lanes(&nonce_config, &nonce_result, lanes) || nonce_result.nonce != nonce_expected[double_hash]){
+				fprintf(stderr, "known-answer: sha256_nonce_search_lanes failed on vector %d\n", double_hash);
+				++bench_failures;
+			}
+			bench_check("sha256_nonce_search_lanes", (size_t) double_hash, nonce_result.hash, nonce_hashes[double_hash]);
+		}
+	}
+
+	//Merkle tree of 11 leaves (two levels end with an odd node), with and without domain separation:
+	//root, then every inclusion proof one by one and in a batch, and a tampered proof that must fail
+	static const char *merkle_roots[2] = {"fbebdcac962416fa76ecd9ddbcd3290f2ec86162f7bf38ee5ea099bfff9121e3",
+		"6dc37b7471fa5b49612b9de621965ce994e1164e4850d2ccd75d19e5a95c7f53"};
+	unsigned char merkle_leaves[11][32], merkle_tree[32][32], merkle_proofs[11][8][32];
+	struct sha256_merkle_check merkle_checks[11];
+	for(int c = 0; c < 11; ++c){
+		for(int n = 0; n < 32; ++n){
+			merkle_leaves[c][n] = (unsigned char) (c * 31 + n);
+		}
+	}
+	for(int separated = 0; separated < 2; ++separated){
+		struct sha256_merkle_config merkle_config = {separated, 0x00, 0x01, 1};
+		size_t valid = 0;
+
+		if(sha256_merkle_tree_size(11) > 32 || sha256_merkle_build(&merkle_leaves[0][0], 32, 11, &merkle_config, merkle_tree, hash)){
+			fprintf(stderr, "known-answer: sha256_merkle_build failed on vector %d\n", separated);
+			++bench_failures;
+			continue;
+		}
+		bench_check("sha256_merkle_build", (size_t) separated, hash, merkle_roots[separated]);
+
+		for(size_t c = 0; c < 11; ++c){
+			merkle_checks[c].leaf = merkle_leaves[c];
+			merkle_checks[c].index = c;
+			merkle_checks[c].proof = (const unsigned char (*)[32]) merkle_proofs[c];
+			merkle_checks[c].proof_length = sha256_merkle_proof((const unsigned char (*)[32]) merkle_tree, 11, c, merkle_proofs[c]);
+			valid += (size_t) sha256_merkle_verify(merkle_leaves[c], 32, c, 11, merkle_checks[c].proof, merkle_checks[c].proof_length,
+				&merkle_config, hash);
+		}
+		if(11 != valid || 11 != sha256_merkle_verify_batch(merkle_checks, 11, 32, 11, &merkle_config, hash)){
+			fprintf(stderr, "known-answer: sha256_merkle_verify failed on vector %d\n", separated);
+			++bench_failures;
+		}
+
+		merkle_proofs[5][1][7] ^= 0x01;
+		if(sha256_merkle_verify(merkle_leaves[5], 32, 5, 11, merkle_checks[5].proof, merkle_checks[5].proof_length, &merkle_config, hash) ||
+			10 != sha256_merkle_verify_batch(merkle_checks, 11, 32, 11, &merkle_config, hash) || merkle_checks[5].valid){
+			fprintf(stderr, "known-answer: sha256_merkle_verify accepted a tampered proof on vector %d\n", separated);
+			++bench_failures;
+		}
+	}
+
+	//Tree hash of 6244 bytes in 1024 bytes chunks (7 chunks, the last one short), then its root again from
+	//the manifest alone
+	unsigned char *tree_data = malloc(6244), tree_manifest[7][32], tree_root[32];
+	if(NULL == tree_data){
+		fprintf(stderr, "bench_known_answers: allocation failed\n");
+		exit(1);
+	}
+	for(size_t c = 0; c < 6244; ++c){
+		tree_data[c] = (unsigned char) (c * 13 + 5);
+	}
+	if(7 != sha256_tree_chunk_count(6244, 1024) || sha256_tree_digest(tree_data, 6244, 1024, 2, tree_manifest, hash) ||
+		sha256_tree_root((const unsigned char (*)[32]) tree_manifest, 6244, 1024, 1, tree_root)){
+		fprintf(stderr, "known-answer: sha256_tree_digest failed\n");
+		++bench_failures;
+	}
+	bench_check("sha256_tree_digest", 0, hash, "4af55f26bfe82f751e1cf04997b1187f74b059536f131ca2464da0af525ca5d0");
+	bench_check("sha256_tree_root", 0, tree_root, "4af55f26bfe82f751e1cf04997b1187f74b059536f131ca2464da0af525ca5d0");
+	free(tree_data);
+
+	//The fixed-length fast paths against the streaming API
+	for(size_t size = 32; size <= 80; size += size < 64 ? 32 : 16){
+		unsigned char input[80], expected[32];
+		struct sha256_context context;
+		char expected_hex[65];
+
+		for(size_t c = 0; c < size; ++c){
+			input[c] = (unsigned char) (c * 5 + 1);
+		}
+		sha256_context_init(&context, base);
+		sha256_context_update(&context, input, size);
+		sha256_context_final(&context, expected);
+		for(int c = 0; c < 32; ++c){
+			sprintf(expected_hex + c*2, "%02x", expected[c]);
+		}
+
+		if(32 == size){
+			sha256_32(input, hash);
+		} else if(64 == size){
+			sha256_64(input, hash);
+		} else {
+			sha256_80(input, hash);
+		}
+		bench_check("sha256_32/64/80", size, hash, expected_hex);
+	}
+
+	//The one-shot function around the padding boundaries, against the streaming API
+	for(size_t size = 0; size <= 200; ++size){
+		unsigned char input[200], expected[32];
+		struct sha256_context context;
+		char expected_hex[65];
+
+		for(size_t c = 0; c < size; ++c){
+			input[c] = (unsigned char) (c * 7 + 3);
+		}
+		sha256_context_init(&context, base);
+		sha256_context_update(&context, input, size);
+		sha256_context_final(&context, expected);
+		for(int c = 0; c < 32; ++c){
+			sprintf(expected_hex + c*2, "%02x", expected[c]);
+		}
+
+		sha256(input, size, hash);
+		bench_check("sha256 (lengths)", size, hash, expected_hex);
+	}
+
+	//Empty message without a buffer
+	sha256(NULL, 0, hash);
+	bench_check("sha256 (NULL)", 0, hash, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+	free(million_a);
+	sha256_free(base);
+
+	return bench_failures ? -1 : 0;
+}
+
+/*
+=====================
+	BENCHMARKS
+=====================
+*/
+
+//Prints and reports the time of iterations hashes of length bytes
+static void bench_throughput_result(const char *variant, uint64_t length, size_t iterations, double time, uint64_t cycles){
+	double gbps = (double) length*iterations/time/1e9;
+	double ns = time*1e9/iterations;
+
+	if(length && cycles){
+		double cpb = (double) cycles/((double) length*iterations);
+		printf("throughput\t%llu bytes\t%s\t%.3f GB/s\t%.2f cycles/byte\t%.0f ns/hash\n", (unsigned long long) length, variant, gbps, cpb, ns);
+		bench_report("throughput", variant, length, "cycles_per_byte", cpb);
+	} else {
+		printf("throughput\t%llu bytes\t%s\t%.3f GB/s\t%.0f ns/hash\n", (unsigned long long) length, variant, gbps, ns);
+	}
+	bench_report("throughput", variant, length, "gb_per_s", gbps);
+	bench_report("throughput", variant, length, "ns_per_hash", ns);
+}
+
+//GB/s and cycles/byte of every single-message digest path for one input of length bytes
+static void bench_throughput(uint64_t length){
+	unsigned char *data = malloc(length ? length : 1);
+	struct sha256_base *base = sha256_init();
+	unsigned char hash[32];
+	//About 256MB hashed per path, but not too many iterations on tiny inputs
+	size_t iterations = length ? (size_t) ((256 << 20)/length) : 200000;
+
+	if(0 == iterations){
+		iterations = 1;
+	}
+	if(iterations > 200000){
+		iterations = 200000;
+	}
+
+	if(NULL == data || NULL == base){
+		printf("throughput\t%llu bytes\tskipped (not enough memory)\n", (unsigned long long) length);
+		free(data);
+		sha256_free(base);
+		return;
+	}
+
+	for(uint64_t c = 0; c < length; ++c){
+		data[c] = (unsigned char) (c * 17);
+	}
+
+	//The copying path needs three times the input in memory
+	if(length <= (256 << 20)){
+		uint64_t cycles = bench_cycles();
+		double start = bench_now();
+		for(size_t c = 0; c < iterations; ++c){
+			struct sha256_message *message = sha256_message_create_from_buffer((char *) data, (unsigned int) (length*8), base);
+			sha256_message_preprocess(message);
+			sha256_message_digest(message, base);
+			sha256_message_delete(message, base);
+		}
+		bench_throughput_result("message", length, iterations, bench_now() - start, bench_cycles() - cycles);
+	}
+
+	uint64_t cycles = bench_cycles();
+	double start = bench_now();
+	for(size_t c = 0; c < iterations; ++c){
+		struct sha256_message *message = sha256_message_create_borrowed(data, length*8, base);
+		sha256_message_preprocess(message);
+		sha256_message_digest(message, base);
+		sha256_message_delete(message, base);
+	}
+	bench_throughput_result("borrowed", length, iterations, bench_now() - start, bench_cycles() - cycles);
+
+	cycles = bench_cycles();
+	start = bench_now();
+	for(size_t c = 0; c < iterations; ++c){
+		struct sha256_context context;
+
+		sha256_context_init(&context, base);
+		sha256_context_update(&context, data, (size_t) length);
+		sha256_context_final(&context, hash);
+	}
+	bench_throughput_result("context", length, iterations, bench_now() - start, bench_cycles() - cycles);
+
+	//Not SHA-256, but it's the path for the huge inputs
+	if(length >= BENCH_TREE_CHUNK){
+		cycles = bench_cycles();
+		start = bench_now();
+		for(size_t c = 0; c < iterations; ++c){
+			sha256_tree_digest(data, length, BENCH_TREE_CHUNK, 0, NULL, hash);
+		}
+		bench_throughput_result("tree", length, iterations, bench_now() - start, bench_cycles() - cycles);
+	}
+
+	sha256_free(base);
+	free(data);
+}
+
+//GB/s and cycles/byte of the compression kernels on their own, blocks_count blocks per call
+static void bench_kernels(size_t blocks_count, size_t iterations){
+	unsigned char *blocks = malloc(blocks_count*64);
+	uint32_t hash_values[8];
+
+	if(NULL == blocks){
+		fprintf(stderr, "bench_kernels: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < blocks_count*64; ++c){
+		blocks[c] = (unsigned char) (c * 11);
+	}
+
+	for(int kernel = 0; kernel < 2; ++kernel){
+		void (*compress)(uint32_t *, const unsigned char *, uint64_t) = sha256_compress_blocks_scalar;
+		const char *name = "scalar";
+
+		if(1 == kernel){
+#if defined(__x86_64__) || defined(__i386__)
+			if(0 == (sha256_cpu_features() & SHA256_CPU_SHANI)){
+				break;
+			}
+			compress = sha256_compress_blocks_shani;
+			name = "shani";
+#else
+			break;
+#endif
+		}
+
+		memcpy(hash_values, sha256_default_hash_values, sizeof(hash_values));
+		uint64_t cycles = bench_cycles();
+		double start = bench_now();
+		for(size_t c = 0; c < iterations; ++c){
+			compress(hash_values, blocks, blocks_count);
+		}
+		double time = bench_now() - start;
+		cycles = bench_cycles() - cycles;
+
+		double gbps = (double) blocks_count*64*iterations/time/1e9;
+		double cpb = (double) cycles/((double) blocks_count*64*iterations);
+		printf("kernel\t%s\t%zu blocks\t%.3f GB/s\t%.2f cycles/byte\n", name, blocks_count, gbps, cpb);
+		bench_report("kernel", name, blocks_count*64, "gb_per_s", gbps);
+		if(cycles){
+			bench_report("kernel", name, blocks_count*64, "cycles_per_byte", cpb);
+		}
+	}
+
+	//SHA-512 scalar kernel on the same bytes (half as many 128 bytes blocks)
+	uint64_t wide_hash_values[8];
+
+	memcpy(wide_hash_values, sha512_256_hash_values, sizeof(wide_hash_values));
+	uint64_t cycles = bench_cycles();
+	double start = bench_now();
+	for(size_t c = 0; c < iterations; ++c){
+		sha512_compress_blocks(wide_hash_values, blocks, blocks_count/2);
+	}
+	double time = bench_now() - start;
+	cycles = bench_cycles() - cycles;
+
+	double gbps = (double) blocks_count*64*iterations/time/1e9;
+	double cpb = (double) cycles/((double) blocks_count*64*iterations);
+	printf("kernel\tsha512_scalar\t%zu blocks\t%.3f GB/s\t%.2f cycles/byte\n", blocks_count/2, gbps, cpb);
+	bench_report("kernel", "sha512_scalar", blocks_count*64, "gb_per_s", gbps);
+	if(cycles){
+		bench_report("kernel", "sha512_scalar", blocks_count*64, "cycles_per_byte", cpb);
+	}
+
+	free(blocks);
+}
+
+//SHA-256 against SHA-512/256 on count messages of message_size bytes, on each multi-buffer tier the CPU
+//has: one job after the other (single-buffer kernel), AVX2 and AVX-512.
+static void bench_families(size_t message_size, size_t count){
+	static const char *tiers[] = {"single", "avx2", "avx512"};
+	static const unsigned int sha256_lanes[] = {1, 8, 16}, sha512_lanes[] = {1, 4, 8};
+	unsigned int features = sha256_cpu_features();
+	unsigned char *data = malloc(message_size * count);
+	struct sha256_job *jobs = malloc(count * sizeof(*jobs));
+	struct sha512_job *wide_jobs = malloc(count * sizeof(*wide_jobs));
+
+	if(NULL == data || NULL == jobs || NULL == wide_jobs){
+		fprintf(stderr, "bench_families: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < message_size * count; ++c){
+		data[c] = (unsigned char) (c * 17 + 1);
+	}
+
+	for(int tier = 0; tier < 3; ++tier){
+		if((1 == tier && 0 == (features & SHA256_CPU_AVX2)) || (2 == tier && 0 == (features & SHA256_CPU_AVX512))){
+			continue;
+		}
+
+		double start = bench_now();
+		for(size_t c = 0; c < count; ++c){
+			sha256_job_init(&jobs[c], sha256_default_hash_values, data + c*message_size, message_size*8, 0);
+		}
+		sha256_compress_jobs_lanes(jobs, count, sha256_lanes[tier]);
+		double sha256_time = bench_now() - start;
+
+		start = bench_now();
+		for(size_t c = 0; c < count; ++c){
+			sha512_job_init(&wide_jobs[c], sha512_256_hash_values, data + c*message_size, message_size*8);
+		}
+		sha512_compress_jobs_lanes(wide_jobs, count, sha512_lanes[tier]);
+		double sha512_time = bench_now() - start;
+
+		double sha256_gbps = (double) message_size*count/sha256_time/1e9, sha512_gbps = (double) message_size*count/sha512_time/1e9;
+
+		printf("family %s\t%zu bytes x %zu\tsha256 %.3f GB/s\tsha512/256 %.3f GB/s\n", tiers[tier], message_size, count,
+			sha256_gbps, sha512_gbps);
+		bench_report("family", tiers[tier], message_size, "sha256_gb_per_s", sha256_gbps);
+		bench_report("family", tiers[tier], message_size, "sha512_256_gb_per_s", sha512_gbps);
+	}
+
+	free(wide_jobs);
+	free(jobs);
+	free(data);
+}
+
+//Setup and teardown costs: sha256_init()/sha256_free() of an empty base, and creating count messages
+//with each sha256_message_create_*() function and freeing them with sha256_free()
+static void bench_setup(size_t count){
+	const char *string = "setup and teardown";
+	const char *variants[] = {"from_string", "from_buffer", "borrowed"};
+
+	double start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		sha256_free(sha256_init());
+	}
+	double base_time = bench_now() - start;
+
+	printf("setup\tsha256_init/sha256_free\t%.1f ns/base\n", base_time*1e9/count);
+	bench_report("setup", "init_free", 0, "ns_per_base", base_time*1e9/count);
+
+	for(int variant = 0; variant < 3; ++variant){
+		struct sha256_base *base = sha256_init();
+
+		if(NULL == base){
+			exit(1);
+		}
+
+		start = bench_now();
+		for(size_t c = 0; c < count; ++c){
+			if(0 == variant){
+				sha256_message_create_from_string(string, base);
+			} else if(1 == variant){
+				sha256_message_create_from_buffer(string, 18*8, base);
+			} else {
+				sha256_message_create_borrowed(string, 18*8, base);
+			}
+		}
+		double create_time = bench_now() - start;
+
+		start = bench_now();
+		sha256_free(base);
+		double free_time = bench_now() - start;
+
+		printf("setup\tsha256_message_create_%s\t%zu messages\tcreate %.1f ns/msg\tsha256_free %.1f ns/msg\n", variants[variant], count,
+			create_time*1e9/count, free_time*1e9/count);
+		bench_report("setup", variants[variant], count, "create_ns_per_msg", create_time*1e9/count);
+		bench_report("setup", variants[variant], count, "free_ns_per_msg", free_time*1e9/count);
+	}
+}
+
+//Messages/sec digesting count messages of message_size bytes one at a time and with the batch call
+static void bench_batch(size_t message_size, size_t count){
+	struct sha256_base *base = sha256_init();
+	struct sha256_message **single = malloc(count * sizeof(*single));
+	struct sha256_message **batch = malloc(count * sizeof(*batch));
+	char *buffer = malloc(message_size + 1);
+
+	if(NULL == base || NULL == single || NULL == batch || NULL == buffer){
+		fprintf(stderr, "bench_batch: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < message_size; ++c){
+		buffer[c] = (char) (c * 31 + 7);
+	}
+
+	for(size_t c = 0; c < count; ++c){
+		buffer[0] = (char) c;	//Make every message different
+		single[c] = sha256_message_create_from_buffer(buffer, message_size*8, base);
+		batch[c] = sha256_message_create_from_buffer(buffer, message_size*8, base);
+	}
+
+	double start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		sha256_message_preprocess(single[c]);
+		sha256_message_digest(single[c], base);
+	}
+	double single_time = bench_now() - start;
+
+	start = bench_now();
+	sha256_message_digest_batch(batch, count, base);
+	double batch_time = bench_now() - start;
+
+	for(size_t c = 0; c < count; ++c){
+		if(memcmp(single[c]->hash, batch[c]->hash, 32)){
+			fprintf(stderr, "bench_batch: batch hash mismatch on message %zu\n", c);
+			exit(1);
+		}
+	}
+
+	printf("batch\t%zu bytes\tsingle %.0f msg/s\tbatch %.0f msg/s\t(x%.2f)\n", message_size,
+		count/single_time, count/batch_time, single_time/batch_time);
+	bench_report("batch", "single", message_size, "msg_per_s", count/single_time);
+	bench_report("batch", "batch", message_size, "msg_per_s", count/batch_time);
+
+	free(buffer);
+	free(batch);
+	free(single);
+	sha256_free(base);
+}
+
+//Cost per message of creating, deleting and freeing count messages. It should stay flat as count grows.
+static void bench_registration(size_t count, int use_arena){
+	struct sha256_base *base = sha256_init();
+	struct sha256_message **messages = malloc(count * sizeof(*messages));
+	const char buffer[16] = "registration";
+
+	if(NULL == base || NULL == messages){
+		fprintf(stderr, "bench_registration: allocation failed\n");
+		exit(1);
+	}
+
+	if(use_arena && sha256_arena_enable(base, 0)){
+		exit(1);
+	}
+
+	double start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		messages[c] = sha256_message_create_from_buffer(buffer, sizeof(buffer)*8, base);
+	}
+	double create_time = bench_now() - start;
+
+	//Delete every other message (from the middle of the list), sha256_free() takes the rest
+	start = bench_now();
+	for(size_t c = 0; c < count; c += 2){
+		sha256_message_delete(messages[c], base);
+	}
+	double delete_time = bench_now() - start;
+
+	start = bench_now();
+	sha256_free(base);
+	double free_time = bench_now() - start;
+
+	printf("registration%s\t%zu messages\tcreate %.1f ns/msg\tdelete %.1f ns/msg\tfree %.1f ns/msg\n", use_arena ? " (arena)" : "", count,
+		create_time*1e9/count, delete_time*1e9/((count + 1)/2), free_time*1e9/(count/2 ? count/2 : 1));
+	bench_report("registration", use_arena ? "arena" : "malloc", count, "create_ns_per_msg", create_time*1e9/count);
+	bench_report("registration", use_arena ? "arena" : "malloc", count, "delete_ns_per_msg", delete_time*1e9/((count + 1)/2));
+	bench_report("registration", use_arena ? "arena" : "malloc", count, "free_ns_per_msg", free_time*1e9/(count/2 ? count/2 : 1));
+
+	free(messages);
+}
+
+//Messages/sec creating and digesting count messages of message_size bytes, copied and borrowed
+static void bench_borrowed(size_t message_size, size_t count){
+	struct sha256_base *base = sha256_init();
+	char *buffer = malloc(message_size + 1);
+	unsigned char copied_hash[32];
+
+	if(NULL == base || NULL == buffer){
+		fprintf(stderr, "bench_borrowed: allocation failed\n");
+		exit(1);
+	}
+
+	memset(buffer, 'b', message_size);
+
+	double start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		struct sha256_message *message = sha256_message_create_from_buffer(buffer, message_size*8, base);
+		sha256_message_preprocess(message);
+		sha256_message_digest(message, base);
+		memcpy(copied_hash, message->hash, 32);
+		sha256_message_delete(message, base);
+	}
+	double copied_time = bench_now() - start;
+
+	start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		struct sha256_message *message = sha256_message_create_borrowed(buffer, message_size*8, base);
+		sha256_message_preprocess(message);
+		sha256_message_digest(message, base);
+		if(memcmp(copied_hash, message->hash, 32)){
+			fprintf(stderr, "bench_borrowed: borrowed hash mismatch\n");
+			exit(1);
+		}
+		sha256_message_delete(message, base);
+	}
+	double borrowed_time = bench_now() - start;
+
+	printf("borrowed\t%zu bytes\tcopied %.0f msg/s\tborrowed %.0f msg/s\t(x%.2f)\n", message_size,
+		count/copied_time, count/borrowed_time, copied_time/borrowed_time);
+	bench_report("borrowed", "copied", message_size, "msg_per_s", count/copied_time);
+	bench_report("borrowed", "borrowed", message_size, "msg_per_s", count/borrowed_time);
+
+	free(buffer);
+	sha256_free(base);
+}
+
+//Hashes/sec of the fixed-length fast paths against the general message path
+static void bench_fixed(size_t input_size, size_t count){
+	struct sha256_base *base = sha256_init();
+	unsigned char input[80], fast_hash[32];
+
+	if(NULL == base){
+		exit(1);
+	}
+
+	for(size_t c = 0; c < sizeof(input); ++c){
+		input[c] = (unsigned char) (c * 3);
+	}
+
+	double start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		input[0] = (unsigned char) c;
+		struct sha256_message *message = sha256_message_create_from_buffer((char *) input, input_size*8, base);
+		sha256_message_preprocess(message);
+		sha256_message_digest(message, base);
+		sha256_message_delete(message, base);
+	}
+	double general_time = bench_now() - start;
+
+	start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		input[0] = (unsigned char) c;
+		if(32 == input_size){
+			sha256_32(input, fast_hash);
+		} else if(64 == input_size){
+			sha256_64(input, fast_hash);
+		} else {
+			sha256_80(input, fast_hash);
+		}
+	}
+	double fast_time = bench_now() - start;
+
+	printf("fixed\t%zu bytes\tgeneral %.0f hash/s\tfast path %.0f hash/s\t(x%.2f)\n", input_size,
+		count/general_time, count/fast_time, general_time/fast_time);
+	bench_report("fixed", "general", input_size, "hash_per_s", count/general_time);
+	bench_report("fixed", "fast_path", input_size, "hash_per_s", count/fast_time);
+
+	sha256_free(base);
+}
+
+//Leaves/sec building the root of a Merkle tree of 32 bytes leaves, against hashing node by node
+static void bench_merkle(size_t leaf_count){
+	unsigned char *leaves = malloc(leaf_count * 32);
+	unsigned char (*level)[32] = malloc(leaf_count * 32);
+	unsigned char (*tree)[32] = malloc(sha256_merkle_tree_size(leaf_count) * 32);
+	unsigned char root[32], node_input[64];
+	struct sha256_merkle_config config = {0, 0, 0, 0};
+
+	if(NULL == leaves || NULL == level || NULL == tree){
+		fprintf(stderr, "bench_merkle: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < leaf_count*32; ++c){
+		leaves[c] = (unsigned char) (c * 13);
+	}
+
+	//Node by node with the fixed-length fast paths
+	double start = bench_now();
+	for(size_t c = 0; c < leaf_count; ++c){
+		sha256_32(leaves + c*32, level[c]);
+	}
+	for(size_t count = leaf_count; count > 1; count = (count + 1)/2){
+		for(size_t c = 0; c < count/2; ++c){
+			memcpy(node_input, level[c*2], 64);
+			sha256_64(node_input, level[c]);
+		}
+		if(count % 2){
+			memcpy(level[count/2], level[count - 1], 32);
+		}
+	}
+	double naive_time = bench_now() - start;
+
+	//Fault the tree in first, the node by node loop reuses an already touched buffer too
+	memset(tree, 0, sha256_merkle_tree_size(leaf_count) * 32);
+	start = bench_now();
+	sha256_merkle_build(leaves, 32, leaf_count, &config, tree, root);
+	double build_time = bench_now() - start;
+
+	if(memcmp(root, level[0], 32)){
+		fprintf(stderr, "bench_merkle: root mismatch\n");
+		exit(1);
+	}
+
+	printf("merkle\t%zu leaves\tnode by node %.0f leaves/s\tsha256_merkle_build %.0f leaves/s\t(x%.2f)\n", leaf_count,
+		leaf_count/naive_time, leaf_count/build_time, naive_time/build_time);
+	bench_report("merkle", "node_by_node", leaf_count, "leaves_per_s", leaf_count/naive_time);
+	bench_report("merkle", "build", leaf_count, "leaves_per_s", leaf_count/build_time);
+
+	free(tree);
+	free(level);
+	free(leaves);
+}
+
+//Messages/sec digesting count messages of message_size bytes drawn from distinct payloads, with and
+//without a digest cache (fingerprint + lookup instead of hashing on a hit)
+static void bench_cache(size_t message_size, size_t distinct, size_t count){
+	struct sha256_base *base = sha256_init();
+	unsigned char *payloads = malloc(distinct * message_size);
+	struct sha256_cache_stats stats;
+
+	if(NULL == base || NULL == payloads || sha256_cache_enable(base, 1 << 20)){
+		fprintf(stderr, "bench_cache: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < distinct * message_size; ++c){
+		payloads[c] = (unsigned char) (c * 37 + c/message_size);
+	}
+
+	double start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		struct sha256_message *message = sha256_message_create_borrowed(payloads + (c % distinct)*message_size, message_size*8, base);
+		sha256_message_digest_batch(&message, 1, base);
+		sha256_message_delete(message, base);
+	}
+	double plain_time = bench_now() - start;
+
+	start = bench_now();
+	for(size_t c = 0; c < count; ++c){
+		const unsigned char *payload = payloads + (c % distinct)*message_size;
+		struct sha256_message *message = sha256_message_create_borrowed(payload, message_size*8, base);
+		sha256_message_digest_cached(message, sha256_cache_fingerprint(payload, message_size), 0);
+		sha256_message_delete(message, base);
+	}
+	double cached_time = bench_now() - start;
+
+	sha256_cache_get_stats(base, &stats);
+	printf("cache\t%zu bytes\t%zu payloads\tdigest %.0f msg/s\tcached %.0f msg/s\t(x%.2f, %.1f%% hits)\n", message_size, distinct,
+		count/plain_time, count/cached_time, plain_time/cached_time, 100.0*stats.hits/(stats.hits + stats.misses));
+	bench_report("cache", "digest", message_size, "msg_per_s", count/plain_time);
+	bench_report("cache", "cached", message_size, "msg_per_s", count/cached_time);
+
+	free(payloads);
+	sha256_free(base);
+}
+
+//MB/s hashing a file of length bytes (in the page cache): read whole and digested as a message, read
+//in pieces into a streaming context, and mapped with sha256_file_digest()
+static void bench_file(size_t length){
+	char path[] = "/tmp/sha256_bench_XXXXXX";
+	unsigned char *data = malloc(length);
+	unsigned char *buffer = malloc(1 << 20);
+	unsigned char hash[32], mapped_hash[32];
+	int fd = mkstemp(path);
+
+	if(NULL == data || NULL == buffer || fd < 0){
+		fprintf(stderr, "bench_file: setup failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < length; ++c){
+		data[c] = (unsigned char) (c * 23);
+	}
+	if(write(fd, data, length) != (ssize_t) length){
+		fprintf(stderr, "bench_file: write failed\n");
+		exit(1);
+	}
+
+	struct sha256_base *base = sha256_init();
+
+	double start = bench_now();
+	lseek(fd, 0, SEEK_SET);
+	ssize_t got = 0;
+	for(ssize_t result; got < (ssize_t) length && (result = read(fd, data + got, length - got)) > 0; got += result);
+	struct sha256_message *message = sha256_message_create_from_buffer((char *) data, (uint64_t) got*8, base);
+	sha256_message_preprocess(message);
+	sha256_message_digest(message, base);
+	double message_time = bench_now() - start;
+
+	start = bench_now();
+	struct sha256_context context;
+	lseek(fd, 0, SEEK_SET);
+	sha256_context_init(&context, base);
+	for(ssize_t result; (result = read(fd, buffer, 1 << 20)) > 0; ){
+		sha256_context_update(&context, buffer, (size_t) result);
+	}
+	sha256_context_final(&context, hash);
+	double read_time = bench_now() - start;
+
+	start = bench_now();
+	sha256_file_digest(path, mapped_hash);
+	double mapped_time = bench_now() - start;
+
+	if(memcmp(hash, message->hash, 32) || memcmp(hash, mapped_hash, 32)){
+		fprintf(stderr, "bench_file: hash mismatch\n");
+		exit(1);
+	}
+
+	printf("file\t%zu bytes\tmessage %.0f MB/s\tread %.0f MB/s\tsha256_file_digest %.0f MB/s\n", length,
+		length/message_time/1e6, length/read_time/1e6, length/mapped_time/1e6);
+	bench_report("file", "message", length, "mb_per_s", length/message_time/1e6);
+	bench_report("file", "read", length, "mb_per_s", length/read_time/1e6);
+	bench_report("file", "mapped", length, "mb_per_s", length/mapped_time/1e6);
+
+	sha256_free(base);
+	close(fd);
+	unlink(path);
+	free(buffer);
+	free(data);
+}
+
+//MB/s of the chunked tree-hash mode against plain SHA-256 on one input
+static void bench_tree(size_t length, size_t chunk_size){
+	unsigned char *data = malloc(length);
+	struct sha256_base *base = sha256_init();
+	struct sha256_context context;
+	unsigned char hash[32], root[32];
+
+	if(NULL == data || NULL == base){
+		fprintf(stderr, "bench_tree: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < length; ++c){
+		data[c] = (unsigned char) (c * 29);
+	}
+
+	double start = bench_now();
+	sha256_context_init(&context, base);
+	sha256_context_update(&context, data, length);
+	sha256_context_final(&context, hash);
+	double plain_time = bench_now() - start;
+
+	start = bench_now();
+	sha256_tree_digest(data, length, chunk_size, 0, NULL, root);
+	double tree_time = bench_now() - start;
+
+	printf("tree\t%zu bytes\t%zu bytes chunks\tsha256 %.0f MB/s\tsha256_tree_digest %.0f MB/s\t(x%.2f)\n", length, chunk_size,
+		length/plain_time/1e6, length/tree_time/1e6, plain_time/tree_time);
+	bench_report("tree", "sha256", length, "mb_per_s", length/plain_time/1e6);
+	bench_report("tree", "tree", length, "mb_per_s", length/tree_time/1e6);
+
+	sha256_free(base);
+	free(data);
+}
+
+//Derivations/sec of count PBKDF2 derivations (32 bytes keys) of the given iterations, on each tier the
+//CPU has and with the default choice of sha256_pbkdf2_batch()
+static void bench_pbkdf2(size_t count, uint64_t iterations){
+	static const char *tiers[] = {"single", "avx2", "avx512", "batch"};
+	static const unsigned int tier_lanes[] = {1, 8, 16, 0};
+	unsigned int features = sha256_cpu_features();
+	struct sha256_pbkdf2_job *jobs = malloc(count * sizeof(*jobs));
+	unsigned char (*keys)[32] = malloc(count * sizeof(*keys));
+	char (*passwords)[32] = malloc(count * sizeof(*passwords));
+
+	if(NULL == jobs || NULL == keys || NULL == passwords){
+		fprintf(stderr, "bench_pbkdf2: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < count; ++c){
+		snprintf(passwords[c], sizeof(passwords[c]), "password%zu", c);
+	}
+
+	for(int tier = 0; tier < 4; ++tier){
+		if((1 == tier && 0 == (features & SHA256_CPU_AVX2)) || (2 == tier && 0 == (features & SHA256_CPU_AVX512))){
+			continue;
+		}
+
+		for(size_t c = 0; c < count; ++c){
+			struct sha256_pbkdf2_job job = {passwords[c], strlen(passwords[c]), "salt", 4, iterations, keys[c], 32};
+
+			jobs[c] = job;
+		}
+
+		double start = bench_now();
+		if(tier_lanes[tier]){
+			sha256_pbkdf2_lanes(jobs, count, tier_lanes[tier]);
+		} else {
+			sha256_pbkdf2_batch(jobs, count);
+		}
+		double time = bench_now() - start;
+
+		double per_second = (double) count/time;
+		printf("pbkdf2 %s\t%zu x %llu iterations\t%.1f derivations/s\t%.3f ms each\n", tiers[tier], count,
+			(unsigned long long) iterations, per_second, time*1e3/(double) count);
+		bench_report("pbkdf2", tiers[tier], count, "derivations_per_s", per_second);
+	}
+
+	free(passwords);
+	free(keys);
+	free(jobs);
+}
+
+//Hashes/sec of the nonce search over count nonces with an unreachable target (the whole range is swept),
+//on each tier the CPU has and then on every online CPU
+static void bench_nonce(uint64_t count, int double_hash){
+	static const char *tiers[] = {"single", "avx2", "avx512", "threads"};
+	static const unsigned int tier_lanes[] = {1, 8, 16, 0};
+	unsigned int features = sha256_cpu_features();
+	struct sha256_nonce_config config;
+	struct sha256_nonce_result result;
+
+	for(int c = 0; c < 80; ++c){
+		config.header[c] = (unsigned char) (c * 11 + 5);
+	}
+	config.nonce_offset = 76;
+	memset(config.target, 0, 32);
+	config.double_hash = double_hash;
+	config.first_nonce = 0;
+	config.nonce_count = count;
+
+	for(int tier = 0; tier < 4; ++tier){
+		if((1 == tier && 0 == (features & SHA256_CPU_AVX2)) || (2 == tier && 0 == (features & SHA256_CPU_AVX512))){
+			continue;
+		}
+
+		config.thread_count = tier_lanes[tier] ? 1 : 0;
+		if(tier_lanes[tier]){
+			sha256_nonce_search_lanes(&config, &result, tier_lanes[tier]);
+		} else {
+			sha256_nonce_search(&config, &result);
+		}
+
+		double per_second = (double) result.hashes/((double) result.nanoseconds/1e9);
+		printf("nonce %s %s\t%llu nonces\t%.2f Mhash/s\n", double_hash ? "sha256d" : "sha256", tiers[tier],
+			(unsigned long long) count, per_second/1e6);
+		bench_report(double_hash ? "nonce_sha256d" : "nonce_sha256", tiers[tier], count, "hashes_per_s", per_second);
+	}
+}
+
+static int bench_compare_doubles(const void *a, const void *b){
+	double left = *(const double *) a, right = *(const double *) b;
+
+	return (left > right) - (left < right);
+}
+
+//Latency of hashing one buffer of input_size bytes, call by call: the one-shot sha256() against the
+//managed API (base, message, pre-processing, digest and hex string, all freed afterwards). The time of
+//reading the clock is measured first and taken out of every sample.
+static void bench_latency(size_t input_size, size_t count){
+	static const char *variants[] = {"oneshot", "managed"};
+	double *samples = malloc(count * sizeof(*samples));
+	unsigned char *input = malloc(input_size + 1);
+	unsigned char hash[32];
+
+	if(NULL == samples || NULL == input){
+		fprintf(stderr, "bench_latency: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < input_size; ++c){
+		input[c] = (unsigned char) (c * 13 + 5);
+	}
+
+	for(size_t c = 0; c < count; ++c){
+		double start = bench_now();
+		samples[c] = bench_now() - start;
+	}
+	qsort(samples, count, sizeof(*samples), bench_compare_doubles);
+	double clock_cost = samples[count/2];
+
+	for(int variant = 0; variant < 2; ++variant){
+		for(size_t c = 0; c < count; ++c){
+			input[0] = (unsigned char) c;	//Make every input different
+
+			double start = bench_now();
+			if(0 == variant){
+				sha256(input, input_size, hash);
+			} else {
+				struct sha256_base *base = sha256_init();
+				struct sha256_message *message = sha256_message_create_from_buffer((const char *) input, input_size*8, base);
+
+				sha256_message_preprocess(message);
+				sha256_message_digest(message, base);
+				free(sha256_message_get_hash(message));
+				sha256_free(base);
+			}
+			samples[c] = bench_now() - start - clock_cost;
+		}
+
+		qsort(samples, count, sizeof(*samples), bench_compare_doubles);
+		double p50 = samples[count/2]*1e9, p99 = samples[count*99/100]*1e9;
+
+		printf("latency %s\t%zu bytes\tp50 %.0f ns\tp99 %.0f ns\n", variants[variant], input_size, p50, p99);
+		bench_report("latency", variants[variant], input_size, "p50_ns", p50);
+		bench_report("latency", variants[variant], input_size, "p99_ns", p99);
+	}
+
+	free(input);
+	free(samples);
+}
+
+struct bench_shared_worker{
+	struct sha256_base *base;
+	const char *buffer;
+	size_t message_size;
+	size_t count;
+	unsigned char expected[32];
+	int mismatches;
+	pthread_t thread;
+};
+
+//Creates, digests and deletes count messages on the shared base
+static void *bench_shared_run(void *argument){
+	struct bench_shared_worker *worker = argument;
+
+	for(size_t c = 0; c < worker->count; ++c){
+		struct sha256_message *message = sha256_message_create_from_buffer(worker->buffer, worker->message_size*8, worker->base);
+
+		if(NULL == message){
+			++worker->mismatches;
+			break;
+		}
+
+		sha256_message_digest_batch(&message, 1, worker->base);
+		worker->mismatches += 0 != memcmp(message->hash, worker->expected, 32);
+		sha256_message_delete(message, worker->base);
+	}
+
+	return NULL;
+}
+
+//Scaling of a base shared by 1 to max_threads threads, every thread doing the same work (count messages
+//of message_size bytes). The efficiency is the throughput relative to one thread times the number of
+//threads the CPU can actually run at once.
+static void bench_shared(size_t message_size, size_t count, unsigned int max_threads){
+	struct bench_shared_worker *workers = malloc(max_threads * sizeof(*workers));
+	char *buffer = malloc(message_size + 1);
+	struct sha256_base *reference = sha256_init();
+	struct sha256_context context;
+	unsigned char expected[32];
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	double single_rate = 0;
+
+	if(NULL == workers || NULL == buffer || NULL == reference){
+		fprintf(stderr, "bench_shared: allocation failed\n");
+		exit(1);
+	}
+
+	for(size_t c = 0; c < message_size; ++c){
+		buffer[c] = (char) (c * 31 + 7);
+	}
+
+	sha256_context_init(&context, reference);
+	sha256_context_update(&context, buffer, message_size);
+	sha256_context_final(&context, expected);
+	sha256_free(reference);
+
+	for(unsigned int threads = 1; threads <= max_threads; threads *= 2){
+		struct sha256_base *base = sha256_init();
+		unsigned int started = 0;
+		int mismatches = 0;
+		char variant[32];
+
+		if(NULL == base || sha256_base_share(base)){
+			exit(1);
+		}
+
+		double start = bench_now();
+		for(; started < threads; ++started){
+			struct bench_shared_worker *worker = &workers[started];
+
+			worker->base = base;
+			worker->buffer = buffer;
+			worker->message_size = message_size;
+			worker->count = count;
+			worker->mismatches = 0;
+			memcpy(worker->expected, expected, 32);
+
+			if(pthread_create(&worker->thread, NULL, bench_shared_run, worker)){
+				break;
+			}
+		}
+		for(unsigned int c = 0; c < started; ++c){
+			pthread_join(workers[c].thread, NULL);
+			mismatches += workers[c].mismatches;
+		}
+		double time = bench_now() - start;
+
+		sha256_free(base);
+
+		if(started < threads || mismatches){
+			fprintf(stderr, "bench_shared: %u thread(s): %d wrong digest(s)\n", threads, mismatches);
+			++bench_failures;
+			break;
+		}
+
+		double rate = started*count/time;
+		unsigned int parallel = online > 0 && (unsigned int) online < threads ? (unsigned int) online : threads;
+
+		if(1 == threads){
+			single_rate = rate;
+		}
+
+		printf("shared base\t%zu bytes\t%2u thread(s)\t%.0f msg/s\tefficiency %.2f\n", message_size, threads, rate,
+			rate/(single_rate*parallel));
+		snprintf(variant, sizeof(variant), "%u_threads", threads);
+		bench_report("shared", variant, message_size, "msg_per_s", rate);
+		bench_report("shared", variant, message_size, "efficiency", rate/(single_rate*parallel));
+	}
+
+	free(buffer);
+	free(workers);
+}
+
+int main(int argc, char **argv){
+	unsigned int features = sha256_cpu_features();
+
+	printf("CPU features:%s%s%s\n", (features & SHA256_CPU_SHANI) ? " sha-ni" : "",
+		(features & SHA256_CPU_AVX2) ? " avx2" : "", (features & SHA256_CPU_AVX512) ? " avx512" : "");
+
+	if(bench_known_answers()){
+		fprintf(stderr, "known-answer: %d failure(s), not benchmarking\n", bench_failures);
+		return 1;
+	}
+	puts("known-answer vectors OK");
+
+	if(argc > 1){
+		bench_results = fopen(argv[1], "w");
+		if(NULL == bench_results){
+			perror(argv[1]);
+			return 1;
+		}
+		fprintf(bench_results, "group,variant,size,metric,value\n");
+	}
+
+	bench_setup(100000);
+
+	bench_kernels(1 << 14, 16);
+
+	bench_families(64, 100000);
+	bench_families(1024, 20000);
+	bench_families(16384, 2000);
+
+	bench_throughput(0);
+	bench_throughput(64);
+	bench_throughput(1 << 10);
+	bench_throughput(64 << 10);
+	bench_throughput(1 << 20);
+	bench_throughput(64 << 20);
+	bench_throughput((uint64_t) 1 << 30);
+
+	bench_registration(1000, 0);
+	bench_registration(10000, 0);
+	bench_registration(100000, 0);
+	bench_registration(1000000, 0);
+	bench_registration(100000, 1);
+	bench_registration(1000000, 1);
+
+	bench_latency(0, 100000);
+	bench_latency(64, 100000);
+	bench_latency(256, 100000);
+	bench_latency(1024, 100000);
+	bench_latency(4096, 100000);
+
+	bench_shared(64, 200000, 64);
+	bench_shared(4096, 20000, 64);
+
+	bench_batch(0, 100000);
+	bench_batch(32, 100000);
+	bench_batch(64, 100000);
+	bench_batch(256, 100000);
+	bench_batch(1024, 50000);
+	bench_batch(16384, 5000);
+
+	bench_fixed(32, 1000000);
+	bench_fixed(64, 1000000);
+	bench_fixed(80, 1000000);
+
+	bench_nonce(1 << 24, 0);
+	bench_nonce(1 << 24, 1);
+
+	bench_pbkdf2(1, 100000);
+	bench_pbkdf2(16, 100000);
+	bench_pbkdf2(64, 10000);
+
+	bench_merkle(1 << 20);
+
+	bench_tree(256 << 20, 1 << 20);
+
+	bench_file(256 << 20);
+
+	bench_cache(4096, 100, 100000);
+	bench_cache(65536, 100, 10000);
+
+	bench_borrowed(1024, 100000);
+	bench_borrowed(16384, 20000);
+	bench_borrowed(65536, 5000);
+
+	if(bench_results){
+		fclose(bench_results);
+	}
+
+	return 0;
+}
@@ -0,0 +1,346 @@
+#include "sha256_digest.h"
+#include <pthread.h>
+
+//Digest cache owned by a sha256_base. Digests are stored under a key given by the caller (an identity,
+//the length in bits and a version tag) in a hash table with a fixed number of entries, all allocated
+//when the cache is enabled. When it's full the least recently used entry is evicted.
+//The cache never looks at the data: the caller must make sure a key never stands for two different
+//contents (i.e. bumping the tag whenever a buffer is modified).
+//On a shared base (see sha256_base_share()) every access to the cache takes its lock.
+
+//Marks the end of a bucket chain or of the LRU list
+#define SHA256_CACHE_NONE UINT32_MAX
+
+struct sha256_cache_entry{
+	uint64_t identity;
+	uint64_t bits_length;
+	uint64_t tag;
+	unsigned char hash[32];
+	uint32_t chain;	//Next entry on the same bucket
+	uint32_t newer;	//LRU list neighbours
+	uint32_t older;
+};
+
+struct sha256_cache{
+	struct sha256_cache_entry *entries;
+	uint32_t *buckets;	//First entry of each bucket
+	uint32_t bucket_mask;	//Number of buckets - 1 (a power of 2)
+	uint32_t capacity;	//Number of entries
+	uint32_t used;	//Entries handed out so far, they're only reused through eviction afterwards
+	uint32_t newest;
+	uint32_t oldest;
+	struct sha256_cache_stats stats;
+	pthread_mutex_t lock;	//Only taken on shared bases
+};
+
+static void sha256_cache_lock(struct sha256_base *base){
+	if(base->shards){
+		pthread_mutex_lock(&base->cache->lock);
+	}
+}
+
+static void sha256_cache_unlock(struct sha256_base *base){
+	if(base->shards){
+		pthread_mutex_unlock(&base->cache->lock);
+	}
+}
+
+//Bucket of a key
+static uint32_t sha256_cache_bucket(const struct sha256_cache *cache, uint64_t identity, uint64_t bits_length, uint64_t tag){
+	uint64_t x = identity ^ (bits_length * 0x9e3779b97f4a7c15ULL) ^ (tag * 0xc2b2ae3d27d4eb4fULL);
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+
+	return (uint32_t) x & cache->bucket_mask;
+}
+
+//Unlinks an entry from the LRU list
+static void sha256_cache_lru_unlink(struct sha256_cache *cache, uint32_t index){
+	struct sha256_cache_entry *entry = &cache->entries[index];
+
+	if(SHA256_CACHE_NONE == entry->newer){
+		cache->newest = entry->older;
+	} else {
+		cache->entries[entry->newer].older = entry->older;
+	}
+
+	if(SHA256_CACHE_NONE == entry->older){
+		cache->oldest = entry->newer;
+	} else {
+		cache->entries[entry->older].newer = entry->newer;
+	}
+}
+
+//Puts an entry at the front (most recently used end) of the LRU list
+static void sha256_cache_lru_push(struct sha256_cache *cache, uint32_t index){
+	struct sha256_cache_entry *entry = &cache->entries[index];
+
+	entry->newer = SHA256_CACHE_NONE;
+	entry->older = cache->newest;
+
+	if(SHA256_CACHE_NONE == cache->newest){
+		cache->oldest = index;
+	} else {
+		cache->entries[cache->newest].newer = index;
+	}
+	cache->newest = index;
+}
+
+//Finds the entry of a key, SHA256_CACHE_NONE if it isn't cached
+static uint32_t sha256_cache_find(const struct sha256_cache *cache, uint64_t identity, uint64_t bits_length, uint64_t tag){
+	uint32_t index = cache->buckets[sha256_cache_bucket(cache, identity, bits_length, tag)];
+
+	while(SHA256_CACHE_NONE != index){
+		const struct sha256_cache_entry *entry = &cache->entries[index];
+
+		if(entry->identity == identity && entry->bits_length == bits_length && entry->tag == tag){
+			return index;
+		}
+		index = entry->chain;
+	}
+
+	return SHA256_CACHE_NONE;
+}
+
+//Attaches a digest cache of at most max_bytes bytes (entries and table) to the base.
+//Returns 0 if it went OK, -1 if any error occurred.
+int sha256_cache_enable(struct sha256_base *base, size_t max_bytes){
+	struct sha256_cache *cache;
+	size_t capacity = max_bytes/(sizeof(struct sha256_cache_entry) + 2*sizeof(uint32_t));
+	size_t bucket_count = 1;
+
+	if(base->cache){
+		sha256_warning("The base already has a cache.");
+		return 0;
+	}
+
+	if(0 == capacity){
+		sha256_warning("The cache can't hold a single entry.");
+		return -1;
+	}
+	if(capacity > SHA256_CACHE_NONE/2){
+		capacity = SHA256_CACHE_NONE/2;
+	}
+
+	//At most 2 buckets per entry, so the table stays within the budget
+	while(bucket_count < capacity){
+		bucket_count *= 2;
+	}
+
+	cache = malloc(sizeof(struct sha256_cache));
+	if(NULL == cache){
+		sha256_error(MALLOC_ERROR);
+		return -1;
+	}
+	memset(cache, 0, sizeof(struct sha256_cache));
+
+	cache->entries = malloc(capacity * sizeof(struct sha256_cache_entry));
+	cache->buckets = malloc(bucket_count * sizeof(uint32_t));
+	if(NULL == cache->entries || NULL == cache->buckets){
+		sha256_error(MALLOC_ERROR);
+		free(cache->entries);
+		free(cache->buckets);
+		free(cache);
+		return -1;
+	}
+
+	cache->capacity = (uint32_t) capacity;
+	cache->bucket_mask = (uint32_t) (bucket_count - 1);
+	cache->stats.capacity = capacity;
+	cache->stats.bytes = capacity * sizeof(struct sha256_cache_entry) + bucket_count * sizeof(uint32_t);
+	pthread_mutex_init(&cache->lock, NULL);
+
+	base->cache = cache;
+	sha256_cache_clear(base);
+
+	return 0;
+}
+
+//Looks a key up. If it's cached its digest is written to hash and it becomes the most recently used entry.
+//Returns 1 on a hit, 0 on a miss (or if the base has no cache).
+int sha256_cache_lookup(struct sha256_base *base, uint64_t identity, uint64_t bits_length, uint64_t tag, unsigned char hash[32]){
+	struct sha256_cache *cache = base->cache;
+
+	if(NULL == cache){
+		return 0;
+	}
+
+	sha256_cache_lock(base);
+
+	uint32_t index = sha256_cache_find(cache, identity, bits_length, tag);
+
+	if(SHA256_CACHE_NONE == index){
+		++cache->stats.misses;
+		sha256_cache_unlock(base);
+		return 0;
+	}
+
+	++cache->stats.hits;
+	memcpy(hash, cache->entries[index].hash, 32);
+
+	if(cache->newest != index){
+		sha256_cache_lru_unlink(cache, index);
+		sha256_cache_lru_push(cache, index);
+	}
+
+	sha256_cache_unlock(base);
+
+	return 1;
+}
+
+//Stores the digest of a key, evicting the least recently used entry if the cache is full
+void sha256_cache_store(struct sha256_base *base, uint64_t identity, uint64_t bits_length, uint64_t tag, const unsigned char hash[32]){
+	struct sha256_cache *cache = base->cache;
+	struct sha256_cache_entry *entry;
+	uint32_t index;
+
+	if(NULL == cache){
+		return;
+	}
+
+	sha256_cache_lock(base);
+
+	index = sha256_cache_find(cache, identity, bits_length, tag);
+
+	if(SHA256_CACHE_NONE != index){
+		//Already there, just refresh it
+		sha256_cache_lru_unlink(cache, index);
+	} else {
+		if(cache->used < cache->capacity){
+			index = cache->used++;
+			++cache->stats.entries;
+		} else {
+			//Evict the oldest entry, unlinking it from its bucket
+			index = cache->oldest;
+			entry = &cache->entries[index];
+
+			uint32_t *link = &cache->buckets[sha256_cache_bucket(cache, entry->identity, entry->bits_length, entry->tag)];
+			while(*link != index){
+				link = &cache->entries[*link].chain;
+			}
+			*link = entry->chain;
+
+			sha256_cache_lru_unlink(cache, index);
+			++cache->stats.evictions;
+		}
+
+		entry = &cache->entries[index];
+		entry->identity = identity;
+		entry->bits_length = bits_length;
+		entry->tag = tag;
+
+		uint32_t bucket = sha256_cache_bucket(cache, identity, bits_length, tag);
+		entry->chain = cache->buckets[bucket];
+		cache->buckets[bucket] = index;
+
+		++cache->stats.insertions;
+	}
+
+	memcpy(cache->entries[index].hash, hash, 32);
+	sha256_cache_lru_push(cache, index);
+
+	sha256_cache_unlock(base);
+}
+
+//Digests the message unless the cache already has the digest of (identity, message length, tag), storing
+//it otherwise. The message doesn't need to be pre-processed.
+//Returns 1 if the digest came from the cache, 0 if it was computed.
+int sha256_message_digest_cached(struct sha256_message *message, uint64_t identity, uint64_t tag){
+	struct sha256_base *base = message->base;
+
+	if(message->digested){
+		sha256_warning("Message already digested.");
+		return 0;
+	}
+
+	if(sha256_cache_lookup(base, identity, message->bits_length, tag, message->hash)){
+		message->digested = 1;
+		return 1;
+	}
+
+	sha256_message_digest_batch(&message, 1, base);
+	sha256_cache_store(base, identity, message->bits_length, tag, message->hash);
+
+	return 0;
+}
+
+//Cheap 64-bit fingerprint of length bytes of data, to be used as an identity when there's no better one.
+//It reads all the data, but it's several times faster than SHA-256. It's NOT collision resistant: inputs
+//chosen by an attacker can share a fingerprint.
+uint64_t sha256_cache_fingerprint(const void *data, size_t length){
+	const unsigned char *bytes = data;
+	uint64_t x = 0x9e3779b97f4a7c15ULL ^ length;
+	size_t c = 0;
+
+	for(; c + 8 <= length; c += 8){
+		uint64_t word;
+
+		memcpy(&word, bytes + c, 8);
+		x ^= word * 0x87c37b91114253d5ULL;
+		x = ((x << 31) | (x >> 33)) * 0x4cf5ad432745937fULL;
+	}
+
+	for(; c < length; ++c){
+		x ^= bytes[c];
+		x *= 0x100000001b3ULL;
+	}
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+
+	return x;
+}
+
+//Copies the cache statistics to stats. Returns 0 if it went OK, -1 if the base has no cache.
+int sha256_cache_get_stats(struct sha256_base *base, struct sha256_cache_stats *stats){
+	if(NULL == base->cache){
+		memset(stats, 0, sizeof(*stats));
+		return -1;
+	}
+
+	sha256_cache_lock(base);
+	*stats = base->cache->stats;
+	sha256_cache_unlock(base);
+
+	return 0;
+}
+
+//Drops every cached digest, keeping the cache's memory (the statistics aren't reset)
+void sha256_cache_clear(struct sha256_base *base){
+	struct sha256_cache *cache = base->cache;
+
+	if(NULL == cache){
+		return;
+	}
+
+	sha256_cache_lock(base);
+
+	for(uint32_t c = 0; c <= cache->bucket_mask; ++c){
+		cache->buckets[c] = SHA256_CACHE_NONE;
+	}
+
+	cache->used = 0;
+	cache->newest = SHA256_CACHE_NONE;
+	cache->oldest = SHA256_CACHE_NONE;
+	cache->stats.entries = 0;
+
+	sha256_cache_unlock(base);
+}
+
+//Frees the base's cache. Called by sha256_free().
+void sha256_cache_destroy(struct sha256_base *base){
+	if(NULL == base->cache){
+		return;
+	}
+
+	pthread_mutex_destroy(&base->cache->lock);
+	free(base->cache->entries);
+	free(base->cache->buckets);
+	free(base->cache);
+	base->cache = NULL;
+}
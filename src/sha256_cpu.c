@@ -0,0 +1,61 @@
+#include "sha256_digest.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+
+//Reads the extended control register, telling which register states the OS saves on context switches
+static uint64_t sha256_xgetbv(void){
+	uint32_t eax, edx;
+
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+	return ((uint64_t) edx << 32) | eax;
+}
+#endif
+
+//Detects (once) the CPU features the library has kernels for. Returns a mask of SHA256_CPU_* flags.
+//Threads racing on the first call all detect, and store, the same features.
+unsigned int sha256_cpu_features(void){
+	static int detected = 0;
+	static unsigned int cached_features = 0;
+	unsigned int features = 0;
+
+	if(__atomic_load_n(&detected, __ATOMIC_ACQUIRE)){
+		return __atomic_load_n(&cached_features, __ATOMIC_RELAXED);
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int max_level = __get_cpuid_max(0, NULL);
+	int sse41 = 0, avx_os = 0, avx512_os = 0;
+
+	if(max_level >= 1){
+		__cpuid(1, eax, ebx, ecx, edx);
+		sse41 = (ecx >> 19) & 1;
+		//OSXSAVE: the OS lets us check which register states are enabled
+		if((ecx >> 27) & 1){
+			uint64_t xcr0 = sha256_xgetbv();
+			avx_os = (xcr0 & 0x06) == 0x06;	//XMM and YMM state
+			avx512_os = (xcr0 & 0xE6) == 0xE6;	//Plus opmask and ZMM state
+		}
+	}
+
+	if(max_level >= 7){
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if(sse41 && ((ebx >> 29) & 1)){
+			features |= SHA256_CPU_SHANI;
+		}
+		if(avx_os && ((ebx >> 5) & 1)){
+			features |= SHA256_CPU_AVX2;
+		}
+		if(avx512_os && ((ebx >> 16) & 1)){
+			features |= SHA256_CPU_AVX512;
+		}
+	}
+#endif
+
+	__atomic_store_n(&cached_features, features, __ATOMIC_RELAXED);
+	__atomic_store_n(&detected, 1, __ATOMIC_RELEASE);
+
+	return features;
+}
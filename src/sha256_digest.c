@@ -1,13 +1,9 @@
 #include "sha256_digest.h"
 
 //Sha256 Error Handling
-/* When we call the function sha256_error, we will actually be calling a MACRO that will
-	call the real function including the line number */
-#define sha256_error(x) sha256_err(x, __FILE__, __func__, __LINE__)
+/* When we call the function sha256_error, we will actually be calling a MACRO (sha256_digest.h) that
+	will call the real function including the line number */
 void sha256_err(int error_code, const char *file_name, const char *function_name, unsigned int line){
-	#define MALLOC_ERROR 1
-	#define DIGEST_ERROR 2
-
 	switch(error_code){
 		case MALLOC_ERROR:
 			fprintf(stderr, "[ERROR] (%s) Function %s at line %u: malloc() didn't work!\n", file_name, function_name, line);
@@ -15,6 +11,9 @@ void sha256_err(int error_code, const char *file_name, const char *function_name
 		case DIGEST_ERROR:
 			fprintf(stderr, "[ERROR] (%s) Function %s at line %u: Trying to digest a message that wasn't pre-processed!\n", file_name, function_name, line);
 			break;
+		case THREAD_ERROR:
+			fprintf(stderr, "[ERROR] (%s) Function %s at line %u: Couldn't start a worker thread!\n", file_name, function_name, line);
+			break;
 		default:
 			fprintf(stderr, "[ERROR] (%s) Function %s at line %u: Unknown error code!\n", file_name, function_name, line);
 			break;
@@ -22,11 +21,24 @@ void sha256_err(int error_code, const char *file_name, const char *function_name
 }
 
 /* We do the same to obtain a warning function */
-#define sha256_warning(x) sha256_warn(x, __FILE__, __func__, __LINE__)
 void sha256_warn(const char *warning_msg, const char *file_name, const char *function_name, unsigned int line){
 	fprintf(stderr, "[WARNING] (%s) Function %s at line %u: %s\n", file_name, function_name, line, warning_msg);
 }
 
+//Gets the hash values (First 32 bits of the fractional part of the square root from the first 8 prime numbers)
+const uint32_t sha256_default_hash_values[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+//Gets the Round Constants (First 32 bits of the fractional part of the cube root from the first 64 prime numbers)
+const uint32_t sha256_default_round_constants[64] = 
+	{0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
 //Sha256 Init
 struct sha256_base *sha256_init(void){
 	struct sha256_base *base;
@@ -42,21 +54,9 @@ struct sha256_base *sha256_init(void){
 	//Initiates struct to 0
 	memset(base, 0, sizeof(struct sha256_base));
 
-	//Gets the hash values (First 32 bits of the fractional part of the square root from the first 8 prime numbers)
-	static const uint32_t DefaultHashValues[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
-		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
-	memcpy(base->HashValues, DefaultHashValues, sizeof(DefaultHashValues));	//Assign default values to the Structure
-	//Gets the Round Constants (First 32 bits of the fractional part of the cube root from the first 64 prime numbers)
-	static const uint32_t DefaultRoundConstants[64] = 
-		{0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
-	memcpy(base->RoundConstants, DefaultRoundConstants, sizeof(DefaultRoundConstants));
+	//The constants are never written, every base points to the same tables
+	base->HashValues = sha256_default_hash_values;
+	base->RoundConstants = sha256_default_round_constants;
 
 	//Messages linked list pointer initialization
 	base->messages_list_entry.prev = NULL;
@@ -70,28 +70,105 @@ error1:
 	return NULL;
 }
 
+static void sha256_message_register(struct sha256_message *message, struct sha256_base *base);
+
 //Sha256 Free
 void sha256_free(struct sha256_base *base){
-	//Frees the messages associated with the sha256 base struct
-	while(NULL != base->messages_list_entry.next){
-		struct sha256_message *entry;
+	if(NULL == base){
+		return;
+	}
 
-		entry = base->messages_list_entry.next;
+	//Frees the messages associated with the sha256 base struct (no need to unlink them one by one,
+	//the whole lists go away)
+	struct sha256_list *list;
+	for(unsigned int c = 0; NULL != (list = sha256_base_list(base, c)); ++c){
+		struct sha256_message *entry = list->next;
 
-		sha256_message_delete(entry, base);
+		while(NULL != entry){
+			struct sha256_message *next = entry->messages_list_entry.next;
+
+			sha256_message_release(entry, base);
+			entry = next;
+		}
 	}
 
+	//Frees the arena, the cache and the shards, if the base has them
+	sha256_arena_destroy(base);
+	sha256_cache_destroy(base);
+	sha256_shard_destroy(base);
+
 	//Frees the sha256 base struct
-	if(base){
-		free(base);
+	free(base);
+}
+
+//Appends a message to the end of a list (the base's or a shard's). The list's prev pointer always
+//points to the last message, so there's no need to walk the list.
+void sha256_message_link(struct sha256_message *message, struct sha256_list *list){
+	message->messages_list_entry.next = NULL;
+
+	//If it's the first message
+	if(NULL == list->next){
+		list->next = message;
+		message->messages_list_entry.prev = list;
+	} else {
+		struct sha256_message *last = list->prev;
+
+		last->messages_list_entry.next = message;
+		message->messages_list_entry.prev = last;
+	}
+
+	list->prev = message;
+}
+
+//Removes a message from the list it was linked to
+void sha256_message_unlink(struct sha256_message *message, struct sha256_list *list){
+	struct sha256_message *tmp_entry; //tmp_entry for conversing the void * to a struct sha256_message *
+
+	//Messages is right after the list head:
+	if(list == message->messages_list_entry.prev){
+		list->next = message->messages_list_entry.next;
+	} else {
+		tmp_entry = message->messages_list_entry.prev;
+		tmp_entry->messages_list_entry.next = message->messages_list_entry.next;
+	}
+
+	if(NULL != message->messages_list_entry.next){
+		tmp_entry = message->messages_list_entry.next;
+		tmp_entry->messages_list_entry.prev = message->messages_list_entry.prev;
+	} else {
+		//It was the last message, the one before it is the last now
+		list->prev = (NULL == list->next) ? NULL : message->messages_list_entry.prev;
 	}
 }
 
+//Registers a message on the base (on the calling thread's shard if the base is shared)
+static void sha256_message_register(struct sha256_message *message, struct sha256_base *base){
+	message->base = base;
+
+	if(base->shards){
+		sha256_shard_register(message, base);
+	} else {
+		sha256_message_link(message, &base->messages_list_entry);
+	}
+}
+
+//Frees everything on the message entry (it must be already unlinked or about to be freed with its base)
+void sha256_message_release(struct sha256_message *message, struct sha256_base *base){
+	//Borrowed messages belong to the user
+	if(0 == message->borrowed){
+		sha256_base_dealloc(base, message->msg, message->allocation & SHA256_ARENA_MSG);
+	}
+	sha256_base_dealloc(base, message->preprocessed_msg, message->allocation & SHA256_ARENA_PREPROCESSED);
+	sha256_base_dealloc_message(base, message);
+}
+
 //Create a message to digest from a string
 struct sha256_message *sha256_message_create_from_string(const char *string, struct sha256_base *base){
 	struct sha256_message *message;
+	SHA256_STATS_START(stats_start);
 
-	message = malloc(sizeof(struct sha256_message));
+	//Comes filled with 0's
+	message = sha256_base_alloc_message(base);
 
 	//Checks for error
 	if(NULL == message){
@@ -99,33 +176,15 @@ struct sha256_message *sha256_message_create_from_string(const char *string, str
 		goto error1;
 	}
 
-	//Initialize with 0's
-	memset(message, 0, sizeof(struct sha256_message));
-
 	//Adds the message to the linked list of messages
-	//If it's the first message
-	if(NULL == base->messages_list_entry.next){
-		base->messages_list_entry.next = message;
-		message->messages_list_entry.prev = base;
-		message->messages_list_entry.next = NULL;
-	} else {
-		struct sha256_message *entry;
-		//Get first message in the list
-		entry = base->messages_list_entry.next;
-
-		//While we are not in the last message
-		while(NULL != entry->messages_list_entry.next){
-			entry = entry->messages_list_entry.next;
-		}
-
-		//We are in the last message, add the new one
-		entry->messages_list_entry.next = message;
-		message->messages_list_entry.prev = entry;
-		message->messages_list_entry.next = NULL;
-	}
+	sha256_message_register(message, base);
 
 	//Allocates space for the message string (without the null byte)
-	message->msg = malloc(strlen(string));
+	int from_arena;
+	message->msg = sha256_base_alloc(base, strlen(string), &from_arena);
+	if(from_arena){
+		message->allocation |= SHA256_ARENA_MSG;
+	}
 
 	if(NULL == message->msg){
 		sha256_error(MALLOC_ERROR);
@@ -145,30 +204,26 @@ struct sha256_message *sha256_message_create_from_string(const char *string, str
 	message->processed = 0; //Message is not processed yet (Just explicitly stating it, though we already
 				//initialized the object to 0...)
 
+	SHA256_STATS_END(base, SHA256_PHASE_CREATE, stats_start);
+
 	return message;
 
 error1:	//sha256_message struct allocation error
-	if(message){
-		free(message);
-	}
 	return NULL;
 error2:	//sha256_message->msg string allocation error
-	if(message->msg){
-		free(message->msg);
-	}
 	//We call the sha256_message_delete function to avoid having to worry about the linked list updating
-	if(message){
-		sha256_message_delete(message, base);
-	}
+	sha256_message_delete(message, base);
 	return NULL;
 }
 
 //Create message from a buffer, specifying the length of the message. That way the user can create a message
 //that has a length outside the bytes boundaries (not a multiple of 8 bits).
-struct sha256_message *sha256_message_create_from_buffer(const char *buffer, unsigned int bits_length, struct sha256_base *base){
+struct sha256_message *sha256_message_create_from_buffer(const char *buffer, uint64_t bits_length, struct sha256_base *base){
 	struct sha256_message *message;
+	SHA256_STATS_START(stats_start);
 
-	message = malloc(sizeof(struct sha256_message));
+	//Comes filled with 0's
+	message = sha256_base_alloc_message(base);
 
 	//Checks for error
 	if(NULL == message){
@@ -176,30 +231,8 @@ struct sha256_message *sha256_message_create_from_buffer(const char *buffer, uns
 		goto error1;
 	}
 
-	//Initialize with 0's
-	memset(message, 0, sizeof(struct sha256_message));
-
 	//Adds the message to the linked list of messages
-	//If it's the first message
-	if(NULL == base->messages_list_entry.next){
-		base->messages_list_entry.next = message;
-		message->messages_list_entry.prev = base;
-		message->messages_list_entry.next = NULL;
-	} else {
-		struct sha256_message *entry;
-		//Get first message in the list
-		entry = base->messages_list_entry.next;
-
-		//While we are not in the last message
-		while(NULL != entry->messages_list_entry.next){
-			entry = entry->messages_list_entry.next;
-		}
-
-		//We are in the last message, add the new one
-		entry->messages_list_entry.next = message;
-		message->messages_list_entry.prev = entry;
-		message->messages_list_entry.next = NULL;
-	}
+	sha256_message_register(message, base);
 
 	//Size of the message:
 	//If the message size is 0 bits, we allocate at least a byte to hold the message.
@@ -214,16 +247,20 @@ struct sha256_message *sha256_message_create_from_buffer(const char *buffer, uns
 		}
 	}
 
-	message->msg = malloc(message_size);
-
-	//Fill with 0's
-	memset(message->msg, 0, message_size);
+	int from_arena;
+	message->msg = sha256_base_alloc(base, message_size, &from_arena);
+	if(from_arena){
+		message->allocation |= SHA256_ARENA_MSG;
+	}
 
 	if(NULL == message->msg){
 		sha256_error(MALLOC_ERROR);
 		goto error2;
 	}
 
+	//Fill with 0's
+	memset(message->msg, 0, message_size);
+
 	//The user is responsable for giving a length of bits that doesn't extrapolate the buffer size.
 	//If the user gives us a buffer, smaller then the bits_length given we will end up accessing
 	//out-of-boundary memory!
@@ -250,29 +287,52 @@ struct sha256_message *sha256_message_create_from_buffer(const char *buffer, uns
 	message->processed = 0; //Message is not processed yet (Just explicitly stating it, though we already
 				//initialized the object to 0...)
 
+	SHA256_STATS_END(base, SHA256_PHASE_CREATE, stats_start);
+
 	return message;
 
 error1:	//sha256_message struct allocation error
-	if(message){
-		free(message);
-	}
 	return NULL;
 error2:	//sha256_message->msg string allocation error
-	if(message->msg){
-		free(message->msg);
-	}
 	//We call the sha256_message_delete function to avoid having to worry about the linked list updating
-	if(message){
-		sha256_message_delete(message, base);
-	}
+	sha256_message_delete(message, base);
 	return NULL;
 }
 
+//Create a message that references the user's buffer instead of copying it. The buffer must stay valid
+//and unchanged until the message is digested (and while sha256_message_show() or
+//sha256_message_debug_bits() may be called on it). The message is digested straight from the buffer.
+struct sha256_message *sha256_message_create_borrowed(const void *buffer, uint64_t bits_length, struct sha256_base *base){
+	struct sha256_message *message;
+	SHA256_STATS_START(stats_start);
+
+	//Comes filled with 0's
+	message = sha256_base_alloc_message(base);
+
+	//Checks for error
+	if(NULL == message){
+		sha256_error(MALLOC_ERROR);
+		return NULL;
+	}
+
+	//Adds the message to the linked list of messages
+	sha256_message_register(message, base);
+
+	//The buffer is only read, never written
+	message->msg = (unsigned char *) buffer;
+	message->bits_length = bits_length;
+	message->borrowed = 1;
+
+	SHA256_STATS_END(base, SHA256_PHASE_CREATE, stats_start);
+
+	return message;
+}
+
 //Print the sha256_message string
 void sha256_message_show(struct sha256_message *message){
 	puts("======================================");
 	puts("Message:");
-	int message_size;
+	size_t message_size;
 	if(0 == message->bits_length){
 		message_size = 1;
 	} else {
@@ -282,7 +342,7 @@ void sha256_message_show(struct sha256_message *message){
 		}
 	}
 	printf("'");
-	for(int c = 0; c < message_size; ++c){
+	for(size_t c = 0; c < message_size; ++c){
 		printf("%c", message->msg[c]);
 	}
 	puts("'");
@@ -299,7 +359,7 @@ void sha256_message_debug_bits(struct sha256_message *message){
 		puts("======================================");
 		printf("Message (%lu bits):\n", (long unsigned int) message->bits_length);
 
-		unsigned int counter;
+		uint64_t counter;
 		unsigned char z;
 
 		//MSG
@@ -325,6 +385,12 @@ void sha256_message_debug_bits(struct sha256_message *message){
 		//PREPROCESSED MSG
 		printf("Preprocessed message %lu bits:\n", (long unsigned int) message->preprocessed_bits_length);
 
+		if(NULL == message->preprocessed_msg){
+			puts("Borrowed message, padded only while digesting.");
+			puts("======================================");
+			return;
+		}
+
 		for(counter = 0; counter < (message->preprocessed_bits_length/8); ++counter){
 			for(z = 128; z > 0; z >>= 1){
 				if((message->preprocessed_msg[counter] & z) == z){
@@ -349,57 +415,37 @@ void sha256_message_debug_bits(struct sha256_message *message){
 
 //Deletes a sha256_message (-1 = error; 0 = OK)
 int sha256_message_delete(struct sha256_message *message, struct sha256_base *base){
-	if(NULL == base->messages_list_entry.next){
+	if(NULL == base->shards && NULL == base->messages_list_entry.next){
 		sha256_warning("No messages to be removed.");
 		return -1;	//No messages in the base
+	} else if(message->base != base){
+		//Every message knows the base it was registered on, so we don't need to look for it
+		sha256_warning("Message wasn't found.");
+		return -1;
 	} else {
-		struct sha256_message *entry, *tmp_entry; //tmp_entry for conversing the void * to a struct sha256_message *
-		//Get first message in the list
-		entry = base->messages_list_entry.next;
-
-		//Iterates through the entries looking for the one given (stops if the entry is found or
-		//if we reach the end of the list)
-		while((entry != message) && (NULL != entry)){
-			entry = entry->messages_list_entry.next;
+		//Removes the message and updates the linked list entries
+		if(base->shards){
+			sha256_shard_unlink(message, base);
+		} else {
+			sha256_message_unlink(message, &base->messages_list_entry);
 		}
 
-		//The entry wasn't found
-		if(NULL == entry){
-			sha256_warning("Message wasn't found.");
-			return -1;
-		} else {
-			//Removes the message and updates the linked list entries
-			//Messages is right after the sha256_base entry:
-			if(base == entry->messages_list_entry.prev){
-				base->messages_list_entry.next = entry->messages_list_entry.next;
-				if(NULL != entry->messages_list_entry.next){
-					tmp_entry = entry->messages_list_entry.next;
-					tmp_entry->messages_list_entry.prev = base;
-				}
-			} else {
-				if(NULL != entry->messages_list_entry.next){
-					tmp_entry = entry->messages_list_entry.prev;
-					tmp_entry->messages_list_entry.next = entry->messages_list_entry.next;
+		sha256_message_release(message, base);
+		return 0;
+	}
+}
 
-					tmp_entry = entry->messages_list_entry.next;
-					tmp_entry->messages_list_entry.prev = entry->messages_list_entry.prev;
-				} else {
-					tmp_entry = entry->messages_list_entry.prev;
-					tmp_entry->messages_list_entry.next = NULL;
-				}
-			}
+//Length in bits of the padded message: the message, the '1' bit and its length (64 bits, 128 for
+//SHA-512/256), rounded up to whole blocks (512 bits, 1024 for SHA-512/256)
+static uint64_t sha256_padded_bits_length(uint64_t bits_length, int algorithm){
+	uint64_t block_bits = 512, length_bits = 64;
 
-			//Free everything on the message entry
-			if(entry->msg){
-				free(entry->msg);
-			}
-			if(entry->preprocessed_msg){
-				free(entry->preprocessed_msg);
-			}
-			free(entry);
-			return 0;
-		}
+	if(SHA256_ALGORITHM_SHA512_256 == algorithm){
+		block_bits = 1024;
+		length_bits = 128;
 	}
+
+	return (bits_length + 1 + length_bits + block_bits - 1)/block_bits*block_bits;
 }
 
 //Pre-processes the message:
@@ -410,21 +456,32 @@ int sha256_message_delete(struct sha256_message *message, struct sha256_base *ba
 */
 //Returns 0 if it went OK, -1 if any error occurred
 int sha256_message_preprocess(struct sha256_message *message) {
+	SHA256_STATS_START(stats_start);
+
 	if(message->processed){
 		sha256_warning("Trying to pre-process a message already processed.");
+		return 0;
+	} else if(message->borrowed){
+		//Borrowed messages are never copied, the digest pads their last block on the fly
+		message->preprocessed_bits_length = sha256_padded_bits_length(message->bits_length, message->base->algorithm);
+
+		message->processed = 1;
+
+		SHA256_STATS_END(message->base, SHA256_PHASE_PAD, stats_start);
+
 		return 0;
 	} else {
 		//How much memory will we need for the preprocessed message?
-		//message + 1 bit + 64 bits
-		if( (message->bits_length + 65) % 512 ){
-			message->preprocessed_bits_length = ((message->bits_length + 65)/512 + 1)*512;
-		} else {
-			message->preprocessed_bits_length = (message->bits_length + 65);
-		}
+		//message + 1 bit + 64 bits (128 bits for SHA-512/256)
+		message->preprocessed_bits_length = sha256_padded_bits_length(message->bits_length, message->base->algorithm);
 
 		//Allocating the preprocessed_msg memory
 		//preprocessed_bits_length will always be divisable by 8, since it will be a multiple of 512
-		message->preprocessed_msg = malloc((size_t) (message->preprocessed_bits_length/8));
+		int from_arena;
+		message->preprocessed_msg = sha256_base_alloc(message->base, (size_t) (message->preprocessed_bits_length/8), &from_arena);
+		if(from_arena){
+			message->allocation |= SHA256_ARENA_PREPROCESSED;
+		}
 
 		//Error handling
 		if(NULL == message->preprocessed_msg){
@@ -457,7 +514,8 @@ int sha256_message_preprocess(struct sha256_message *message) {
 		//Switch the bit on
 		message->preprocessed_msg[append_byte] |= (1 << (7 - append_position % 8));
 
-		//Append the 64-bit message size in the end (big-endian)
+		//Append the 64-bit message size in the end (big-endian). SHA-512/256 has a 128-bit size, whose
+		//high 64 bits are left at 0.
 		uint64_t size_byte_pos = message->preprocessed_bits_length/8 - 8;
 
 		message->preprocessed_msg[size_byte_pos] = (message->bits_length >> 56) & 0xFF;
@@ -471,6 +529,8 @@ int sha256_message_preprocess(struct sha256_message *message) {
 
 		message->processed = 1;
 
+		SHA256_STATS_END(message->base, SHA256_PHASE_PAD, stats_start);
+
 		return 0;
 	}
 }
@@ -507,6 +567,88 @@ uint32_t sha256_logical_func6(uint32_t x){
 	return result;
 }
 
+//Portable block compression function
+//Compresses number_of_blocks consecutive 512-bit blocks into the given hash values. The blocks are
+//expected to be already padded, this function knows nothing about the message length.
+//All 64 rounds are unrolled with the working variables in locals (their names rotate instead of the
+//values moving), and the schedule is computed on the fly in a ring of 16 words instead of expanding
+//all 64 words first.
+void sha256_compress_blocks_scalar(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks){
+	//Schedule words 0-15 are the block's big-endian words, the next ones replace the word 16 rounds back
+#define SCALAR_LOAD(i) (w[i] = ((uint32_t) block[(i)*4] << 24) | ((uint32_t) block[(i)*4 + 1] << 16) \
+	| ((uint32_t) block[(i)*4 + 2] << 8) | (uint32_t) block[(i)*4 + 3])
+#define SCALAR_NEXT(i) (w[(i) & 15] += SHA256_LOWSIGMA1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] \
+	+ SHA256_LOWSIGMA0(w[((i) - 15) & 15]))
+#define SCALAR_LOAD_KW(i) (SCALAR_LOAD(i) + sha256_default_round_constants[i])
+#define SCALAR_NEXT_KW(i) (SCALAR_NEXT(i) + sha256_default_round_constants[i])
+
+	for(uint64_t chunk = 0; chunk < number_of_blocks; ++chunk){
+		const unsigned char *block = blocks + chunk*64;	//64 bytes per chunk (512 bits)
+		uint32_t w[16];
+		uint32_t a = hash_values[0], b = hash_values[1], c = hash_values[2], d = hash_values[3];
+		uint32_t e = hash_values[4], f = hash_values[5], g = hash_values[6], h = hash_values[7];
+
+		SHA256_ROUNDS_8(0, SCALAR_LOAD_KW);
+		SHA256_ROUNDS_8(8, SCALAR_LOAD_KW);
+		SHA256_ROUNDS_8(16, SCALAR_NEXT_KW);
+		SHA256_ROUNDS_8(24, SCALAR_NEXT_KW);
+		SHA256_ROUNDS_8(32, SCALAR_NEXT_KW);
+		SHA256_ROUNDS_8(40, SCALAR_NEXT_KW);
+		SHA256_ROUNDS_8(48, SCALAR_NEXT_KW);
+		SHA256_ROUNDS_8(56, SCALAR_NEXT_KW);
+
+		hash_values[0] += a;
+		hash_values[1] += b;
+		hash_values[2] += c;
+		hash_values[3] += d;
+		hash_values[4] += e;
+		hash_values[5] += f;
+		hash_values[6] += g;
+		hash_values[7] += h;
+	}
+
+#undef SCALAR_LOAD
+#undef SCALAR_NEXT
+#undef SCALAR_LOAD_KW
+#undef SCALAR_NEXT_KW
+}
+
+//Picks the fastest compression kernel the CPU supports on the first call
+static void sha256_compress_blocks_resolve(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks);
+
+//Threads may race to resolve it, they all store the same kernel
+static void (*sha256_compress_kernel)(uint32_t *, const unsigned char *, uint64_t) = sha256_compress_blocks_resolve;
+
+static void sha256_compress_blocks_resolve(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks){
+	void (*kernel)(uint32_t *, const unsigned char *, uint64_t) = sha256_compress_blocks_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if(sha256_cpu_features() & SHA256_CPU_SHANI){
+		kernel = sha256_compress_blocks_shani;
+	}
+#endif
+
+	__atomic_store_n(&sha256_compress_kernel, kernel, __ATOMIC_RELAXED);
+	kernel(hash_values, blocks, number_of_blocks);
+}
+
+//Block compression function
+//Every digest path goes through here, so all of them use the kernel picked for this CPU
+void sha256_compress_blocks(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks){
+	__atomic_load_n(&sha256_compress_kernel, __ATOMIC_RELAXED)(hash_values, blocks, number_of_blocks);
+}
+
+//Writes the hash values as the 32 bytes big-endian hash
+void sha256_hash_values_to_bytes(const uint32_t hash_values[8], unsigned char hash[32]){
+	for(int i = 0, hashindex = 0; i < 8; ++i){
+		hash[hashindex] = (hash_values[i] >> 24) & 0xFF;
+		hash[hashindex+1] = (hash_values[i] >> 16) & 0xFF;
+		hash[hashindex+2] = (hash_values[i] >> 8) & 0xFF;
+		hash[hashindex+3] = hash_values[i] & 0xFF;
+		hashindex += 4;
+	}
+}
+
 //Digest function
 void sha256_message_digest(struct sha256_message *message, struct sha256_base *base){
 	if(0 == message->processed){
@@ -515,7 +657,11 @@ void sha256_message_digest(struct sha256_message *message, struct sha256_base *b
 	} else if(message->digested){
 		sha256_warning("Message already digested.");
 		return;
+	} else if(SHA256_ALGORITHM_SHA512_256 == base->algorithm){
+		sha512_256_message_digest_batch(&message, 1);
 	} else {
+		SHA256_STATS_START(stats_start);
+
 		//Initialize current hash values
 		uint32_t digest_hash_values[8];
 
@@ -523,75 +669,255 @@ void sha256_message_digest(struct sha256_message *message, struct sha256_base *b
 			digest_hash_values[c] = base->HashValues[c];
 		}
 
-		//Message will be divided into 512 bit chunks
-		unsigned int number_of_chunks = message->preprocessed_bits_length/512;
+		//Message is compressed in 512 bit chunks
+		if(message->preprocessed_msg){
+			sha256_compress_blocks(digest_hash_values, message->preprocessed_msg, message->preprocessed_bits_length/512);
+		} else {
+			//Borrowed message: whole blocks straight from the caller's memory, padding only on the last one(s)
+			struct sha256_job job;
 
-		//For each chunk
-		for(unsigned int chunk = 0; chunk < number_of_chunks; ++chunk){
-			unsigned char *chunk_pointer;
-			chunk_pointer = message->preprocessed_msg;
-			chunk_pointer += chunk*64; //64 bytes per chunk (512 bits)
+			sha256_job_init(&job, digest_hash_values, message->msg, message->bits_length, 0);
+			sha256_compress_blocks(job.hash_values, job.blocks, job.number_of_blocks);
+			sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+			memcpy(digest_hash_values, job.hash_values, sizeof(digest_hash_values));
+		}
 
-			uint32_t message_schedule[64];
+		//Copy the hash reversing the endianness of each 32-bit piece, since we used
+		//little-endian and the algorithm requires big-endian values. Doesn't reverse the
+		//order if we are already using big-endian.
+		sha256_hash_values_to_bytes(digest_hash_values, message->hash);
 
-			//Copy the 32-bit pieces of the chunk in the message schedule little-endian (so we can use the processor
-			//arithmetics on it), or keep it big endian if the processor works with big endian memory layout.
-			unsigned char *message_byte = chunk_pointer;
-			for(int j = 0; j < 16; ++j){
-				message_schedule[j] = (((uint32_t) *(message_byte + 3)) << 0) | (((uint32_t) *(message_byte + 2)) << 8) | (((uint32_t) *(message_byte + 1)) << 16) | (((uint32_t) *(message_byte)) << 24);
-				message_byte += 4; //Advance 4 bytes
-			}
+		message->digested = 1;
 
-			//Expand the message blocks:
-			for(int j = 16; j < 64; ++j){
-				message_schedule[j] = sha256_logical_func6(message_schedule[j-2]) + message_schedule[j-7]
-					+ sha256_logical_func5(message_schedule[j-15]) + message_schedule[j-16];
-			}
+		SHA256_STATS_ADD(base, bytes_hashed, (message->bits_length + 7)/8);
+		SHA256_STATS_ADD(base, blocks_compressed, message->preprocessed_bits_length/512);
+		SHA256_STATS_END(base, SHA256_PHASE_COMPRESS, stats_start);
+	}
+}
 
-			uint32_t chunk_hash_values[8];
+static void sha256_message_digest_batch_from(struct sha256_message **messages, size_t count, const uint32_t hash_values[8], uint64_t prefix_length);
 
-			for(int n = 0; n < 8; ++n){
-				chunk_hash_values[n] = digest_hash_values[n];
-			}
+//Digests count messages at once using the multi-buffer engine. Messages already digested are skipped
+//and, unlike sha256_message_digest(), the messages don't need to be pre-processed (the engine pads the
+//last block itself, so not pre-processing them saves a copy of each message).
+void sha256_message_digest_batch(struct sha256_message **messages, size_t count, struct sha256_base *base){
+	if(SHA256_ALGORITHM_SHA512_256 == base->algorithm){
+		sha512_256_message_digest_batch(messages, count);
+		return;
+	}
+
+	sha256_message_digest_batch_from(messages, count, base->HashValues, 0);
+}
 
-			//Work the chunk hash values
-			for(int j = 0; j < 64; ++j){
-				uint32_t tmp1, tmp2;
-
-				tmp1 = chunk_hash_values[7] + sha256_logical_func4(chunk_hash_values[4])
-					+ sha256_logical_func1(chunk_hash_values[4], chunk_hash_values[5], chunk_hash_values[6])
-					+ base->RoundConstants[j] + message_schedule[j];
-				tmp2 = sha256_logical_func3(chunk_hash_values[0])
-					+ sha256_logical_func2(chunk_hash_values[0], chunk_hash_values[1], chunk_hash_values[2]);
-
-				chunk_hash_values[7] = chunk_hash_values[6];
-				chunk_hash_values[6] = chunk_hash_values[5];
-				chunk_hash_values[5] = chunk_hash_values[4];
-				chunk_hash_values[4] = chunk_hash_values[3] + tmp1;
-				chunk_hash_values[3] = chunk_hash_values[2];
-				chunk_hash_values[2] = chunk_hash_values[1];
-				chunk_hash_values[1] = chunk_hash_values[0];
-				chunk_hash_values[0] = tmp1 + tmp2;
+//Batch digest starting from the given hash values, prefix_length bytes being already compressed into them
+static void sha256_message_digest_batch_from(struct sha256_message **messages, size_t count, const uint32_t hash_values[8], uint64_t prefix_length){
+	struct sha256_job jobs[SHA256_BATCH_WINDOW];
+	struct sha256_message *window[SHA256_BATCH_WINDOW];
+	size_t index = 0;
+
+	while(index < count){
+		size_t jobs_count = 0;
+		SHA256_STATS_START(stats_start);
+
+		//Fill a window with messages that still need to be digested
+		while(index < count && jobs_count < SHA256_BATCH_WINDOW){
+			struct sha256_message *message = messages[index++];
+
+			if(message->digested){
+				continue;
 			}
 
-			for(int n = 0; n < 8; ++n){
-				digest_hash_values[n] += chunk_hash_values[n];
+			//The preprocessed message can only be used if it has the padding we need
+			if(message->processed && message->preprocessed_msg && 0 == prefix_length){
+				memcpy(jobs[jobs_count].hash_values, hash_values, sizeof(jobs[jobs_count].hash_values));
+				jobs[jobs_count].blocks = message->preprocessed_msg;
+				jobs[jobs_count].number_of_blocks = message->preprocessed_bits_length/512;
+				jobs[jobs_count].tail_blocks = 0;
+			} else {
+				sha256_job_init(&jobs[jobs_count], hash_values, message->msg, message->bits_length, prefix_length);
 			}
+
+			window[jobs_count++] = message;
 		}
 
-		//Copy the hash reversing the endianness of each 32-bit piece, since we used
-		//little-endian and the algorithm requires big-endian values. Doesn't reverse the
-		//order if we are already using big-endian.
-		for(int i = 0, hashindex = 0; i < 8; ++i){
-			message->hash[hashindex] = (digest_hash_values[i] >> 24) & 0xFF;
-			message->hash[hashindex+1] = (digest_hash_values[i] >> 16) & 0xFF;
-			message->hash[hashindex+2] = (digest_hash_values[i] >> 8) & 0xFF;
-			message->hash[hashindex+3] = digest_hash_values[i] & 0xFF;
-			hashindex += 4;
+		sha256_compress_jobs(jobs, jobs_count);
+
+		for(size_t c = 0; c < jobs_count; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, window[c]->hash);
+			window[c]->digested = 1;
+
+			SHA256_STATS_ADD(window[c]->base, bytes_hashed, (window[c]->bits_length + 7)/8);
+			SHA256_STATS_ADD(window[c]->base, blocks_compressed, jobs[c].number_of_blocks + jobs[c].tail_blocks);
 		}
 
-		message->digested = 1;
+		//The whole window counts as one call, on the base of its first message
+		if(jobs_count){
+			SHA256_STATS_END(window[0]->base, SHA256_PHASE_COMPRESS, stats_start);
+		}
+	}
+}
+
+//STREAMING API:
+//Initializes a streaming context, hashing with the base's algorithm. Nothing is allocated, the context
+//can live on the stack.
+void sha256_context_init(struct sha256_context *context, struct sha256_base *base){
+	memcpy(context->hash_values, base->HashValues, sizeof(context->hash_values));
+	context->buffered = 0;
+	context->length = 0;
+	context->algorithm = base->algorithm;
+
+	if(SHA256_ALGORITHM_SHA512_256 == base->algorithm){
+		memcpy(context->wide_hash_values, sha512_256_hash_values, sizeof(context->wide_hash_values));
+	}
+}
+
+//Feeds length bytes of data to the context. Whole blocks are compressed straight from the caller's
+//memory, only a partial block (less than 64 bytes) is kept in the context's buffer.
+void sha256_context_update(struct sha256_context *context, const void *data, size_t length){
+	const unsigned char *data_pointer = data;
+
+	if(SHA256_ALGORITHM_SHA512_256 == context->algorithm){
+		sha512_256_context_update(context, data, length);
+		return;
 	}
+
+	context->length += length;
+
+	//Complete the partial block from previous calls first
+	if(context->buffered){
+		size_t missing = 64 - context->buffered;
+
+		if(length < missing){
+			memcpy(context->buffer + context->buffered, data_pointer, length);
+			context->buffered += length;
+			return;
+		}
+
+		memcpy(context->buffer + context->buffered, data_pointer, missing);
+		sha256_compress_blocks(context->hash_values, context->buffer, 1);
+		context->buffered = 0;
+		data_pointer += missing;
+		length -= missing;
+	}
+
+	//Compress all whole blocks without copying them
+	if(length >= 64){
+		sha256_compress_blocks(context->hash_values, data_pointer, length/64);
+		data_pointer += length - length%64;
+		length %= 64;
+	}
+
+	//Keep the remaining bytes for the next call
+	if(length){
+		memcpy(context->buffer, data_pointer, length);
+		context->buffered = length;
+	}
+}
+
+//Pads the last block (or the last two, if the length doesn't fit in the first one) and writes the
+//final hash. The context must be initialized again before being reused.
+void sha256_context_final(struct sha256_context *context, unsigned char hash[32]){
+	uint64_t bits_length = context->length * 8;
+
+	if(SHA256_ALGORITHM_SHA512_256 == context->algorithm){
+		sha512_256_context_final(context, hash);
+		return;
+	}
+
+	//Append the '1' bit
+	context->buffer[context->buffered++] = 0x80;
+
+	//Not enough room for the 64-bit length, pad and compress this block and use another one
+	if(context->buffered > 56){
+		memset(context->buffer + context->buffered, 0, 64 - context->buffered);
+		sha256_compress_blocks(context->hash_values, context->buffer, 1);
+		context->buffered = 0;
+	}
+
+	memset(context->buffer + context->buffered, 0, 56 - context->buffered);
+
+	//Append the 64-bit message size in the end (big-endian)
+	for(int c = 0; c < 8; ++c){
+		context->buffer[56 + c] = (bits_length >> (56 - c*8)) & 0xFF;
+	}
+
+	sha256_compress_blocks(context->hash_values, context->buffer, 1);
+
+	sha256_hash_values_to_bytes(context->hash_values, hash);
+}
+
+//MIDSTATES:
+//Computes the midstate after compressing length bytes of prefix (a multiple of 64 bytes).
+//Returns 0 if it went OK, -1 if the length isn't a whole number of blocks (or the base isn't SHA-256).
+int sha256_midstate_compute(struct sha256_midstate *midstate, struct sha256_base *base, const void *prefix, uint64_t length){
+	if(SHA256_ALGORITHM_SHA256 != base->algorithm){
+		sha256_warning("Midstates are only supported by SHA-256.");
+		return -1;
+	}
+	if(length % 64){
+		sha256_warning("A midstate can only be computed after a whole number of 64 bytes blocks.");
+		return -1;
+	}
+
+	memcpy(midstate->hash_values, base->HashValues, sizeof(midstate->hash_values));
+	sha256_compress_blocks(midstate->hash_values, prefix, length/64);
+	midstate->length = length;
+
+	return 0;
+}
+
+//Saves the context state as a midstate. Returns 0 if it went OK, -1 if the context has a partial block
+//buffered (the length fed to it isn't a multiple of 64 bytes) or it isn't a SHA-256 context.
+int sha256_context_get_midstate(const struct sha256_context *context, struct sha256_midstate *midstate){
+	if(SHA256_ALGORITHM_SHA256 != context->algorithm){
+		sha256_warning("Midstates are only supported by SHA-256.");
+		return -1;
+	}
+	if(context->buffered){
+		sha256_warning("A midstate can only be saved after a whole number of 64 bytes blocks.");
+		return -1;
+	}
+
+	memcpy(midstate->hash_values, context->hash_values, sizeof(midstate->hash_values));
+	midstate->length = context->length;
+
+	return 0;
+}
+
+//Initializes a streaming context as if the midstate's prefix had already been fed to it
+void sha256_context_init_from_midstate(struct sha256_context *context, const struct sha256_midstate *midstate){
+	memcpy(context->hash_values, midstate->hash_values, sizeof(context->hash_values));
+	context->buffered = 0;
+	context->length = midstate->length;
+	context->algorithm = SHA256_ALGORITHM_SHA256;
+}
+
+//Digests the message as the suffix of the midstate's prefix: the hash stored in the message is the hash
+//of prefix + message. Only the message's own blocks are compressed.
+void sha256_message_digest_from_midstate(struct sha256_message *message, const struct sha256_midstate *midstate){
+	if(message->digested){
+		sha256_warning("Message already digested.");
+		return;
+	}
+
+	struct sha256_job job;
+	SHA256_STATS_START(stats_start);
+
+	sha256_job_init(&job, midstate->hash_values, message->msg, message->bits_length, midstate->length);
+	sha256_compress_blocks(job.hash_values, job.blocks, job.number_of_blocks);
+	sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+
+	sha256_hash_values_to_bytes(job.hash_values, message->hash);
+	message->digested = 1;
+
+	SHA256_STATS_ADD(message->base, bytes_hashed, (message->bits_length + 7)/8);
+	SHA256_STATS_ADD(message->base, blocks_compressed, job.number_of_blocks + job.tail_blocks);
+	SHA256_STATS_END(message->base, SHA256_PHASE_COMPRESS, stats_start);
+}
+
+//Batch version of sha256_message_digest_from_midstate(), using the multi-buffer engine
+void sha256_message_digest_batch_from_midstate(struct sha256_message **messages, size_t count, const struct sha256_midstate *midstate){
+	sha256_message_digest_batch_from(messages, count, midstate->hash_values, midstate->length);
 }
 
 //Print the hash in the screen in hexadecimal
@@ -618,6 +944,7 @@ void sha256_message_show_hash(struct sha256_message *message){
 //it with free();
 //The string will be returned with the hexadecimal representation in lower case letters.
 char *sha256_message_get_hash(struct sha256_message *message){
+	SHA256_STATS_START(stats_start);
 	char *returned_hash = malloc(65); //64 characters + null terminator
 
 	if(NULL == returned_hash){
@@ -633,7 +960,23 @@ char *sha256_message_get_hash(struct sha256_message *message){
 			snprintf(&returned_hash[c*2], (size_t) 3, "%02x", (unsigned int) message->hash[c]);
 		}
 
+		SHA256_STATS_END(message->base, SHA256_PHASE_FORMAT, stats_start);
+
 		return returned_hash;
 	}
 }
 
+//Writes the hash hexadecimal representation (lower case letters) and a null terminator to the given
+//array, without allocating anything.
+void sha256_message_get_hash_string(struct sha256_message *message, char hash_string[65]){
+	static const char hex_digits[] = "0123456789abcdef";
+	SHA256_STATS_START(stats_start);
+
+	for(int c = 0; c < 32; ++c){
+		hash_string[c*2] = hex_digits[message->hash[c] >> 4];
+		hash_string[c*2 + 1] = hex_digits[message->hash[c] & 0x0F];
+	}
+	hash_string[64] = '\0';
+
+	SHA256_STATS_END(message->base, SHA256_PHASE_FORMAT, stats_start);
+}
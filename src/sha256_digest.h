@@ -16,12 +16,106 @@
 #define RIGHTROTATE_32(x,y) (((x) >> (y)) | ((x) << (32 - (y))))
 #define LEFTROTATE_32(x,y) (((x) << (y)) | ((x) >> (32 - (y))))
 
+//Logical functions of the specification as macros, for the hot loops (same as sha256_logical_func1..6)
+#define SHA256_CH(x,y,z) (((x) & (y)) ^ (~(x) & (z)))
+#define SHA256_MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SHA256_SIGMA0(x) (RIGHTROTATE_32(x, 2) ^ RIGHTROTATE_32(x, 13) ^ RIGHTROTATE_32(x, 22))
+#define SHA256_SIGMA1(x) (RIGHTROTATE_32(x, 6) ^ RIGHTROTATE_32(x, 11) ^ RIGHTROTATE_32(x, 25))
+#define SHA256_LOWSIGMA0(x) (RIGHTROTATE_32(x, 7) ^ RIGHTROTATE_32(x, 18) ^ ((x) >> 3))
+#define SHA256_LOWSIGMA1(x) (RIGHTROTATE_32(x, 17) ^ RIGHTROTATE_32(x, 19) ^ ((x) >> 10))
+
+//One round with the schedule word (plus round constant) kw. Instead of shifting the 8 working variables,
+//only d and h are updated and the caller rotates the names: the next round is
+//SHA256_ROUND(h, a, b, c, d, e, f, g, ...), and after 8 rounds the names are back in place.
+#define SHA256_ROUND(a,b,c,d,e,f,g,h,kw) do{ \
+		uint32_t round_tmp = (h) + SHA256_SIGMA1(e) + SHA256_CH(e, f, g) + (kw); \
+		(d) += round_tmp; \
+		(h) = round_tmp + SHA256_SIGMA0(a) + SHA256_MAJ(a, b, c); \
+	} while(0)
+
+//8 rounds starting at round i, W(i) giving the schedule word plus round constant of round i
+#define SHA256_ROUNDS_8(i, W) \
+	SHA256_ROUND(a, b, c, d, e, f, g, h, W((i) + 0)); \
+	SHA256_ROUND(h, a, b, c, d, e, f, g, W((i) + 1)); \
+	SHA256_ROUND(g, h, a, b, c, d, e, f, W((i) + 2)); \
+	SHA256_ROUND(f, g, h, a, b, c, d, e, W((i) + 3)); \
+	SHA256_ROUND(e, f, g, h, a, b, c, d, W((i) + 4)); \
+	SHA256_ROUND(d, e, f, g, h, a, b, c, W((i) + 5)); \
+	SHA256_ROUND(c, d, e, f, g, h, a, b, W((i) + 6)); \
+	SHA256_ROUND(b, c, d, e, f, g, h, a, W((i) + 7))
+
+//Error and warning reporting, including the file name, function and line
+#define sha256_error(x) sha256_err(x, __FILE__, __func__, __LINE__)
+#define sha256_warning(x) sha256_warn(x, __FILE__, __func__, __LINE__)
+
+//Error codes for sha256_error()
+#define MALLOC_ERROR 1
+#define DIGEST_ERROR 2
+#define THREAD_ERROR 3
+
+//Terms of a schedule word W[j] (j >= 16) that depend on the nonce (struct sha256_nonce_search.terms)
+#define SHA256_NONCE_TERM_SIGMA1 0x01	//sigma1(W[j-2])
+#define SHA256_NONCE_TERM_W7 0x02	//W[j-7]
+#define SHA256_NONCE_TERM_SIGMA0 0x04	//sigma0(W[j-15])
+#define SHA256_NONCE_TERM_W16 0x08	//W[j-16]
+
+//Number of messages handed to the multi-buffer engine at once by sha256_message_digest_batch()
+#define SHA256_BATCH_WINDOW 64
+
+//Maximum number of lanes of any multi-buffer kernel
+#define SHA256_MB_MAX_LANES 16
+
+//Parts of a message allocated from the base's arena (sha256_message.allocation)
+#define SHA256_ARENA_STRUCT 0x01
+#define SHA256_ARENA_MSG 0x02
+#define SHA256_ARENA_PREPROCESSED 0x04
+
+//Maximum number of threads used to hash a level of a Merkle tree
+#define SHA256_MERKLE_MAX_THREADS 64
+
+//Instrumentation phases (see struct sha256_stats)
+#define SHA256_PHASE_CREATE 0	//sha256_message_create_*()
+#define SHA256_PHASE_PAD 1	//sha256_message_preprocess()
+#define SHA256_PHASE_COMPRESS 2	//sha256_message_digest*()
+#define SHA256_PHASE_FORMAT 3	//sha256_message_get_hash*()
+#define SHA256_PHASES 4
+
+//Latency histogram buckets, bucket b counts the calls that took [2^b, 2^(b+1)) ns (the last one also
+//counts anything longer)
+#define SHA256_STATS_BUCKETS 32
+
+//Instrumentation hooks. They only do something when the library is built with -DSHA256_STATS,
+//otherwise they compile to nothing. Counters are updated atomically, since the threads of
+//sha256_digest_pending() update the same base.
+#ifdef SHA256_STATS
+#define SHA256_STATS_ADD(base, field, n) __atomic_fetch_add(&(base)->stats.field, (uint64_t) (n), __ATOMIC_RELAXED)
+#define SHA256_STATS_START(start) uint64_t start = sha256_stats_now()
+#define SHA256_STATS_END(base, phase, start) sha256_stats_record(base, phase, start)
+#else
+#define SHA256_STATS_ADD(base, field, n) ((void) 0)
+#define SHA256_STATS_START(start)
+#define SHA256_STATS_END(base, phase, start) ((void) 0)
+#endif
+
+//CPU features with a dedicated compression kernel (see sha256_cpu_features())
+#define SHA256_CPU_SHANI 0x01
+#define SHA256_CPU_AVX2 0x02
+#define SHA256_CPU_AVX512 0x04
+
+//Hash algorithms a base can use (see sha256_base_set_algorithm()). Both give a 32 bytes hash.
+#define SHA256_ALGORITHM_SHA256 0
+#define SHA256_ALGORITHM_SHA512_256 1
+
 /*
 ==========================
 	STRUCTURES
 ==========================
 */
 
+struct sha256_arena;
+struct sha256_cache;
+struct sha256_shard;
+
 //Linked list implementation
 struct sha256_list{
 	void *prev;
@@ -40,17 +134,171 @@ struct sha256_message{
 
 	char processed;	//Was the message already processed? 1 = processed / 0 = not processed
 	char digested;	//Was the message already digested? 1 = digested / 0 = not digested
+	char borrowed;	//Does msg belong to the user? 1 = borrowed (not copied, not free'd) / 0 = owned
 
 	struct sha256_list messages_list_entry;	//Linked list reference
+	struct sha256_base *base;	//Base the message is registered on
+	unsigned int shard;	//Shard the message is registered on (shared bases only)
+	unsigned char allocation;	//Which parts of the message came from the base's arena (SHA256_ARENA_* flags)
+};
+
+//Hot path counters of a base (filled only when built with -DSHA256_STATS)
+struct sha256_stats{
+	uint64_t bytes_hashed;	//Message bytes digested
+	uint64_t blocks_compressed;	//512-bit blocks compressed, padding included
+	uint64_t allocations;	//Buffers allocated for the messages (arena or malloc())
+	uint64_t bytes_allocated;
+	uint64_t calls[SHA256_PHASES];	//Calls per phase (SHA256_PHASE_*)
+	uint64_t nanoseconds[SHA256_PHASES];	//Time spent per phase
+	uint64_t histogram[SHA256_PHASES][SHA256_STATS_BUCKETS];	//Latency of the calls per phase
+};
+
+//Digest cache statistics (see sha256_cache_get_stats())
+struct sha256_cache_stats{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t insertions;
+	uint64_t evictions;	//Entries dropped to make room for new ones
+	size_t entries;	//Entries in use
+	size_t capacity;	//Maximum number of entries
+	size_t bytes;	//Memory used by the entries and the table
 };
 
 //Main structure, containing some information needed for the digestion function
 struct sha256_base {
 	//Linked list entry to reference all messages added to this base structure
+	//(next points to the first message and prev to the last one)
 	struct sha256_list messages_list_entry;
 
-	uint32_t HashValues[8];
-	uint32_t RoundConstants[64];
+	//The library's read-only tables, shared by every base
+	const uint32_t *HashValues;
+	const uint32_t *RoundConstants;
+
+	struct sha256_arena *arena;	//Arena the messages are allocated from (NULL = malloc())
+	struct sha256_cache *cache;	//Digest cache (NULL = no cache)
+	struct sha256_shard *shards;	//Per-thread message lists (NULL = the base isn't shared)
+	int algorithm;	//SHA256_ALGORITHM_* of the base's messages and contexts
+
+#ifdef SHA256_STATS
+	struct sha256_stats stats;	//Instrumentation counters
+#endif
+};
+
+//Streaming context, used to digest a message in pieces without holding all of it in memory.
+//Only a partial block (less than 64 bytes) is ever buffered.
+struct sha256_context{
+	uint32_t hash_values[8];	//Current chaining values
+	unsigned char buffer[128];	//Partial block not compressed yet (64 bytes blocks, 128 for SHA-512/256)
+	size_t buffered;	//Number of bytes held in buffer
+	uint64_t length;	//Total number of bytes fed to the context
+	uint64_t wide_hash_values[8];	//Current chaining values of SHA-512/256
+	int algorithm;	//SHA256_ALGORITHM_*
+};
+
+//Chaining state after a whole number of blocks, used to start new hashes after a shared prefix
+struct sha256_midstate{
+	uint32_t hash_values[8];	//Chaining values after the prefix
+	uint64_t length;	//Length of the prefix in bytes (multiple of 64)
+};
+
+//HMAC-SHA256 key, with the midstates after the inner (key ^ ipad) and outer (key ^ opad) blocks
+struct sha256_hmac_key{
+	struct sha256_midstate inner;
+	struct sha256_midstate outer;
+};
+
+//Streaming HMAC-SHA256 context
+struct sha256_hmac_context{
+	struct sha256_context inner;	//Inner hash, started from the key's inner midstate
+	struct sha256_midstate outer;	//Key's outer midstate, used by sha256_hmac_final()
+};
+
+//HMAC chains run side by side by the multi-buffer engine (PBKDF2), transposed: [word][lane]
+struct sha256_hmac_lanes{
+	uint32_t inner[8][SHA256_MB_MAX_LANES];	//Inner midstate of each lane's key
+	uint32_t outer[8][SHA256_MB_MAX_LANES];	//Outer midstate of each lane's key
+	uint32_t u[8][SHA256_MB_MAX_LANES];	//Last HMAC of the chain
+	uint32_t t[8][SHA256_MB_MAX_LANES];	//Xor of all the HMACs of the chain
+};
+
+//One PBKDF2-HMAC-SHA256 derivation of sha256_pbkdf2_batch()
+struct sha256_pbkdf2_job{
+	const void *password;
+	size_t password_length;
+	const void *salt;
+	size_t salt_length;
+	uint64_t iterations;
+	unsigned char *key;	//Derived key (output)
+	size_t key_length;
+};
+
+//Nonce search (proof of work): template and range of sha256_nonce_search()
+struct sha256_nonce_config{
+	unsigned char header[80];	//Template, its nonce bytes are ignored
+	size_t nonce_offset;	//Offset of the 32-bit little-endian nonce in the second block: 64, 68, 72 or 76
+	unsigned char target[32];	//A hash is accepted if it's <= target, both read as big-endian numbers
+	int double_hash;	//1 = the hash is SHA-256 of the SHA-256 (sha256d), 0 = SHA-256
+	uint32_t first_nonce;	//First nonce to try
+	uint64_t nonce_count;	//Number of nonces to try (first_nonce + nonce_count <= 2^32)
+	unsigned int thread_count;	//0 = one per online CPU
+};
+
+//Outcome of sha256_nonce_search()
+struct sha256_nonce_result{
+	uint32_t nonce;	//Lowest accepted nonce of the range
+	unsigned char hash[32];	//Its hash
+	uint64_t hashes;	//Nonces tried
+	uint64_t nanoseconds;	//Time spent searching
+};
+
+//Nonce search state precomputed from the template: everything of the second block that doesn't
+//depend on the nonce
+struct sha256_nonce_search{
+	uint32_t midstate[8];	//Chaining values after the first block
+	uint32_t state[8];	//Working variables (a to h) before the round of the nonce word
+	unsigned char block[64];	//Second block, padded (with a nonce of 0)
+	uint32_t fixed_kw[64];	//K[j] + W[j] of the schedule words that don't depend on the nonce
+	uint32_t partial[64];	//Part of the words that depend on it made of terms that don't
+	unsigned char terms[64];	//Terms of W[j] that depend on the nonce (SHA256_NONCE_TERM_*), 0 = none
+	unsigned int nonce_word;	//Index of the nonce in the words of the second block (0 to 3)
+	uint32_t target_word;	//First word of the target: hashes with a larger first word are rejected
+	int double_hash;
+};
+
+//Merkle tree options
+struct sha256_merkle_config{
+	int domain_separation;	//1 = prefix leaves with leaf_prefix and nodes with node_prefix before hashing
+	unsigned char leaf_prefix;
+	unsigned char node_prefix;
+	unsigned int thread_count;	//Threads hashing each level (0 = one per online CPU)
+};
+
+//Inclusion proof to be checked by sha256_merkle_verify_batch()
+struct sha256_merkle_check{
+	const unsigned char *leaf;	//Leaf data
+	size_t index;	//Position of the leaf
+	const unsigned char (*proof)[32];	//Sibling hashes, bottom up
+	size_t proof_length;
+	int valid;	//Result: 1 = the proof leads to the root / 0 = it doesn't
+};
+
+//Compression job, the unit of work of the multi-buffer engine (see sha256_compress_jobs()).
+//Whole blocks are read straight from the caller's memory, only the padded last block(s) live in the job.
+struct sha256_job{
+	uint32_t hash_values[8];	//Starting chaining values, replaced by the final ones after compression
+	const unsigned char *blocks;	//Whole blocks to compress first
+	uint64_t number_of_blocks;	//Number of blocks pointed by blocks
+	unsigned char tail[128];	//Padded last block(s), compressed after the whole blocks
+	unsigned int tail_blocks;	//Number of blocks in tail (0, 1 or 2)
+};
+
+//SHA-512 compression job, the same as struct sha256_job with 64-bit words and 128 bytes blocks
+struct sha512_job{
+	uint64_t hash_values[8];
+	const unsigned char *blocks;
+	uint64_t number_of_blocks;
+	unsigned char tail[256];
+	unsigned int tail_blocks;
 };
 
 /*
@@ -64,7 +312,8 @@ void sha256_warn(const char *warning_msg, const char *file_name, const char *fun
 struct sha256_base *sha256_init();
 void sha256_free(struct sha256_base *base);
 struct sha256_message *sha256_message_create_from_string(const char *string, struct sha256_base *base);
-struct sha256_message *sha256_message_create_from_buffer(const char *buffer, unsigned int bits_length, struct sha256_base *base);
+struct sha256_message *sha256_message_create_from_buffer(const char *buffer, uint64_t bits_length, struct sha256_base *base);
+struct sha256_message *sha256_message_create_borrowed(const void *buffer, uint64_t bits_length, struct sha256_base *base);
 int sha256_message_delete(struct sha256_message *message, struct sha256_base *base);
 int sha256_message_preprocess(struct sha256_message *message);
 void sha256_message_show(struct sha256_message *message);
@@ -78,13 +327,157 @@ uint32_t sha256_logical_func4(uint32_t x);
 uint32_t sha256_logical_func5(uint32_t x);
 uint32_t sha256_logical_func6(uint32_t x);
 
+//Default hash values and round constants from the specification
+extern const uint32_t sha256_default_hash_values[8];
+extern const uint32_t sha256_default_round_constants[64];
+
+//Block compression function, shared by all digest paths. It dispatches to one of the kernels
+//below depending on the features of the CPU.
+void sha256_compress_blocks(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks);
+void sha256_compress_blocks_scalar(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks);
+void sha256_compress_prescheduled_scalar(uint32_t hash_values[8], const uint32_t schedule[64]);
+#if defined(__x86_64__) || defined(__i386__)
+void sha256_compress_blocks_shani(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks);
+void sha256_compress_prescheduled_shani(uint32_t hash_values[8], const uint32_t schedule[64]);
+void sha256_hmac_chain_shani(const struct sha256_hmac_key *key, uint32_t u[8], uint32_t t[8], uint64_t iterations);
+#endif
+unsigned int sha256_cpu_features(void);
+void sha256_hash_values_to_bytes(const uint32_t hash_values[8], unsigned char hash[32]);
+
 //Digest function
 void sha256_message_digest(struct sha256_message *message, struct sha256_base *base);
 
+//Multi-buffer engine and batch digest
+void sha256_job_init(struct sha256_job *job, const uint32_t hash_values[8], const void *data, uint64_t bits_length, uint64_t prefix_length);
+void sha256_compress_jobs(struct sha256_job *jobs, size_t count);
+void sha256_compress_jobs_lanes(struct sha256_job *jobs, size_t count, unsigned int lanes);
+void sha256_message_digest_batch(struct sha256_message **messages, size_t count, struct sha256_base *base);
+
+//Multi-threaded digest of all pending messages of a base
+long sha256_digest_pending(struct sha256_base *base, unsigned int thread_count);
+
+//Streaming API (init/update/final)
+void sha256_context_init(struct sha256_context *context, struct sha256_base *base);
+void sha256_context_update(struct sha256_context *context, const void *data, size_t length);
+void sha256_context_final(struct sha256_context *context, unsigned char hash[32]);
+
+//Midstates (shared prefixes)
+int sha256_midstate_compute(struct sha256_midstate *midstate, struct sha256_base *base, const void *prefix, uint64_t length);
+int sha256_context_get_midstate(const struct sha256_context *context, struct sha256_midstate *midstate);
+void sha256_context_init_from_midstate(struct sha256_context *context, const struct sha256_midstate *midstate);
+void sha256_message_digest_from_midstate(struct sha256_message *message, const struct sha256_midstate *midstate);
+void sha256_message_digest_batch_from_midstate(struct sha256_message **messages, size_t count, const struct sha256_midstate *midstate);
+
+//Fixed-length fast paths, one-shot and double SHA-256
+void sha256_32(const unsigned char input[32], unsigned char hash[32]);
+void sha256_64(const unsigned char input[64], unsigned char hash[32]);
+void sha256_80(const unsigned char input[80], unsigned char hash[32]);
+void sha256d_64(const unsigned char input[64], unsigned char hash[32]);
+void sha256d_80(const unsigned char input[80], unsigned char hash[32]);
+void sha256d(const void *data, size_t length, unsigned char hash[32]);
+void sha256(const void *data, size_t length, unsigned char hash[32]);
+
+//Merkle trees
+size_t sha256_merkle_tree_size(size_t leaf_count);
+unsigned int sha256_merkle_levels(size_t leaf_count);
+int sha256_merkle_build(const unsigned char *leaves, size_t leaf_size, size_t leaf_count, const struct sha256_merkle_config *config,
+	unsigned char (*tree)[32], unsigned char root[32]);
+size_t sha256_merkle_proof(const unsigned char (*tree)[32], size_t leaf_count, size_t index, unsigned char (*proof)[32]);
+int sha256_merkle_verify(const unsigned char *leaf, size_t leaf_size, size_t index, size_t leaf_count, const unsigned char (*proof)[32],
+	size_t proof_length, const struct sha256_merkle_config *config, const unsigned char root[32]);
+size_t sha256_merkle_verify_batch(struct sha256_merkle_check *checks, size_t count, size_t leaf_size, size_t leaf_count,
+	const struct sha256_merkle_config *config, const unsigned char root[32]);
+
+//Chunked tree-hash mode (not compatible with SHA-256)
+size_t sha256_tree_chunk_count(uint64_t length, size_t chunk_size);
+int sha256_tree_digest(const void *data, uint64_t length, size_t chunk_size, unsigned int thread_count, unsigned char (*manifest)[32],
+	unsigned char root[32]);
+int sha256_tree_root(const unsigned char (*manifest)[32], uint64_t length, size_t chunk_size, unsigned int thread_count, unsigned char root[32]);
+long sha256_tree_verify_range(const void *data, uint64_t offset, uint64_t range_length, uint64_t length, size_t chunk_size,
+	const unsigned char (*manifest)[32]);
+
+//HMAC-SHA256 (one-shot, streaming and batch)
+void sha256_hmac_key_init(struct sha256_hmac_key *key, const void *key_data, size_t key_length);
+void sha256_hmac(const struct sha256_hmac_key *key, const void *data, size_t length, unsigned char mac[32]);
+void sha256_hmac_init(struct sha256_hmac_context *context, const struct sha256_hmac_key *key);
+void sha256_hmac_update(struct sha256_hmac_context *context, const void *data, size_t length);
+void sha256_hmac_final(struct sha256_hmac_context *context, unsigned char mac[32]);
+void sha256_hmac_batch(const struct sha256_hmac_key *key, const void *const *data, const size_t *lengths, size_t count, unsigned char (*macs)[32]);
+int sha256_hmac_chain_lanes(struct sha256_hmac_lanes *lanes, unsigned int width, uint64_t iterations);
+void sha256_wipe(void *pointer, size_t length);
+
+//Nonce search
+int sha256_nonce_search(const struct sha256_nonce_config *config, struct sha256_nonce_result *result);
+int sha256_nonce_search_lanes(const struct sha256_nonce_config *config, struct sha256_nonce_result *result, unsigned int lanes);
+int sha256_nonce_prepare(struct sha256_nonce_search *search, const struct sha256_nonce_config *config);
+uint64_t sha256_nonce_scan_lanes(const struct sha256_nonce_search *search, uint32_t first_nonce, uint64_t count, unsigned int width,
+	uint32_t *candidates);
+
+//PBKDF2-HMAC-SHA256
+int sha256_pbkdf2(const void *password, size_t password_length, const void *salt, size_t salt_length, uint64_t iterations,
+	unsigned char *key, size_t key_length);
+int sha256_pbkdf2_batch(struct sha256_pbkdf2_job *jobs, size_t count);
+int sha256_pbkdf2_lanes(struct sha256_pbkdf2_job *jobs, size_t count, unsigned int lanes);
+
+//File hashing (memory-mapped)
+int sha256_file_digest(const char *path, unsigned char hash[32]);
+int sha256_fd_digest(int fd, unsigned char hash[32]);
+
 //Print hash in the screen
 void sha256_message_show_hash(struct sha256_message *message);
 
 //Returns the hash to a mallocated string and returns the pointer to it
 char *sha256_message_get_hash(struct sha256_message *message);
+//Writes the hash string to the caller's memory
+void sha256_message_get_hash_string(struct sha256_message *message, char hash_string[65]);
+
+//Instrumentation counters
+int sha256_stats_snapshot(struct sha256_base *base, struct sha256_stats *stats);
+void sha256_stats_reset(struct sha256_base *base);
+uint64_t sha256_stats_now(void);
+void sha256_stats_record(struct sha256_base *base, unsigned int phase, uint64_t start);
+
+//Digest cache owned by a base
+int sha256_cache_enable(struct sha256_base *base, size_t max_bytes);
+int sha256_cache_lookup(struct sha256_base *base, uint64_t identity, uint64_t bits_length, uint64_t tag, unsigned char hash[32]);
+void sha256_cache_store(struct sha256_base *base, uint64_t identity, uint64_t bits_length, uint64_t tag, const unsigned char hash[32]);
+int sha256_message_digest_cached(struct sha256_message *message, uint64_t identity, uint64_t tag);
+uint64_t sha256_cache_fingerprint(const void *data, size_t length);
+int sha256_cache_get_stats(struct sha256_base *base, struct sha256_cache_stats *stats);
+void sha256_cache_clear(struct sha256_base *base);
+void sha256_cache_destroy(struct sha256_base *base);
+
+//Arena allocator owned by a base
+int sha256_arena_enable(struct sha256_base *base, size_t chunk_size);
+void sha256_arena_reset(struct sha256_base *base);
+void sha256_arena_destroy(struct sha256_base *base);
+void *sha256_base_alloc(struct sha256_base *base, size_t size, int *from_arena);
+void sha256_base_dealloc(struct sha256_base *base, void *pointer, int from_arena);
+struct sha256_message *sha256_base_alloc_message(struct sha256_base *base);
+void sha256_base_dealloc_message(struct sha256_base *base, struct sha256_message *message);
+void sha256_message_release(struct sha256_message *message, struct sha256_base *base);
+void sha256_message_link(struct sha256_message *message, struct sha256_list *list);
+void sha256_message_unlink(struct sha256_message *message, struct sha256_list *list);
+
+//SHA-512 core and SHA-512/256
+extern const uint64_t sha512_round_constants[80];
+extern const uint64_t sha512_256_hash_values[8];
+int sha256_base_set_algorithm(struct sha256_base *base, int algorithm);
+void sha512_256(const void *data, size_t length, unsigned char hash[32]);
+void sha512_compress_blocks(uint64_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks);
+void sha512_job_init(struct sha512_job *job, const uint64_t hash_values[8], const void *data, uint64_t bits_length);
+void sha512_compress_jobs(struct sha512_job *jobs, size_t count);
+void sha512_compress_jobs_lanes(struct sha512_job *jobs, size_t count, unsigned int lanes);
+void sha512_256_hash_values_to_bytes(const uint64_t hash_values[8], unsigned char hash[32]);
+void sha512_256_message_digest_batch(struct sha256_message **messages, size_t count);
+void sha512_256_context_update(struct sha256_context *context, const void *data, size_t length);
+void sha512_256_context_final(struct sha256_context *context, unsigned char hash[32]);
+
+//Bases shared between threads
+int sha256_base_share(struct sha256_base *base);
+struct sha256_list *sha256_base_list(struct sha256_base *base, unsigned int index);
+void sha256_shard_register(struct sha256_message *message, struct sha256_base *base);
+void sha256_shard_unlink(struct sha256_message *message, struct sha256_base *base);
+void sha256_shard_destroy(struct sha256_base *base);
 
 #endif
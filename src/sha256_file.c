@@ -0,0 +1,147 @@
+#include "sha256_digest.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//File hashing. Regular files are mapped and their pages are compressed straight from the mapping, only
+//the padded last block(s) are built in memory. Anything that can't be mapped (pipes, empty-looking
+//files like the ones in /proc, mmap() failures) is read in big pieces through a streaming context.
+
+//Blocks compressed between read-ahead hints (8MB)
+#define SHA256_FILE_WINDOW_BLOCKS (8*1024*1024/64)
+//Read size of the fallback path
+#define SHA256_FILE_READ_SIZE (1 << 20)
+
+//Streams the rest of fd through a context. Returns 0 if it went OK, -1 otherwise.
+static int sha256_fd_digest_read(int fd, uint32_t hash_values[8], unsigned char hash[32]){
+	struct sha256_midstate start;
+	struct sha256_context context;
+	unsigned char *buffer = malloc(SHA256_FILE_READ_SIZE);
+
+	if(NULL == buffer){
+		sha256_error(MALLOC_ERROR);
+		return -1;
+	}
+
+	memcpy(start.hash_values, hash_values, sizeof(start.hash_values));
+	start.length = 0;
+	sha256_context_init_from_midstate(&context, &start);
+
+	for(;;){
+		ssize_t length = read(fd, buffer, SHA256_FILE_READ_SIZE);
+
+		if(length < 0){
+			if(EINTR == errno){
+				continue;
+			}
+			sha256_warning(strerror(errno));
+			free(buffer);
+			return -1;
+		}
+		if(0 == length){
+			break;
+		}
+		sha256_context_update(&context, buffer, (size_t) length);
+	}
+
+	sha256_context_final(&context, hash);
+	free(buffer);
+
+	return 0;
+}
+
+//Hashes everything from the current position of fd to its end.
+//Returns 0 if it went OK, -1 otherwise.
+int sha256_fd_digest(int fd, unsigned char hash[32]){
+	uint32_t hash_values[8];
+	struct stat st;
+	struct sha256_job job;
+
+	memcpy(hash_values, sha256_default_hash_values, sizeof(hash_values));
+
+	if(fstat(fd, &st)){
+		sha256_warning(strerror(errno));
+		return -1;
+	}
+
+	off_t offset = lseek(fd, 0, SEEK_CUR);
+	if(!S_ISREG(st.st_mode) || offset < 0 || st.st_size <= offset){
+		return sha256_fd_digest_read(fd, hash_values, hash);
+	}
+
+	uint64_t length = (uint64_t) (st.st_size - offset);
+	if(length > SIZE_MAX){
+		return sha256_fd_digest_read(fd, hash_values, hash);
+	}
+
+	//The mapping must start on a page boundary
+	long page_size = sysconf(_SC_PAGESIZE);
+	off_t map_offset = page_size > 0 ? offset - offset % page_size : 0;
+	size_t map_length = (size_t) (length + (uint64_t) (offset - map_offset));
+	unsigned char *map = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, map_offset);
+
+	if(MAP_FAILED == map){
+		return sha256_fd_digest_read(fd, hash_values, hash);
+	}
+
+	madvise(map, map_length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(map, map_length, MADV_HUGEPAGE);
+#endif
+
+	const unsigned char *data = map + (offset - map_offset);
+	uint64_t blocks = length/64;
+	uintptr_t dropped = (uintptr_t) map;	//Pages before this one were already dropped
+
+	//Window by window, asking for the next one to be read ahead and dropping the pages already hashed so
+	//a huge file doesn't stay mapped in memory
+	for(uint64_t done = 0; done < blocks; ){
+		uint64_t window = blocks - done < SHA256_FILE_WINDOW_BLOCKS ? blocks - done : SHA256_FILE_WINDOW_BLOCKS;
+		const unsigned char *current = data + done*64;
+
+		if(done + window < blocks){
+			uint64_t next = blocks - done - window < SHA256_FILE_WINDOW_BLOCKS ? blocks - done - window : SHA256_FILE_WINDOW_BLOCKS;
+			uintptr_t start = (uintptr_t) (current + window*64) & ~((uintptr_t) page_size - 1);
+
+			madvise((void *) start, (size_t) ((uintptr_t) (current + (window + next)*64) - start), MADV_WILLNEED);
+		}
+
+		sha256_compress_blocks(hash_values, current, window);
+		done += window;
+
+		uintptr_t end = (uintptr_t) (data + done*64) & ~((uintptr_t) page_size - 1);
+		if(end > dropped){
+			madvise((void *) dropped, (size_t) (end - dropped), MADV_DONTNEED);
+			dropped = end;
+		}
+	}
+
+	//Only the padded tail is built in memory
+	sha256_job_init(&job, hash_values, data + blocks*64, (length % 64)*8, blocks*64);
+	sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+	sha256_hash_values_to_bytes(job.hash_values, hash);
+
+	munmap(map, map_length);
+
+	//Leave fd at the end, like the read path does
+	lseek(fd, 0, SEEK_END);
+
+	return 0;
+}
+
+//Hashes the file at path. Returns 0 if it went OK, -1 otherwise.
+int sha256_file_digest(const char *path, unsigned char hash[32]){
+	int fd = open(path, O_RDONLY);
+
+	if(fd < 0){
+		sha256_warning(strerror(errno));
+		return -1;
+	}
+
+	int result = sha256_fd_digest(fd, hash);
+	close(fd);
+
+	return result;
+}
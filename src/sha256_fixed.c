@@ -0,0 +1,165 @@
+#include "sha256_digest.h"
+
+//Fast paths for fixed-length inputs (32, 64 and 80 bytes), plus one-shot and double SHA-256 of any
+//buffer. The padding of the fixed lengths is known at compile time, so their padded blocks are built on
+//the stack from constant templates, and the padding block of a 64 bytes input (which doesn't depend on
+//the input at all) has its whole message schedule precomputed. Nothing is allocated.
+
+//Message schedule (W[j] + K[j]) of the padding block of a 64 bytes message: '1' bit, zeros and a
+//length of 512 bits.
+static const uint32_t sha256_padding64_schedule[64] = {
+	0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+	0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+	0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+	0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+	0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+	0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+	0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76};
+
+//Padding of a 32 bytes message (second half of its only block): '1' bit, zeros and a length of 256 bits
+static const unsigned char sha256_padding32[32] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x00};
+
+//Padding of an 80 bytes message (last 48 bytes of its second block): '1' bit, zeros and a length of 640 bits
+static const unsigned char sha256_padding80[48] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x80};
+
+//Compresses a block whose schedule (W[j] + K[j]) was already computed
+void sha256_compress_prescheduled_scalar(uint32_t hash_values[8], const uint32_t schedule[64]){
+	uint32_t a = hash_values[0], b = hash_values[1], c = hash_values[2], d = hash_values[3];
+	uint32_t e = hash_values[4], f = hash_values[5], g = hash_values[6], h = hash_values[7];
+
+#define PRESCHEDULED_KW(i) (schedule[i])
+	SHA256_ROUNDS_8(0, PRESCHEDULED_KW);
+	SHA256_ROUNDS_8(8, PRESCHEDULED_KW);
+	SHA256_ROUNDS_8(16, PRESCHEDULED_KW);
+	SHA256_ROUNDS_8(24, PRESCHEDULED_KW);
+	SHA256_ROUNDS_8(32, PRESCHEDULED_KW);
+	SHA256_ROUNDS_8(40, PRESCHEDULED_KW);
+	SHA256_ROUNDS_8(48, PRESCHEDULED_KW);
+	SHA256_ROUNDS_8(56, PRESCHEDULED_KW);
+#undef PRESCHEDULED_KW
+
+	hash_values[0] += a;
+	hash_values[1] += b;
+	hash_values[2] += c;
+	hash_values[3] += d;
+	hash_values[4] += e;
+	hash_values[5] += f;
+	hash_values[6] += g;
+	hash_values[7] += h;
+}
+
+static void sha256_compress_prescheduled(uint32_t hash_values[8], const uint32_t schedule[64]){
+#if defined(__x86_64__) || defined(__i386__)
+	if(sha256_cpu_features() & SHA256_CPU_SHANI){
+		sha256_compress_prescheduled_shani(hash_values, schedule);
+		return;
+	}
+#endif
+	sha256_compress_prescheduled_scalar(hash_values, schedule);
+}
+
+//SHA-256 of a 32 bytes input (i.e.: a hash, for hash chains)
+void sha256_32(const unsigned char input[32], unsigned char hash[32]){
+	uint32_t hash_values[8];
+	unsigned char block[64];
+
+	memcpy(block, input, 32);
+	memcpy(block + 32, sha256_padding32, 32);
+
+	memcpy(hash_values, sha256_default_hash_values, sizeof(hash_values));
+	sha256_compress_blocks(hash_values, block, 1);
+	sha256_hash_values_to_bytes(hash_values, hash);
+}
+
+//SHA-256 of a 64 bytes input (i.e.: two hashes, for Merkle tree nodes)
+void sha256_64(const unsigned char input[64], unsigned char hash[32]){
+	uint32_t hash_values[8];
+
+	memcpy(hash_values, sha256_default_hash_values, sizeof(hash_values));
+	sha256_compress_blocks(hash_values, input, 1);
+	sha256_compress_prescheduled(hash_values, sha256_padding64_schedule);
+	sha256_hash_values_to_bytes(hash_values, hash);
+}
+
+//SHA-256 of an 80 bytes input (i.e.: block headers)
+void sha256_80(const unsigned char input[80], unsigned char hash[32]){
+	uint32_t hash_values[8];
+	unsigned char block[64];
+
+	memcpy(block, input + 64, 16);
+	memcpy(block + 16, sha256_padding80, 48);
+
+	memcpy(hash_values, sha256_default_hash_values, sizeof(hash_values));
+	sha256_compress_blocks(hash_values, input, 1);
+	sha256_compress_blocks(hash_values, block, 1);
+	sha256_hash_values_to_bytes(hash_values, hash);
+}
+
+//Double SHA-256 (SHA-256 of the SHA-256) of a 64 bytes input
+void sha256d_64(const unsigned char input[64], unsigned char hash[32]){
+	unsigned char first_hash[32];
+
+	sha256_64(input, first_hash);
+	sha256_32(first_hash, hash);
+}
+
+//Double SHA-256 of an 80 bytes input
+void sha256d_80(const unsigned char input[80], unsigned char hash[32]){
+	unsigned char first_hash[32];
+
+	sha256_80(input, first_hash);
+	sha256_32(first_hash, hash);
+}
+
+//SHA-256 of length bytes of data, written to hash. No base, no message: the whole blocks are compressed
+//straight from data and only the padded last block(s) are built on the stack.
+void sha256(const void *data, size_t length, unsigned char hash[32]){
+	const unsigned char *bytes = data;
+	uint32_t hash_values[8];
+	unsigned char tail[128];
+	size_t whole_blocks = length/64, remaining = length%64;
+	size_t tail_length = remaining < 56 ? 64 : 128;
+	uint64_t bits_length = (uint64_t) length*8;
+
+	//The lengths with a fast path of their own
+	switch(length){
+		case 32:
+			sha256_32(bytes, hash);
+			return;
+		case 64:
+			sha256_64(bytes, hash);
+			return;
+		case 80:
+			sha256_80(bytes, hash);
+			return;
+	}
+
+	memcpy(hash_values, sha256_default_hash_values, sizeof(hash_values));
+	if(whole_blocks){
+		sha256_compress_blocks(hash_values, bytes, whole_blocks);
+	}
+
+	//Last bytes, '1' bit, zeros and the length in bits (big-endian). data may be NULL when length is 0.
+	if(remaining){
+		memcpy(tail, bytes + whole_blocks*64, remaining);
+	}
+	tail[remaining] = 0x80;
+	memset(tail + remaining + 1, 0, tail_length - 8 - remaining - 1);
+	for(int c = 0; c < 8; ++c){
+		tail[tail_length - 8 + c] = (bits_length >> (56 - c*8)) & 0xFF;
+	}
+
+	sha256_compress_blocks(hash_values, tail, tail_length/64);
+	sha256_hash_values_to_bytes(hash_values, hash);
+}
+
+//Double SHA-256 of length bytes of data
+void sha256d(const void *data, size_t length, unsigned char hash[32]){
+	unsigned char first_hash[32];
+
+	sha256(data, length, first_hash);
+	sha256_32(first_hash, hash);
+}
@@ -0,0 +1,123 @@
+#include "sha256_digest.h"
+
+//HMAC-SHA256 (RFC 2104) on top of the compression function. The key's inner (key ^ ipad) and outer
+//(key ^ opad) blocks are compressed once, when the key is set, so each MAC only compresses the
+//message blocks plus one outer block.
+
+//Zeroes length bytes of secret data. The stores go through a volatile pointer, so the compiler can't
+//drop them even when the memory is never read again (a plain memset() of a dying buffer is dead code).
+void sha256_wipe(void *pointer, size_t length){
+	volatile unsigned char *bytes = pointer;
+
+	while(length--){
+		*bytes++ = 0;
+	}
+}
+
+//Sets the key, precomputing the inner and outer midstates
+void sha256_hmac_key_init(struct sha256_hmac_key *key, const void *key_data, size_t key_length){
+	unsigned char block[64];
+	unsigned char pad[64];
+
+	memset(block, 0, sizeof(block));
+
+	//Keys longer than a block are hashed first
+	if(key_length > 64){
+		struct sha256_midstate start = {{0}, 0};
+		struct sha256_context context;
+
+		memcpy(start.hash_values, sha256_default_hash_values, sizeof(start.hash_values));
+		sha256_context_init_from_midstate(&context, &start);
+		sha256_context_update(&context, key_data, key_length);
+		sha256_context_final(&context, block);
+		sha256_wipe(&context, sizeof(context));
+	} else if(key_length > 0){
+		memcpy(block, key_data, key_length);
+	}
+
+	for(int c = 0; c < 64; ++c){
+		pad[c] = block[c] ^ 0x36;
+	}
+	memcpy(key->inner.hash_values, sha256_default_hash_values, sizeof(key->inner.hash_values));
+	sha256_compress_blocks(key->inner.hash_values, pad, 1);
+	key->inner.length = 64;
+
+	for(int c = 0; c < 64; ++c){
+		pad[c] = block[c] ^ 0x5c;
+	}
+	memcpy(key->outer.hash_values, sha256_default_hash_values, sizeof(key->outer.hash_values));
+	sha256_compress_blocks(key->outer.hash_values, pad, 1);
+	key->outer.length = 64;
+
+	//Don't leave key material on the stack
+	sha256_wipe(block, sizeof(block));
+	sha256_wipe(pad, sizeof(pad));
+}
+
+//Outer hash: one block with the inner hash, starting from the outer midstate
+static void sha256_hmac_outer(const struct sha256_hmac_key *key, const unsigned char inner_hash[32], unsigned char mac[32]){
+	struct sha256_job job;
+
+	sha256_job_init(&job, key->outer.hash_values, inner_hash, 256, key->outer.length);
+	sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+	sha256_hash_values_to_bytes(job.hash_values, mac);
+}
+
+//One-shot MAC of length bytes of data
+void sha256_hmac(const struct sha256_hmac_key *key, const void *data, size_t length, unsigned char mac[32]){
+	struct sha256_job job;
+	unsigned char inner_hash[32];
+
+	sha256_job_init(&job, key->inner.hash_values, data, (uint64_t) length*8, key->inner.length);
+	sha256_compress_blocks(job.hash_values, job.blocks, job.number_of_blocks);
+	sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+	sha256_hash_values_to_bytes(job.hash_values, inner_hash);
+
+	sha256_hmac_outer(key, inner_hash, mac);
+}
+
+//Streaming MAC: init/update/final, like the streaming digest
+void sha256_hmac_init(struct sha256_hmac_context *context, const struct sha256_hmac_key *key){
+	sha256_context_init_from_midstate(&context->inner, &key->inner);
+	context->outer = key->outer;
+}
+
+void sha256_hmac_update(struct sha256_hmac_context *context, const void *data, size_t length){
+	sha256_context_update(&context->inner, data, length);
+}
+
+void sha256_hmac_final(struct sha256_hmac_context *context, unsigned char mac[32]){
+	unsigned char inner_hash[32];
+	struct sha256_hmac_key key;
+
+	sha256_context_final(&context->inner, inner_hash);
+
+	key.outer = context->outer;
+	sha256_hmac_outer(&key, inner_hash, mac);
+}
+
+//MACs count messages with the same key using the multi-buffer engine (inner hashes first, then the
+//outer hashes). data[c] holds lengths[c] bytes and its MAC is written to macs[c].
+void sha256_hmac_batch(const struct sha256_hmac_key *key, const void *const *data, const size_t *lengths, size_t count, unsigned char (*macs)[32]){
+	struct sha256_job jobs[SHA256_BATCH_WINDOW];
+	unsigned char inner_hashes[SHA256_BATCH_WINDOW][32];
+
+	for(size_t first = 0; first < count; first += SHA256_BATCH_WINDOW){
+		size_t window = count - first < SHA256_BATCH_WINDOW ? count - first : SHA256_BATCH_WINDOW;
+
+		for(size_t c = 0; c < window; ++c){
+			sha256_job_init(&jobs[c], key->inner.hash_values, data[first + c], (uint64_t) lengths[first + c]*8, key->inner.length);
+		}
+		sha256_compress_jobs(jobs, window);
+
+		for(size_t c = 0; c < window; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, inner_hashes[c]);
+			sha256_job_init(&jobs[c], key->outer.hash_values, inner_hashes[c], 256, key->outer.length);
+		}
+		sha256_compress_jobs(jobs, window);
+
+		for(size_t c = 0; c < window; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, macs[first + c]);
+		}
+	}
+}
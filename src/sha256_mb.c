@@ -0,0 +1,624 @@
+#include "sha256_digest.h"
+
+//Multi-buffer compression: 8 (AVX2) or 16 (AVX-512) independent jobs are compressed at the same
+//time, each one in a 32-bit lane of the vector registers. Lanes are refilled with the next job as
+//soon as their current job finishes, so jobs of different lengths can be mixed freely.
+
+//Compresses one block per lane. state is transposed: state[word][lane].
+typedef void (*sha256_mb_kernel)(uint32_t state[8][SHA256_MB_MAX_LANES], const unsigned char *const blocks[SHA256_MB_MAX_LANES]);
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+//Loads the 16 words of the blocks of 8 lanes and transposes them so words[t] holds word t of every lane
+__attribute__((target("avx2"), always_inline))
+static inline void sha256_mb_load_words_avx2(__m256i words[16], const unsigned char *const blocks[8]){
+	const __m256i byte_swap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+	for(int half = 0; half < 2; ++half){
+		__m256i r[8], t[8], u[8];
+
+		for(int l = 0; l < 8; ++l){
+			r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (blocks[l] + half*32)), byte_swap);
+		}
+
+		for(int l = 0; l < 8; l += 2){
+			t[l] = _mm256_unpacklo_epi32(r[l], r[l+1]);
+			t[l+1] = _mm256_unpackhi_epi32(r[l], r[l+1]);
+		}
+
+		for(int l = 0; l < 8; l += 4){
+			u[l] = _mm256_unpacklo_epi64(t[l], t[l+2]);
+			u[l+1] = _mm256_unpackhi_epi64(t[l], t[l+2]);
+			u[l+2] = _mm256_unpacklo_epi64(t[l+1], t[l+3]);
+			u[l+3] = _mm256_unpackhi_epi64(t[l+1], t[l+3]);
+		}
+
+		for(int l = 0; l < 4; ++l){
+			words[half*8 + l] = _mm256_permute2x128_si256(u[l], u[l+4], 0x20);
+			words[half*8 + l + 4] = _mm256_permute2x128_si256(u[l], u[l+4], 0x31);
+		}
+	}
+}
+
+//AVX2 helpers
+#define AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define AVX2_ADD(x, y) _mm256_add_epi32(x, y)
+#define AVX2_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define AVX2_CH(x, y, z) _mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define AVX2_MAJ(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)))
+#define AVX2_SIGMA0(x) AVX2_XOR3(AVX2_ROTR(x, 2), AVX2_ROTR(x, 13), AVX2_ROTR(x, 22))
+#define AVX2_SIGMA1(x) AVX2_XOR3(AVX2_ROTR(x, 6), AVX2_ROTR(x, 11), AVX2_ROTR(x, 25))
+#define AVX2_LOWSIGMA0(x) AVX2_XOR3(AVX2_ROTR(x, 7), AVX2_ROTR(x, 18), _mm256_srli_epi32(x, 3))
+#define AVX2_LOWSIGMA1(x) AVX2_XOR3(AVX2_ROTR(x, 17), AVX2_ROTR(x, 19), _mm256_srli_epi32(x, 10))
+
+//One round, the working variables are rotated by renaming them on each call
+#define AVX2_ROUND(a, b, c, d, e, f, g, h, j) \
+	if((j) >= 16){ \
+		w[(j) & 15] = AVX2_ADD(AVX2_ADD(AVX2_LOWSIGMA1(w[((j) - 2) & 15]), w[((j) - 7) & 15]), \
+			AVX2_ADD(AVX2_LOWSIGMA0(w[((j) - 15) & 15]), w[(j) & 15])); \
+	} \
+	tmp1 = AVX2_ADD(AVX2_ADD(AVX2_ADD(h, AVX2_SIGMA1(e)), AVX2_CH(e, f, g)), \
+		AVX2_ADD(_mm256_set1_epi32((int) sha256_default_round_constants[j]), w[(j) & 15])); \
+	tmp2 = AVX2_ADD(AVX2_SIGMA0(a), AVX2_MAJ(a, b, c)); \
+	d = AVX2_ADD(d, tmp1); \
+	h = AVX2_ADD(tmp1, tmp2)
+
+//Compresses the (transposed) words w of one block per lane into state
+__attribute__((target("avx2"), always_inline))
+static inline void sha256_mb_rounds_avx2(__m256i state[8], __m256i w[16]){
+	__m256i tmp1, tmp2;
+	__m256i a = state[0], b = state[1], c = state[2], d = state[3];
+	__m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for(int j = 0; j < 64; j += 8){
+		AVX2_ROUND(a, b, c, d, e, f, g, h, j);
+		AVX2_ROUND(h, a, b, c, d, e, f, g, j + 1);
+		AVX2_ROUND(g, h, a, b, c, d, e, f, j + 2);
+		AVX2_ROUND(f, g, h, a, b, c, d, e, j + 3);
+		AVX2_ROUND(e, f, g, h, a, b, c, d, j + 4);
+		AVX2_ROUND(d, e, f, g, h, a, b, c, j + 5);
+		AVX2_ROUND(c, d, e, f, g, h, a, b, j + 6);
+		AVX2_ROUND(b, c, d, e, f, g, h, a, j + 7);
+	}
+
+	state[0] = AVX2_ADD(state[0], a);
+	state[1] = AVX2_ADD(state[1], b);
+	state[2] = AVX2_ADD(state[2], c);
+	state[3] = AVX2_ADD(state[3], d);
+	state[4] = AVX2_ADD(state[4], e);
+	state[5] = AVX2_ADD(state[5], f);
+	state[6] = AVX2_ADD(state[6], g);
+	state[7] = AVX2_ADD(state[7], h);
+}
+
+__attribute__((target("avx2")))
+static void sha256_mb_kernel_avx2(uint32_t state[8][SHA256_MB_MAX_LANES], const unsigned char *const blocks[SHA256_MB_MAX_LANES]){
+	__m256i w[16], s[8];
+
+	sha256_mb_load_words_avx2(w, blocks);
+	for(int n = 0; n < 8; ++n){
+		s[n] = _mm256_loadu_si256((const __m256i *) state[n]);
+	}
+
+	sha256_mb_rounds_avx2(s, w);
+
+	for(int n = 0; n < 8; ++n){
+		_mm256_storeu_si256((__m256i *) state[n], s[n]);
+	}
+}
+
+//AVX-512 helpers (native rotations and ternary logic)
+#define AVX512_ADD(x, y) _mm512_add_epi32(x, y)
+#define AVX512_XOR3(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define AVX512_CH(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xCA)
+#define AVX512_MAJ(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xE8)
+#define AVX512_SIGMA0(x) AVX512_XOR3(_mm512_ror_epi32(x, 2), _mm512_ror_epi32(x, 13), _mm512_ror_epi32(x, 22))
+#define AVX512_SIGMA1(x) AVX512_XOR3(_mm512_ror_epi32(x, 6), _mm512_ror_epi32(x, 11), _mm512_ror_epi32(x, 25))
+#define AVX512_LOWSIGMA0(x) AVX512_XOR3(_mm512_ror_epi32(x, 7), _mm512_ror_epi32(x, 18), _mm512_srli_epi32(x, 3))
+#define AVX512_LOWSIGMA1(x) AVX512_XOR3(_mm512_ror_epi32(x, 17), _mm512_ror_epi32(x, 19), _mm512_srli_epi32(x, 10))
+
+#define AVX512_ROUND(a, b, c, d, e, f, g, h, j) \
+	if((j) >= 16){ \
+		w[(j) & 15] = AVX512_ADD(AVX512_ADD(AVX512_LOWSIGMA1(w[((j) - 2) & 15]), w[((j) - 7) & 15]), \
+			AVX512_ADD(AVX512_LOWSIGMA0(w[((j) - 15) & 15]), w[(j) & 15])); \
+	} \
+	tmp1 = AVX512_ADD(AVX512_ADD(AVX512_ADD(h, AVX512_SIGMA1(e)), AVX512_CH(e, f, g)), \
+		AVX512_ADD(_mm512_set1_epi32((int) sha256_default_round_constants[j]), w[(j) & 15])); \
+	tmp2 = AVX512_ADD(AVX512_SIGMA0(a), AVX512_MAJ(a, b, c)); \
+	d = AVX512_ADD(d, tmp1); \
+	h = AVX512_ADD(tmp1, tmp2)
+
+__attribute__((target("avx512f,avx2"), always_inline))
+static inline void sha256_mb_rounds_avx512(__m512i state[8], __m512i w[16]){
+	__m512i tmp1, tmp2;
+	__m512i a = state[0], b = state[1], c = state[2], d = state[3];
+	__m512i e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for(int j = 0; j < 64; j += 8){
+		AVX512_ROUND(a, b, c, d, e, f, g, h, j);
+		AVX512_ROUND(h, a, b, c, d, e, f, g, j + 1);
+		AVX512_ROUND(g, h, a, b, c, d, e, f, j + 2);
+		AVX512_ROUND(f, g, h, a, b, c, d, e, j + 3);
+		AVX512_ROUND(e, f, g, h, a, b, c, d, j + 4);
+		AVX512_ROUND(d, e, f, g, h, a, b, c, j + 5);
+		AVX512_ROUND(c, d, e, f, g, h, a, b, j + 6);
+		AVX512_ROUND(b, c, d, e, f, g, h, a, j + 7);
+	}
+
+	state[0] = AVX512_ADD(state[0], a);
+	state[1] = AVX512_ADD(state[1], b);
+	state[2] = AVX512_ADD(state[2], c);
+	state[3] = AVX512_ADD(state[3], d);
+	state[4] = AVX512_ADD(state[4], e);
+	state[5] = AVX512_ADD(state[5], f);
+	state[6] = AVX512_ADD(state[6], g);
+	state[7] = AVX512_ADD(state[7], h);
+}
+
+__attribute__((target("avx512f,avx2")))
+static void sha256_mb_kernel_avx512(uint32_t state[8][SHA256_MB_MAX_LANES], const unsigned char *const blocks[SHA256_MB_MAX_LANES]){
+	__m512i w[16], s[8];
+	__m256i low[16], high[16];
+
+	//Transpose lanes 0-7 and 8-15 separately and join the halves
+	sha256_mb_load_words_avx2(low, blocks);
+	sha256_mb_load_words_avx2(high, blocks + 8);
+	for(int j = 0; j < 16; ++j){
+		w[j] = _mm512_inserti64x4(_mm512_castsi256_si512(low[j]), high[j], 1);
+	}
+	for(int n = 0; n < 8; ++n){
+		s[n] = _mm512_loadu_si512(state[n]);
+	}
+
+	sha256_mb_rounds_avx512(s, w);
+
+	for(int n = 0; n < 8; ++n){
+		_mm512_storeu_si512(state[n], s[n]);
+	}
+}
+
+//HMAC chains (PBKDF2): each iteration replaces every lane's u by HMAC(key, u) and xors it into t. The
+//message is always a 32 bytes hash after a 64 bytes key block, so both blocks are the 8 words of a hash
+//followed by constant padding ('1' bit and a length of 768 bits), and nothing but the key midstates is
+//read from memory between iterations.
+__attribute__((target("avx2")))
+static void sha256_hmac_chain_avx2(struct sha256_hmac_lanes *lanes, uint64_t iterations){
+	__m256i u[8], t[8], s[8], w[16];
+
+	for(int n = 0; n < 8; ++n){
+		u[n] = _mm256_loadu_si256((const __m256i *) lanes->u[n]);
+		t[n] = _mm256_loadu_si256((const __m256i *) lanes->t[n]);
+	}
+
+	for(uint64_t c = 0; c < iterations; ++c){
+		for(int n = 0; n < 8; ++n){
+			w[n] = u[n];
+			w[n + 8] = _mm256_setzero_si256();
+			s[n] = _mm256_loadu_si256((const __m256i *) lanes->inner[n]);
+		}
+		w[8] = _mm256_set1_epi32((int) 0x80000000);
+		w[15] = _mm256_set1_epi32(768);
+		sha256_mb_rounds_avx2(s, w);
+
+		for(int n = 0; n < 8; ++n){
+			w[n] = s[n];
+			w[n + 8] = _mm256_setzero_si256();
+			u[n] = _mm256_loadu_si256((const __m256i *) lanes->outer[n]);
+		}
+		w[8] = _mm256_set1_epi32((int) 0x80000000);
+		w[15] = _mm256_set1_epi32(768);
+		sha256_mb_rounds_avx2(u, w);
+
+		for(int n = 0; n < 8; ++n){
+			t[n] = _mm256_xor_si256(t[n], u[n]);
+		}
+	}
+
+	for(int n = 0; n < 8; ++n){
+		_mm256_storeu_si256((__m256i *) lanes->u[n], u[n]);
+		_mm256_storeu_si256((__m256i *) lanes->t[n], t[n]);
+	}
+}
+
+__attribute__((target("avx512f,avx2")))
+static void sha256_hmac_chain_avx512(struct sha256_hmac_lanes *lanes, uint64_t iterations){
+	__m512i u[8], t[8], s[8], w[16];
+
+	for(int n = 0; n < 8; ++n){
+		u[n] = _mm512_loadu_si512(lanes->u[n]);
+		t[n] = _mm512_loadu_si512(lanes->t[n]);
+	}
+
+	for(uint64_t c = 0; c < iterations; ++c){
+		for(int n = 0; n < 8; ++n){
+			w[n] = u[n];
+			w[n + 8] = _mm512_setzero_si512();
+			s[n] = _mm512_loadu_si512(lanes->inner[n]);
+		}
+		w[8] = _mm512_set1_epi32((int) 0x80000000);
+		w[15] = _mm512_set1_epi32(768);
+		sha256_mb_rounds_avx512(s, w);
+
+		for(int n = 0; n < 8; ++n){
+			w[n] = s[n];
+			w[n + 8] = _mm512_setzero_si512();
+			u[n] = _mm512_loadu_si512(lanes->outer[n]);
+		}
+		w[8] = _mm512_set1_epi32((int) 0x80000000);
+		w[15] = _mm512_set1_epi32(768);
+		sha256_mb_rounds_avx512(u, w);
+
+		for(int n = 0; n < 8; ++n){
+			t[n] = _mm512_xor_si512(t[n], u[n]);
+		}
+	}
+
+	for(int n = 0; n < 8; ++n){
+		_mm512_storeu_si512(lanes->u[n], u[n]);
+		_mm512_storeu_si512(lanes->t[n], t[n]);
+	}
+}
+
+//Nonce search rounds of the second block: the rounds before the nonce word are skipped (they come
+//precomputed in search->state), the words that don't depend on the nonce come with K[j] already added,
+//and the others only compute their terms that depend on it.
+#define NONCE_ROUND(PREFIX, SET1, a, b, c, d, e, f, g, h, j) \
+	if((j) >= (int) search->nonce_word){ \
+		if((j) == (int) search->nonce_word){ \
+			w[(j) & 15] = nonces; \
+			kw = PREFIX##_ADD(SET1((int) sha256_default_round_constants[j]), nonces); \
+		} else if(0 == search->terms[j]){ \
+			kw = SET1((int) search->fixed_kw[j]); \
+		} else { \
+			x = SET1((int) search->partial[j]); \
+			if(search->terms[j] & SHA256_NONCE_TERM_SIGMA1){ \
+				x = PREFIX##_ADD(x, PREFIX##_LOWSIGMA1(w[((j) - 2) & 15])); \
+			} \
+			if(search->terms[j] & SHA256_NONCE_TERM_W7){ \
+				x = PREFIX##_ADD(x, w[((j) - 7) & 15]); \
+			} \
+			if(search->terms[j] & SHA256_NONCE_TERM_SIGMA0){ \
+				x = PREFIX##_ADD(x, PREFIX##_LOWSIGMA0(w[((j) - 15) & 15])); \
+			} \
+			if(search->terms[j] & SHA256_NONCE_TERM_W16){ \
+				x = PREFIX##_ADD(x, w[(j) & 15]); \
+			} \
+			w[(j) & 15] = x; \
+			kw = PREFIX##_ADD(SET1((int) sha256_default_round_constants[j]), x); \
+		} \
+		tmp1 = PREFIX##_ADD(PREFIX##_ADD(PREFIX##_ADD(h, PREFIX##_SIGMA1(e)), PREFIX##_CH(e, f, g)), kw); \
+		tmp2 = PREFIX##_ADD(PREFIX##_SIGMA0(a), PREFIX##_MAJ(a, b, c)); \
+		d = PREFIX##_ADD(d, tmp1); \
+		h = PREFIX##_ADD(tmp1, tmp2); \
+	}
+
+//Nonces first_nonce + lane, as big-endian words of the block (the nonce bytes are little-endian)
+static void sha256_nonce_words(uint32_t words[SHA256_MB_MAX_LANES], uint32_t first_nonce, unsigned int width){
+	for(unsigned int l = 0; l < width; ++l){
+		words[l] = __builtin_bswap32(first_nonce + l);
+	}
+}
+
+//First word of the hash of width consecutive nonces (the rest of the hash isn't needed to reject them)
+__attribute__((target("avx2")))
+static __m256i sha256_nonce_hash_avx2(const struct sha256_nonce_search *search, uint32_t first_nonce){
+	uint32_t nonce_words[SHA256_MB_MAX_LANES];
+	__m256i w[16], v[8], s[8], nonces, kw, x, tmp1, tmp2;
+
+	sha256_nonce_words(nonce_words, first_nonce, 8);
+	nonces = _mm256_loadu_si256((const __m256i *) nonce_words);
+
+	//Working variables at the round of the nonce word, renamed like the rounds that were skipped
+	for(int p = 0; p < 8; ++p){
+		v[(p - (int) search->nonce_word) & 7] = _mm256_set1_epi32((int) search->state[p]);
+	}
+
+	for(int j = 0; j < 64; j += 8){
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], j);
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[7], v[0], v[1], v[2], v[3], v[4], v[5], v[6], j + 1);
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[6], v[7], v[0], v[1], v[2], v[3], v[4], v[5], j + 2);
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[5], v[6], v[7], v[0], v[1], v[2], v[3], v[4], j + 3);
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[4], v[5], v[6], v[7], v[0], v[1], v[2], v[3], j + 4);
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[3], v[4], v[5], v[6], v[7], v[0], v[1], v[2], j + 5);
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[2], v[3], v[4], v[5], v[6], v[7], v[0], v[1], j + 6);
+		NONCE_ROUND(AVX2, _mm256_set1_epi32, v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[0], j + 7);
+	}
+
+	if(0 == search->double_hash){
+		return AVX2_ADD(v[0], _mm256_set1_epi32((int) search->midstate[0]));
+	}
+
+	//Second hash: the 32 bytes hash and its constant padding
+	for(int n = 0; n < 8; ++n){
+		w[n] = AVX2_ADD(v[n], _mm256_set1_epi32((int) search->midstate[n]));
+		w[n + 8] = _mm256_setzero_si256();
+		s[n] = _mm256_set1_epi32((int) sha256_default_hash_values[n]);
+	}
+	w[8] = _mm256_set1_epi32((int) 0x80000000);
+	w[15] = _mm256_set1_epi32(256);
+	sha256_mb_rounds_avx2(s, w);
+
+	return s[0];
+}
+
+__attribute__((target("avx2")))
+static uint64_t sha256_nonce_scan_avx2(const struct sha256_nonce_search *search, uint32_t first_nonce, uint64_t count, uint32_t *candidates){
+	const __m256i sign = _mm256_set1_epi32((int) 0x80000000);
+	const __m256i target = _mm256_xor_si256(_mm256_set1_epi32((int) search->target_word), sign);
+
+	for(uint64_t offset = 0; offset < count; offset += 8){
+		__m256i first_word = _mm256_xor_si256(sha256_nonce_hash_avx2(search, first_nonce + (uint32_t) offset), sign);
+		//No unsigned comparison on AVX2: compare with the sign bits flipped
+		uint32_t rejected = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(first_word, target)));
+		uint32_t mask = ~rejected & 0xFF;
+
+		if(count - offset < 8){
+			mask &= (1u << (count - offset)) - 1;
+		}
+		if(mask){
+			*candidates = mask;
+			return offset;
+		}
+	}
+
+	return count;
+}
+
+__attribute__((target("avx512f,avx2")))
+static __m512i sha256_nonce_hash_avx512(const struct sha256_nonce_search *search, uint32_t first_nonce){
+	uint32_t nonce_words[SHA256_MB_MAX_LANES];
+	__m512i w[16], v[8], s[8], nonces, kw, x, tmp1, tmp2;
+
+	sha256_nonce_words(nonce_words, first_nonce, 16);
+	nonces = _mm512_loadu_si512(nonce_words);
+
+	for(int p = 0; p < 8; ++p){
+		v[(p - (int) search->nonce_word) & 7] = _mm512_set1_epi32((int) search->state[p]);
+	}
+
+	for(int j = 0; j < 64; j += 8){
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], j);
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[7], v[0], v[1], v[2], v[3], v[4], v[5], v[6], j + 1);
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[6], v[7], v[0], v[1], v[2], v[3], v[4], v[5], j + 2);
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[5], v[6], v[7], v[0], v[1], v[2], v[3], v[4], j + 3);
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[4], v[5], v[6], v[7], v[0], v[1], v[2], v[3], j + 4);
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[3], v[4], v[5], v[6], v[7], v[0], v[1], v[2], j + 5);
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[2], v[3], v[4], v[5], v[6], v[7], v[0], v[1], j + 6);
+		NONCE_ROUND(AVX512, _mm512_set1_epi32, v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[0], j + 7);
+	}
+
+	if(0 == search->double_hash){
+		return AVX512_ADD(v[0], _mm512_set1_epi32((int) search->midstate[0]));
+	}
+
+	for(int n = 0; n < 8; ++n){
+		w[n] = AVX512_ADD(v[n], _mm512_set1_epi32((int) search->midstate[n]));
+		w[n + 8] = _mm512_setzero_si512();
+		s[n] = _mm512_set1_epi32((int) sha256_default_hash_values[n]);
+	}
+	w[8] = _mm512_set1_epi32((int) 0x80000000);
+	w[15] = _mm512_set1_epi32(256);
+	sha256_mb_rounds_avx512(s, w);
+
+	return s[0];
+}
+
+__attribute__((target("avx512f,avx2")))
+static uint64_t sha256_nonce_scan_avx512(const struct sha256_nonce_search *search, uint32_t first_nonce, uint64_t count, uint32_t *candidates){
+	const __m512i target = _mm512_set1_epi32((int) search->target_word);
+
+	for(uint64_t offset = 0; offset < count; offset += 16){
+		uint32_t mask = _mm512_cmple_epu32_mask(sha256_nonce_hash_avx512(search, first_nonce + (uint32_t) offset), target);
+
+		if(count - offset < 16){
+			mask &= (1u << (count - offset)) - 1;
+		}
+		if(mask){
+			*candidates = mask;
+			return offset;
+		}
+	}
+
+	return count;
+}
+#endif
+
+//Lane bookkeeping for the scheduler
+struct sha256_mb_lane{
+	struct sha256_job *job;	//Job being compressed (NULL = idle lane)
+	const unsigned char *next_block;	//Next block to feed the lane
+	uint64_t data_blocks_left;	//Blocks left on job->blocks
+	unsigned int tail_blocks_left;	//Blocks left on job->tail
+};
+
+//Puts the next non-empty job on the lane, or leaves it idle if there are no more jobs
+static void sha256_mb_lane_assign(struct sha256_mb_lane *lane, unsigned int lane_index, uint32_t state[8][SHA256_MB_MAX_LANES],
+	struct sha256_job *jobs, size_t count, size_t *next_job){
+	lane->job = NULL;
+
+	while(*next_job < count){
+		struct sha256_job *job = &jobs[(*next_job)++];
+
+		if(0 == job->number_of_blocks && 0 == job->tail_blocks){
+			continue;	//Nothing to compress, the job's hash values are already final
+		}
+
+		lane->job = job;
+		lane->next_block = job->blocks;
+		lane->data_blocks_left = job->number_of_blocks;
+		lane->tail_blocks_left = job->tail_blocks;
+		for(int n = 0; n < 8; ++n){
+			state[n][lane_index] = job->hash_values[n];
+		}
+		return;
+	}
+}
+
+//Runs the jobs through a multi-buffer kernel
+static void sha256_mb_run(struct sha256_job *jobs, size_t count, unsigned int lanes, sha256_mb_kernel kernel){
+	static const unsigned char idle_block[64] = {0};
+	uint32_t state[8][SHA256_MB_MAX_LANES];
+	const unsigned char *blocks[SHA256_MB_MAX_LANES];
+	struct sha256_mb_lane lane[SHA256_MB_MAX_LANES];
+	unsigned int active = 0;
+	size_t next_job = 0;
+
+	memset(state, 0, sizeof(state));
+
+	for(unsigned int l = 0; l < lanes; ++l){
+		sha256_mb_lane_assign(&lane[l], l, state, jobs, count, &next_job);
+		if(lane[l].job){
+			++active;
+		}
+	}
+
+	//Once there are no more jobs and most lanes are idle, a single-buffer kernel is faster than
+	//dragging the idle lanes along
+	while(active > 0 && (next_job < count || active*4 > lanes)){
+		for(unsigned int l = 0; l < lanes; ++l){
+			if(NULL == lane[l].job){
+				blocks[l] = idle_block;
+			} else if(lane[l].data_blocks_left){
+				blocks[l] = lane[l].next_block;
+				lane[l].next_block += 64;
+				--lane[l].data_blocks_left;
+			} else {
+				blocks[l] = lane[l].job->tail + (lane[l].job->tail_blocks - lane[l].tail_blocks_left)*64;
+				--lane[l].tail_blocks_left;
+			}
+		}
+
+		kernel(state, blocks);
+
+		for(unsigned int l = 0; l < lanes; ++l){
+			if(lane[l].job && 0 == lane[l].data_blocks_left && 0 == lane[l].tail_blocks_left){
+				for(int n = 0; n < 8; ++n){
+					lane[l].job->hash_values[n] = state[n][l];
+				}
+				sha256_mb_lane_assign(&lane[l], l, state, jobs, count, &next_job);
+				if(NULL == lane[l].job){
+					--active;
+				}
+			}
+		}
+	}
+
+	//Finish the few jobs left one at a time
+	for(unsigned int l = 0; l < lanes; ++l){
+		if(lane[l].job){
+			struct sha256_job *job = lane[l].job;
+			unsigned int tail_done = job->tail_blocks - lane[l].tail_blocks_left;
+
+			for(int n = 0; n < 8; ++n){
+				job->hash_values[n] = state[n][l];
+			}
+			sha256_compress_blocks(job->hash_values, lane[l].next_block, lane[l].data_blocks_left);
+			sha256_compress_blocks(job->hash_values, job->tail + tail_done*64, lane[l].tail_blocks_left);
+		}
+	}
+}
+
+//Prepares a job to hash bits_length bits of data starting from the given hash values. prefix_length
+//is the number of bytes already compressed into hash_values (0 for a new hash), it's only used to
+//write the right length in the padding. Whole blocks are read straight from data, only the last
+//bits are copied (and padded) into the job.
+void sha256_job_init(struct sha256_job *job, const uint32_t hash_values[8], const void *data, uint64_t bits_length, uint64_t prefix_length){
+	const unsigned char *data_pointer = data;
+	uint64_t remaining_bits = bits_length % 512;
+	uint64_t total_bits = prefix_length*8 + bits_length;
+
+	memcpy(job->hash_values, hash_values, sizeof(job->hash_values));
+	job->blocks = data_pointer;
+	job->number_of_blocks = bits_length/512;
+
+	memset(job->tail, 0, sizeof(job->tail));
+	if(remaining_bits){
+		memcpy(job->tail, data_pointer + job->number_of_blocks*64, (size_t) ((remaining_bits + 7)/8));
+		//Remove the extra bits of a broken byte
+		if(remaining_bits % 8){
+			job->tail[remaining_bits/8] &= (unsigned char) (0xFF << (8 - remaining_bits % 8));
+		}
+	}
+
+	//Append the '1' bit and the length, using a second block if they don't fit
+	job->tail[remaining_bits/8] |= (unsigned char) (0x80 >> (remaining_bits % 8));
+	job->tail_blocks = (remaining_bits + 65 > 512) ? 2 : 1;
+
+	unsigned char *size_bytes = job->tail + job->tail_blocks*64 - 8;
+	for(int c = 0; c < 8; ++c){
+		size_bytes[c] = (total_bits >> (56 - c*8)) & 0xFF;
+	}
+}
+
+//Compresses the jobs with at most lanes lanes: 16 (AVX-512), 8 (AVX2) or 1 (one job after the other
+//with the single-buffer kernel). The widest kernel the CPU supports within that limit is used.
+void sha256_compress_jobs_lanes(struct sha256_job *jobs, size_t count, unsigned int lanes){
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int features = sha256_cpu_features();
+
+	if(count > 1 && lanes >= 16 && (features & SHA256_CPU_AVX512)){
+		sha256_mb_run(jobs, count, 16, sha256_mb_kernel_avx512);
+		return;
+	}
+	if(count > 1 && lanes >= 8 && (features & SHA256_CPU_AVX2)){
+		sha256_mb_run(jobs, count, 8, sha256_mb_kernel_avx2);
+		return;
+	}
+#else
+	(void) lanes;
+#endif
+
+	for(size_t c = 0; c < count; ++c){
+		sha256_compress_blocks(jobs[c].hash_values, jobs[c].blocks, jobs[c].number_of_blocks);
+		sha256_compress_blocks(jobs[c].hash_values, jobs[c].tail, jobs[c].tail_blocks);
+	}
+}
+
+//Compresses all the jobs, leaving the final chaining values on each job's hash_values
+void sha256_compress_jobs(struct sha256_job *jobs, size_t count){
+	sha256_compress_jobs_lanes(jobs, count, SHA256_MB_MAX_LANES);
+}
+
+//Runs iterations steps of the HMAC chains of 16 (AVX-512) or 8 (AVX2) lanes. The caller must check
+//the CPU supports it. Returns -1 (doing nothing) for any other width.
+int sha256_hmac_chain_lanes(struct sha256_hmac_lanes *lanes, unsigned int width, uint64_t iterations){
+#if defined(__x86_64__) || defined(__i386__)
+	if(16 == width){
+		sha256_hmac_chain_avx512(lanes, iterations);
+		return 0;
+	}
+	if(8 == width){
+		sha256_hmac_chain_avx2(lanes, iterations);
+		return 0;
+	}
+#else
+	(void) lanes;
+	(void) iterations;
+#endif
+	(void) width;
+	return -1;
+}
+
+//Scans the nonces [first_nonce, first_nonce + count) width at a time on 16 (AVX-512) or 8 (AVX2) lanes,
+//up to the first group with candidates: nonces whose hash has a first word <= the target's (they still
+//must be checked against the whole target). Returns the offset of that group from first_nonce, with its
+//candidates as a mask of lanes, or count if there are none. The caller must check the CPU supports it.
+uint64_t sha256_nonce_scan_lanes(const struct sha256_nonce_search *search, uint32_t first_nonce, uint64_t count, unsigned int width,
+	uint32_t *candidates){
+#if defined(__x86_64__) || defined(__i386__)
+	if(16 == width){
+		return sha256_nonce_scan_avx512(search, first_nonce, count, candidates);
+	}
+	if(8 == width){
+		return sha256_nonce_scan_avx2(search, first_nonce, count, candidates);
+	}
+#else
+	(void) search;
+	(void) first_nonce;
+	(void) candidates;
+#endif
+	(void) width;
+	return count;
+}
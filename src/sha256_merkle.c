@@ -0,0 +1,500 @@
+#include "sha256_digest.h"
+#include <pthread.h>
+#include <unistd.h>
+
+//Merkle trees over fixed-size leaves. Each level is split in slices hashed in parallel by several threads,
+//and every thread hashes its slice in windows of jobs through the multi-buffer engine. The tree is stored
+//level after level (leaves first, root last) in a single array, so there's no allocation per node.
+//An odd node at the end of a level has no sibling and is promoted unchanged to the next level.
+//With SHA-NI a single lane beats the multi-buffer engine on these two-block inputs (no job setup, and the
+//padding block of a 64-byte node is prescheduled), so the fixed-length fast paths are used when they fit.
+
+//Number of levels of a tree with leaf_count leaves (leaves and root included)
+unsigned int sha256_merkle_levels(size_t leaf_count){
+	unsigned int levels = 1;
+
+	while(leaf_count > 1){
+		leaf_count = (leaf_count + 1)/2;
+		++levels;
+	}
+
+	return levels;
+}
+
+//Number of nodes (leaves included) of a tree with leaf_count leaves
+size_t sha256_merkle_tree_size(size_t leaf_count){
+	size_t size = 0;
+
+	if(0 == leaf_count){
+		return 1;	//Just the root, the hash of an empty input
+	}
+
+	while(leaf_count > 1){
+		size += leaf_count;
+		leaf_count = (leaf_count + 1)/2;
+	}
+
+	return size + 1;
+}
+
+//Hashes the leaves [first, last) into hashes[first, last). scratch must hold SHA256_BATCH_WINDOW leaves
+//plus their prefix byte when domain separation is used.
+static void sha256_merkle_hash_leaves(const unsigned char *leaves, size_t leaf_size, const struct sha256_merkle_config *config,
+	unsigned char (*hashes)[32], size_t first, size_t last, unsigned char *scratch){
+	size_t input_size = leaf_size + (config->domain_separation ? 1 : 0);
+	struct sha256_job jobs[SHA256_BATCH_WINDOW];
+
+	if(!config->domain_separation && (32 == leaf_size || 64 == leaf_size) && (sha256_cpu_features() & SHA256_CPU_SHANI)){
+		for(size_t c = first; c < last; ++c){
+			if(32 == leaf_size){
+				sha256_32(leaves + c*32, hashes[c]);
+			} else {
+				sha256_64(leaves + c*64, hashes[c]);
+			}
+		}
+		return;
+	}
+
+	for(size_t start = first; start < last; start += SHA256_BATCH_WINDOW){
+		size_t window = last - start < SHA256_BATCH_WINDOW ? last - start : SHA256_BATCH_WINDOW;
+
+		for(size_t c = 0; c < window; ++c){
+			const unsigned char *leaf = leaves + (start + c)*leaf_size;
+
+			if(config->domain_separation){
+				unsigned char *input = scratch + c*input_size;
+
+				input[0] = config->leaf_prefix;
+				memcpy(input + 1, leaf, leaf_size);
+				leaf = input;
+			}
+			sha256_job_init(&jobs[c], sha256_default_hash_values, leaf, (uint64_t) input_size*8, 0);
+		}
+
+		sha256_compress_jobs(jobs, window);
+
+		for(size_t c = 0; c < window; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, hashes[start + c]);
+		}
+	}
+}
+
+//Hashes the nodes [first, last) of a level from the children on the level below
+static void sha256_merkle_hash_nodes(const struct sha256_merkle_config *config, const unsigned char (*children)[32], size_t children_count,
+	unsigned char (*nodes)[32], size_t first, size_t last){
+	struct sha256_job jobs[SHA256_BATCH_WINDOW];
+	unsigned char inputs[SHA256_BATCH_WINDOW][65];
+	size_t input_size = config->domain_separation ? 65 : 64;
+
+	if(!config->domain_separation && (sha256_cpu_features() & SHA256_CPU_SHANI)){
+		for(size_t c = first; c < last; ++c){
+			if(c*2 + 1 >= children_count){
+				memcpy(nodes[c], children[c*2], 32);
+			} else {
+				sha256_64(children[c*2], nodes[c]);
+			}
+		}
+		return;
+	}
+
+	for(size_t start = first; start < last; start += SHA256_BATCH_WINDOW){
+		size_t window = last - start < SHA256_BATCH_WINDOW ? last - start : SHA256_BATCH_WINDOW;
+		size_t jobs_count = 0;
+
+		for(size_t c = 0; c < window; ++c){
+			size_t left = (start + c)*2;
+
+			//Odd node, promoted unchanged
+			if(left + 1 >= children_count){
+				memcpy(nodes[start + c], children[left], 32);
+				continue;
+			}
+
+			//Without domain separation both children are already contiguous
+			const unsigned char *input = children[left];
+			if(config->domain_separation){
+				inputs[c][0] = config->node_prefix;
+				memcpy(&inputs[c][1], children[left], 64);
+				input = inputs[c];
+			}
+			sha256_job_init(&jobs[jobs_count++], sha256_default_hash_values, input, (uint64_t) input_size*8, 0);
+		}
+
+		sha256_compress_jobs(jobs, jobs_count);
+
+		//Jobs are in the same order as the nodes that needed hashing
+		for(size_t c = 0, job = 0; c < window; ++c){
+			if((start + c)*2 + 1 < children_count){
+				sha256_hash_values_to_bytes(jobs[job++].hash_values, nodes[start + c]);
+			}
+		}
+	}
+}
+
+//Slice of a level hashed by one thread
+struct sha256_merkle_slice{
+	const unsigned char *leaves;	//Leaves, when hashing the first level (NULL otherwise)
+	size_t leaf_size;
+	const struct sha256_merkle_config *config;
+	const unsigned char (*children)[32];	//Level below, when hashing nodes
+	size_t children_count;
+	unsigned char (*nodes)[32];	//Level being hashed
+	size_t first;
+	size_t last;
+	int failed;
+	pthread_t thread;
+};
+
+static void *sha256_merkle_slice_run(void *argument){
+	struct sha256_merkle_slice *slice = argument;
+
+	if(NULL == slice->leaves){
+		sha256_merkle_hash_nodes(slice->config, slice->children, slice->children_count, slice->nodes, slice->first, slice->last);
+		return NULL;
+	}
+
+	unsigned char *scratch = NULL;
+
+	//With domain separation the prefix and the leaf must be copied together
+	if(slice->config->domain_separation){
+		scratch = malloc(SHA256_BATCH_WINDOW * (slice->leaf_size + 1));
+		if(NULL == scratch){
+			sha256_error(MALLOC_ERROR);
+			slice->failed = 1;
+			return NULL;
+		}
+	}
+
+	sha256_merkle_hash_leaves(slice->leaves, slice->leaf_size, slice->config, slice->nodes, slice->first, slice->last, scratch);
+	free(scratch);
+
+	return NULL;
+}
+
+//Hashes a whole level, split in slices among thread_count threads (the calling thread takes the first
+//slice, and the slices of threads that can't be started). Returns 0 if it went OK, -1 otherwise.
+static int sha256_merkle_hash_level(struct sha256_merkle_slice *slices, unsigned int thread_count, const struct sha256_merkle_slice *level, size_t count){
+	unsigned int started[SHA256_MERKLE_MAX_THREADS] = {0};
+	int result = 0;
+
+	//Small levels aren't worth the threads
+	if(count < (size_t) thread_count * SHA256_BATCH_WINDOW){
+		thread_count = (unsigned int) (count/SHA256_BATCH_WINDOW) + 1;
+	}
+
+	for(unsigned int c = 0; c < thread_count; ++c){
+		slices[c] = *level;
+		slices[c].first = count * c / thread_count;
+		slices[c].last = count * (c + 1) / thread_count;
+		slices[c].failed = 0;
+	}
+
+	for(unsigned int c = 1; c < thread_count; ++c){
+		if(0 == pthread_create(&slices[c].thread, NULL, sha256_merkle_slice_run, &slices[c])){
+			started[c] = 1;
+		} else {
+			sha256_error(THREAD_ERROR);
+		}
+	}
+
+	sha256_merkle_slice_run(&slices[0]);
+
+	for(unsigned int c = 1; c < thread_count; ++c){
+		if(started[c]){
+			pthread_join(slices[c].thread, NULL);
+		} else {
+			sha256_merkle_slice_run(&slices[c]);
+		}
+	}
+
+	for(unsigned int c = 0; c < thread_count; ++c){
+		if(slices[c].failed){
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+//Builds the Merkle tree of leaf_count leaves of leaf_size bytes each (stored one after the other in
+//leaves). If tree isn't NULL it must hold sha256_merkle_tree_size(leaf_count) nodes and it will hold
+//every level of the tree, leaves first and root last (needed for proofs). The root is written to root.
+//Returns 0 if it went OK, -1 if any error occurred.
+int sha256_merkle_build(const unsigned char *leaves, size_t leaf_size, size_t leaf_count, const struct sha256_merkle_config *config,
+	unsigned char (*tree)[32], unsigned char root[32]){
+	struct sha256_merkle_slice slices[SHA256_MERKLE_MAX_THREADS];
+	size_t tree_size = sha256_merkle_tree_size(leaf_count);
+	unsigned char (*nodes)[32] = tree;
+	unsigned int thread_count = config->thread_count;
+	int result = -1;
+
+	//An empty tree's root is the hash of an empty input
+	if(0 == leaf_count){
+		struct sha256_job job;
+
+		sha256_job_init(&job, sha256_default_hash_values, "", 0, 0);
+		sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+		sha256_hash_values_to_bytes(job.hash_values, root);
+		if(tree){
+			memcpy(tree[0], root, 32);
+		}
+		return 0;
+	}
+
+	//The caller only wants the root, we still need room for the levels
+	if(NULL == nodes){
+		nodes = malloc(tree_size * 32);
+		if(NULL == nodes){
+			sha256_error(MALLOC_ERROR);
+			return -1;
+		}
+	}
+
+	if(0 == thread_count){
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = online > 0 ? (unsigned int) online : 1;
+	}
+	if(thread_count > SHA256_MERKLE_MAX_THREADS){
+		thread_count = SHA256_MERKLE_MAX_THREADS;
+	}
+
+	//Leaves
+	struct sha256_merkle_slice level;
+	memset(&level, 0, sizeof(level));
+	level.leaves = leaves;
+	level.leaf_size = leaf_size;
+	level.config = config;
+	level.nodes = nodes;
+	if(sha256_merkle_hash_level(slices, thread_count, &level, leaf_count)){
+		goto error1;
+	}
+
+	//Every level from the one below
+	unsigned char (*children)[32] = nodes;
+	size_t count = leaf_count;
+	while(count > 1){
+		level.leaves = NULL;
+		level.children = (const unsigned char (*)[32]) children;
+		level.children_count = count;
+		level.nodes = children + count;
+
+		count = (count + 1)/2;
+		sha256_merkle_hash_level(slices, thread_count, &level, count);
+		children = level.nodes;
+	}
+
+	memcpy(root, nodes[tree_size - 1], 32);
+	result = 0;
+
+error1:
+	if(nodes != tree){
+		free(nodes);
+	}
+	return result;
+}
+
+//Hashes a leaf (with its prefix if domain separation is used)
+static void sha256_merkle_leaf_hash(const unsigned char *leaf, size_t leaf_size, const struct sha256_merkle_config *config, unsigned char hash[32]){
+	struct sha256_midstate start = {{0}, 0};
+	struct sha256_context context;
+
+	memcpy(start.hash_values, sha256_default_hash_values, sizeof(start.hash_values));
+	sha256_context_init_from_midstate(&context, &start);
+	if(config->domain_separation){
+		sha256_context_update(&context, &config->leaf_prefix, 1);
+	}
+	sha256_context_update(&context, leaf, leaf_size);
+	sha256_context_final(&context, hash);
+}
+
+//Writes the inclusion proof of leaf index (the siblings on the path to the root, bottom up) to proof,
+//which must have room for as many hashes as the tree has levels. Returns the number of hashes written.
+size_t sha256_merkle_proof(const unsigned char (*tree)[32], size_t leaf_count, size_t index, unsigned char (*proof)[32]){
+	size_t level_start = 0, count = leaf_count, length = 0;
+
+	while(count > 1){
+		size_t sibling = index ^ 1;
+
+		//A promoted odd node has no sibling on this level
+		if(sibling < count){
+			memcpy(proof[length++], tree[level_start + sibling], 32);
+		}
+
+		level_start += count;
+		count = (count + 1)/2;
+		index >>= 1;
+	}
+
+	return length;
+}
+
+//Walks a proof up from a leaf hash, writing the root it leads to. Returns 0 if the proof has the right
+//length for the leaf's position, -1 otherwise.
+static int sha256_merkle_proof_root(unsigned char node[32], size_t index, size_t leaf_count, const unsigned char (*proof)[32], size_t proof_length,
+	const struct sha256_merkle_config *config){
+	size_t count = leaf_count, used = 0;
+	unsigned char input[65];
+	unsigned char *children = input;
+
+	if(config->domain_separation){
+		input[0] = config->node_prefix;
+		children = input + 1;
+	}
+
+	while(count > 1){
+		if((index ^ 1) < count){
+			if(used == proof_length){
+				return -1;
+			}
+
+			if(index & 1){
+				memcpy(children, proof[used], 32);
+				memcpy(children + 32, node, 32);
+			} else {
+				memcpy(children, node, 32);
+				memcpy(children + 32, proof[used], 32);
+			}
+			++used;
+
+			if(config->domain_separation){
+				struct sha256_job job;
+
+				sha256_job_init(&job, sha256_default_hash_values, input, 65*8, 0);
+				sha256_compress_blocks(job.hash_values, job.blocks, job.number_of_blocks);
+				sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+				sha256_hash_values_to_bytes(job.hash_values, node);
+			} else {
+				sha256_64(input, node);
+			}
+		}
+
+		count = (count + 1)/2;
+		index >>= 1;
+	}
+
+	return used == proof_length ? 0 : -1;
+}
+
+//Verifies the inclusion proof of a leaf at position index of a tree with leaf_count leaves.
+//Returns 1 if the proof leads to root, 0 otherwise.
+int sha256_merkle_verify(const unsigned char *leaf, size_t leaf_size, size_t index, size_t leaf_count, const unsigned char (*proof)[32],
+	size_t proof_length, const struct sha256_merkle_config *config, const unsigned char root[32]){
+	unsigned char node[32];
+
+	if(index >= leaf_count){
+		return 0;
+	}
+
+	sha256_merkle_leaf_hash(leaf, leaf_size, config, node);
+
+	if(sha256_merkle_proof_root(node, index, leaf_count, proof, proof_length, config)){
+		return 0;
+	}
+
+	return 0 == memcmp(node, root, 32);
+}
+
+//Verifies count proofs against the same root. The proofs are walked up in windows, one level of every
+//proof of the window at a time, so all the hashing goes through the multi-buffer engine. Sets
+//checks[c].valid and returns the number of valid proofs.
+size_t sha256_merkle_verify_batch(struct sha256_merkle_check *checks, size_t count, size_t leaf_size, size_t leaf_count,
+	const struct sha256_merkle_config *config, const unsigned char root[32]){
+	struct sha256_job jobs[SHA256_BATCH_WINDOW];
+	unsigned char *scratch = NULL;
+	size_t input_size = leaf_size + (config->domain_separation ? 1 : 0);
+	size_t valid = 0;
+
+	if(config->domain_separation){
+		scratch = malloc(SHA256_BATCH_WINDOW * input_size);
+		if(NULL == scratch){
+			sha256_error(MALLOC_ERROR);
+			for(size_t c = 0; c < count; ++c){
+				checks[c].valid = 0;
+			}
+			return 0;
+		}
+	}
+
+	for(size_t start = 0; start < count; start += SHA256_BATCH_WINDOW){
+		size_t window = count - start < SHA256_BATCH_WINDOW ? count - start : SHA256_BATCH_WINDOW;
+
+		//Leaf hashes of the whole window at once
+		for(size_t c = 0; c < window; ++c){
+			const unsigned char *leaf = checks[start + c].leaf;
+
+			if(config->domain_separation){
+				scratch[c*input_size] = config->leaf_prefix;
+				memcpy(scratch + c*input_size + 1, leaf, leaf_size);
+				leaf = scratch + c*input_size;
+			}
+			sha256_job_init(&jobs[c], sha256_default_hash_values, leaf, (uint64_t) input_size*8, 0);
+		}
+		sha256_compress_jobs(jobs, window);
+
+		//Walk the proofs up, one level of every proof of the window at a time
+		unsigned char nodes[SHA256_BATCH_WINDOW][32];
+		unsigned char inputs[SHA256_BATCH_WINDOW][65];
+		size_t used[SHA256_BATCH_WINDOW];
+		size_t index[SHA256_BATCH_WINDOW];
+		size_t node_size = config->domain_separation ? 65 : 64;
+		unsigned int bad[SHA256_BATCH_WINDOW];
+
+		for(size_t c = 0; c < window; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, nodes[c]);
+			used[c] = 0;
+			index[c] = checks[start + c].index;
+			bad[c] = index[c] >= leaf_count;
+		}
+
+		for(size_t level_count = leaf_count; level_count > 1; level_count = (level_count + 1)/2){
+			size_t jobs_count = 0;
+			size_t job_owner[SHA256_BATCH_WINDOW];
+
+			for(size_t c = 0; c < window; ++c){
+				struct sha256_merkle_check *check = &checks[start + c];
+				unsigned char *children = config->domain_separation ? inputs[c] + 1 : inputs[c];
+
+				if(bad[c] || (index[c] ^ 1) >= level_count){
+					continue;
+				}
+				if(used[c] == check->proof_length){
+					bad[c] = 1;
+					continue;
+				}
+
+				inputs[c][0] = config->node_prefix;
+				if(index[c] & 1){
+					memcpy(children, check->proof[used[c]], 32);
+					memcpy(children + 32, nodes[c], 32);
+				} else {
+					memcpy(children, nodes[c], 32);
+					memcpy(children + 32, check->proof[used[c]], 32);
+				}
+				++used[c];
+
+				sha256_job_init(&jobs[jobs_count], sha256_default_hash_values, inputs[c], (uint64_t) node_size*8, 0);
+				job_owner[jobs_count++] = c;
+			}
+
+			sha256_compress_jobs(jobs, jobs_count);
+
+			for(size_t j = 0; j < jobs_count; ++j){
+				sha256_hash_values_to_bytes(jobs[j].hash_values, nodes[job_owner[j]]);
+			}
+			for(size_t c = 0; c < window; ++c){
+				index[c] >>= 1;
+			}
+		}
+
+		for(size_t c = 0; c < window; ++c){
+			struct sha256_merkle_check *check = &checks[start + c];
+
+			check->valid = !bad[c] && used[c] == check->proof_length && 0 == memcmp(nodes[c], root, 32);
+			valid += check->valid;
+		}
+	}
+
+	free(scratch);
+
+	return valid;
+}
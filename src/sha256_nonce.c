@@ -0,0 +1,267 @@
+#include "sha256_digest.h"
+#include <pthread.h>
+#include <unistd.h>
+
+//Nonce search (proof of work, client puzzles): hashes an 80 bytes template with every nonce of a range
+//until the hash is <= a target. The first block doesn't change, so its midstate is computed once, and so
+//are the rounds of the second block before the nonce word and every schedule word (or part of one) that
+//doesn't depend on the nonce. The range is swept by the lanes of the multi-buffer kernels, which only
+//compute the first word of each hash to reject it (see sha256_nonce_scan_lanes()), and split among threads.
+
+//Nonces claimed at once by a thread
+#define SHA256_NONCE_CLAIM 65536
+
+struct sha256_nonce_job{
+	const struct sha256_nonce_config *config;
+	struct sha256_nonce_search search;
+	unsigned int width;	//Lanes of the kernel (1 = one nonce after the other)
+
+	pthread_mutex_t lock;
+	uint64_t next;	//First nonce (offset from first_nonce) nobody claimed yet
+	uint64_t best;	//Offset of the lowest accepted nonce found so far (nonce_count = none)
+	unsigned char hash[32];	//Hash of the best nonce
+	uint64_t hashes;	//Nonces tried
+};
+
+//Precomputes the search state from the template. Returns 0 if it went OK, -1 if the nonce isn't in the
+//second block or the range doesn't fit in 32 bits.
+int sha256_nonce_prepare(struct sha256_nonce_search *search, const struct sha256_nonce_config *config){
+	uint32_t schedule[64];
+	unsigned char depends[64];
+
+	if(config->nonce_offset < 64 || config->nonce_offset > 76 || config->nonce_offset % 4){
+		sha256_warning("The nonce must be a word of the second block (offset 64, 68, 72 or 76).");
+		return -1;
+	}
+	if((uint64_t) config->first_nonce + config->nonce_count > (uint64_t) UINT32_MAX + 1){
+		sha256_warning("The nonce range goes past 2^32.");
+		return -1;
+	}
+
+	memcpy(search->midstate, sha256_default_hash_values, sizeof(search->midstate));
+	sha256_compress_blocks(search->midstate, config->header, 1);
+
+	//Second block: last 16 bytes of the template with a nonce of 0, '1' bit, zeros and a length of 640 bits
+	memset(search->block, 0, sizeof(search->block));
+	memcpy(search->block, config->header + 64, 16);
+	memset(search->block + config->nonce_offset - 64, 0, 4);
+	search->block[16] = 0x80;
+	search->block[62] = 0x02;
+	search->block[63] = 0x80;
+
+	search->nonce_word = (unsigned int) (config->nonce_offset - 64)/4;
+	search->double_hash = config->double_hash;
+	search->target_word = (uint32_t) config->target[0] << 24 | (uint32_t) config->target[1] << 16 |
+		(uint32_t) config->target[2] << 8 | config->target[3];
+
+	//Schedule with a nonce of 0, and which words depend on the nonce
+	for(int j = 0; j < 16; ++j){
+		schedule[j] = (uint32_t) search->block[j*4] << 24 | (uint32_t) search->block[j*4 + 1] << 16 |
+			(uint32_t) search->block[j*4 + 2] << 8 | search->block[j*4 + 3];
+		depends[j] = (unsigned int) j == search->nonce_word;
+		search->terms[j] = 0;
+		search->partial[j] = 0;
+	}
+	for(int j = 16; j < 64; ++j){
+		uint32_t terms[4] = {SHA256_LOWSIGMA1(schedule[j - 2]), schedule[j - 7], SHA256_LOWSIGMA0(schedule[j - 15]), schedule[j - 16]};
+		unsigned char sources[4] = {depends[j - 2], depends[j - 7], depends[j - 15], depends[j - 16]};
+
+		schedule[j] = terms[0] + terms[1] + terms[2] + terms[3];
+		search->terms[j] = 0;
+		search->partial[j] = 0;
+		for(int t = 0; t < 4; ++t){
+			if(sources[t]){
+				search->terms[j] |= (unsigned char) (1 << t);
+			} else {
+				search->partial[j] += terms[t];
+			}
+		}
+		depends[j] = 0 != search->terms[j];
+	}
+	for(int j = 0; j < 64; ++j){
+		search->fixed_kw[j] = depends[j] ? 0 : sha256_default_round_constants[j] + schedule[j];
+	}
+
+	//Rounds before the nonce word
+	uint32_t *state = search->state;
+	memcpy(state, search->midstate, sizeof(search->state));
+	for(unsigned int j = 0; j < search->nonce_word; ++j){
+		uint32_t tmp1 = state[7] + SHA256_SIGMA1(state[4]) + SHA256_CH(state[4], state[5], state[6]) + search->fixed_kw[j];
+		uint32_t tmp2 = SHA256_SIGMA0(state[0]) + SHA256_MAJ(state[0], state[1], state[2]);
+
+		memmove(state + 1, state, 7*sizeof(uint32_t));
+		state[4] += tmp1;
+		state[0] = tmp1 + tmp2;
+	}
+
+	return 0;
+}
+
+//Hash of the template with the given nonce
+static void sha256_nonce_hash(const struct sha256_nonce_search *search, size_t nonce_offset, uint32_t nonce, unsigned char hash[32]){
+	unsigned char block[64];
+	uint32_t hash_values[8];
+
+	memcpy(block, search->block, sizeof(block));
+	for(int c = 0; c < 4; ++c){
+		block[nonce_offset - 64 + c] = (nonce >> (c*8)) & 0xFF;
+	}
+
+	memcpy(hash_values, search->midstate, sizeof(hash_values));
+	sha256_compress_blocks(hash_values, block, 1);
+	sha256_hash_values_to_bytes(hash_values, hash);
+
+	if(search->double_hash){
+		sha256_32(hash, hash);
+	}
+}
+
+//Looks for the lowest accepted nonce of [start, end) (offsets from first_nonce). Returns its offset, with
+//its hash, or end if there's none. tried is set to the number of nonces tried.
+static uint64_t sha256_nonce_search_range(struct sha256_nonce_job *job, uint64_t start, uint64_t end, unsigned char hash[32],
+	uint64_t *tried){
+	const struct sha256_nonce_config *config = job->config;
+	uint64_t offset = start;
+
+	while(offset < end){
+		uint32_t candidates = 1;
+
+		if(job->width > 1){
+			offset += sha256_nonce_scan_lanes(&job->search, config->first_nonce + (uint32_t) offset, end - offset, job->width, &candidates);
+			if(offset >= end){
+				break;
+			}
+		}
+
+		//Candidates still must be checked against the whole target, in order
+		for(unsigned int l = 0; candidates >> l; ++l){
+			if(candidates & (1u << l)){
+				sha256_nonce_hash(&job->search, config->nonce_offset, config->first_nonce + (uint32_t) (offset + l), hash);
+				if(memcmp(hash, config->target, 32) <= 0){
+					*tried = offset + l + 1 - start;
+					return offset + l;
+				}
+			}
+		}
+
+		offset += job->width;
+	}
+
+	*tried = end - start;
+	return end;
+}
+
+static void *sha256_nonce_worker_run(void *argument){
+	struct sha256_nonce_job *job = argument;
+	unsigned char hash[32];
+
+	for(;;){
+		//Nonces past the best one found so far aren't worth trying
+		pthread_mutex_lock(&job->lock);
+		uint64_t start = job->next;
+		uint64_t end = start + SHA256_NONCE_CLAIM < job->best ? start + SHA256_NONCE_CLAIM : job->best;
+		if(end > start){
+			job->next = end;
+		}
+		pthread_mutex_unlock(&job->lock);
+
+		if(start >= end){
+			return NULL;
+		}
+
+		uint64_t tried;
+		uint64_t found = sha256_nonce_search_range(job, start, end, hash, &tried);
+
+		pthread_mutex_lock(&job->lock);
+		job->hashes += tried;
+		if(found < end && found < job->best){
+			job->best = found;
+			memcpy(job->hash, hash, 32);
+		}
+		pthread_mutex_unlock(&job->lock);
+	}
+}
+
+//Same as sha256_nonce_search() with at most lanes lanes: 16 (AVX-512), 8 (AVX2) or 1 (one nonce after
+//the other with the single-buffer kernel). The widest kernel the CPU supports within that limit is used.
+int sha256_nonce_search_lanes(const struct sha256_nonce_config *config, struct sha256_nonce_result *result, unsigned int lanes){
+	struct sha256_nonce_job job;
+	pthread_t *workers;
+	unsigned int thread_count = config->thread_count, started;
+	uint64_t start_time = sha256_stats_now();
+
+	if(sha256_nonce_prepare(&job.search, config)){
+		return -1;
+	}
+
+	job.config = config;
+	job.width = 1;
+	job.next = 0;
+	job.best = config->nonce_count;
+	job.hashes = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int features = sha256_cpu_features();
+
+	if(lanes >= 16 && (features & SHA256_CPU_AVX512)){
+		job.width = 16;
+	} else if(lanes >= 8 && (features & SHA256_CPU_AVX2)){
+		job.width = 8;
+	}
+#else
+	(void) lanes;
+#endif
+
+	if(0 == thread_count){
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = online > 0 ? (unsigned int) online : 1;
+	}
+	if((config->nonce_count + SHA256_NONCE_CLAIM - 1)/SHA256_NONCE_CLAIM < thread_count){
+		thread_count = (unsigned int) ((config->nonce_count + SHA256_NONCE_CLAIM - 1)/SHA256_NONCE_CLAIM);
+	}
+	if(0 == thread_count){
+		thread_count = 1;
+	}
+
+	workers = malloc(thread_count * sizeof(*workers));
+	if(NULL == workers){
+		sha256_error(MALLOC_ERROR);
+		return -1;
+	}
+
+	pthread_mutex_init(&job.lock, NULL);
+
+	//The calling thread works too, a thread that can't be started only means less parallelism
+	for(started = 1; started < thread_count; ++started){
+		if(pthread_create(&workers[started], NULL, sha256_nonce_worker_run, &job)){
+			sha256_error(THREAD_ERROR);
+			break;
+		}
+	}
+
+	sha256_nonce_worker_run(&job);
+
+	for(unsigned int c = 1; c < started; ++c){
+		pthread_join(workers[c], NULL);
+	}
+
+	pthread_mutex_destroy(&job.lock);
+	free(workers);
+
+	result->hashes = job.hashes;
+	result->nanoseconds = sha256_stats_now() - start_time;
+	if(job.best == config->nonce_count){
+		return 0;
+	}
+
+	result->nonce = config->first_nonce + (uint32_t) job.best;
+	memcpy(result->hash, job.hash, 32);
+	return 1;
+}
+
+//Looks for the lowest nonce of the range whose hash is <= the target, using every multi-buffer lane and
+//thread_count threads. Returns 1 if one was found (written to result), 0 if none of the range is
+//accepted and -1 if the configuration is invalid. result always gets the nonces tried and the time spent.
+int sha256_nonce_search(const struct sha256_nonce_config *config, struct sha256_nonce_result *result){
+	return sha256_nonce_search_lanes(config, result, SHA256_MB_MAX_LANES);
+}
@@ -0,0 +1,198 @@
+#include "sha256_digest.h"
+#include <pthread.h>
+#include <unistd.h>
+
+//Parallel digest of all the messages of a sha256_base.
+//Every worker owns a deque with a range of the pending messages. It takes small pieces of work from
+//the front of its own deque and, once it runs dry, steals half of the work left on another worker's
+//deque (from the back). That way a huge message only keeps its own worker busy.
+
+//A worker takes messages from its deque until it has this many bytes (or SHA256_BATCH_WINDOW messages)
+#define SHA256_PARALLEL_PIECE_BYTES (64*1024)
+
+struct sha256_parallel_deque{
+	pthread_mutex_t lock;
+	size_t head;	//Next message to take (front)
+	size_t tail;	//One past the last message (back)
+};
+
+struct sha256_parallel_job{
+	struct sha256_base *base;
+	struct sha256_message **messages;
+	struct sha256_parallel_deque *deques;
+	unsigned int thread_count;
+};
+
+struct sha256_parallel_worker{
+	struct sha256_parallel_job *job;
+	unsigned int index;
+	pthread_t thread;
+};
+
+//Takes a piece of work from the front of the worker's own deque. Returns the number of messages taken.
+static size_t sha256_parallel_take(struct sha256_parallel_job *job, unsigned int index, size_t *first){
+	struct sha256_parallel_deque *deque = &job->deques[index];
+	uint64_t bits = 0;
+	size_t taken = 0;
+
+	pthread_mutex_lock(&deque->lock);
+	*first = deque->head;
+	while(deque->head < deque->tail && taken < SHA256_BATCH_WINDOW && bits < SHA256_PARALLEL_PIECE_BYTES*8){
+		bits += job->messages[deque->head]->bits_length;
+		++deque->head;
+		++taken;
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	return taken;
+}
+
+//Moves half of the work left on another worker's deque (from its back) to the worker's own deque.
+//Returns 0 if there was nothing left to steal.
+static int sha256_parallel_steal(struct sha256_parallel_job *job, unsigned int index){
+	for(unsigned int offset = 1; offset < job->thread_count; ++offset){
+		struct sha256_parallel_deque *victim = &job->deques[(index + offset) % job->thread_count];
+		size_t first = 0, last = 0;
+
+		pthread_mutex_lock(&victim->lock);
+		if(victim->tail > victim->head){
+			size_t stolen = (victim->tail - victim->head + 1)/2;
+
+			last = victim->tail;
+			first = victim->tail - stolen;
+			victim->tail = first;
+		}
+		pthread_mutex_unlock(&victim->lock);
+
+		if(last > first){
+			struct sha256_parallel_deque *own = &job->deques[index];
+
+			pthread_mutex_lock(&own->lock);
+			own->head = first;
+			own->tail = last;
+			pthread_mutex_unlock(&own->lock);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void *sha256_parallel_worker_run(void *argument){
+	struct sha256_parallel_worker *worker = argument;
+	struct sha256_parallel_job *job = worker->job;
+
+	for(;;){
+		size_t first;
+		size_t taken = sha256_parallel_take(job, worker->index, &first);
+
+		if(taken){
+			sha256_message_digest_batch(&job->messages[first], taken, job->base);
+		} else if(0 == sha256_parallel_steal(job, worker->index)){
+			break;	//No work left anywhere
+		}
+	}
+
+	return NULL;
+}
+
+//Digests every message of the base that wasn't digested yet, using thread_count worker threads (0 = one
+//per online CPU). Returns the number of messages digested or -1 if any error occurred (no message is
+//digested in that case).
+long sha256_digest_pending(struct sha256_base *base, unsigned int thread_count){
+	struct sha256_message **messages = NULL;
+	struct sha256_parallel_deque *deques = NULL;
+	struct sha256_parallel_worker *workers = NULL;
+	size_t count = 0, capacity = 0;
+	unsigned int started = 0;
+	long result = -1;
+
+	//Collect the pending messages (from every shard if the base is shared)
+	struct sha256_list *list;
+	for(unsigned int c = 0; NULL != (list = sha256_base_list(base, c)); ++c){
+		for(struct sha256_message *entry = list->next; NULL != entry; entry = entry->messages_list_entry.next){
+			if(entry->digested){
+				continue;
+			}
+
+			if(count == capacity){
+				size_t new_capacity = capacity ? capacity*2 : 256;
+				struct sha256_message **tmp = realloc(messages, new_capacity * sizeof(*messages));
+
+				if(NULL == tmp){
+					sha256_error(MALLOC_ERROR);
+					goto error1;
+				}
+				messages = tmp;
+				capacity = new_capacity;
+			}
+
+			messages[count++] = entry;
+		}
+	}
+
+	if(0 == count){
+		free(messages);
+		return 0;
+	}
+
+	if(0 == thread_count){
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = online > 0 ? (unsigned int) online : 1;
+	}
+	if(thread_count > count){
+		thread_count = (unsigned int) count;
+	}
+
+	//A single worker doesn't need any thread
+	if(1 == thread_count){
+		sha256_message_digest_batch(messages, count, base);
+		free(messages);
+		return (long) count;
+	}
+
+	deques = malloc(thread_count * sizeof(*deques));
+	workers = malloc(thread_count * sizeof(*workers));
+
+	if(NULL == deques || NULL == workers){
+		sha256_error(MALLOC_ERROR);
+		goto error1;
+	}
+
+	struct sha256_parallel_job job = {base, messages, deques, thread_count};
+
+	//Every worker starts with a contiguous range of the messages
+	for(unsigned int c = 0; c < thread_count; ++c){
+		pthread_mutex_init(&deques[c].lock, NULL);
+		deques[c].head = count * c / thread_count;
+		deques[c].tail = count * (c + 1) / thread_count;
+		workers[c].job = &job;
+		workers[c].index = c;
+	}
+
+	//The calling thread works as worker 0
+	for(started = 1; started < thread_count; ++started){
+		if(pthread_create(&workers[started].thread, NULL, sha256_parallel_worker_run, &workers[started])){
+			sha256_error(THREAD_ERROR);
+			break;	//The workers already running (at least this one) will steal the work of the missing ones
+		}
+	}
+
+	sha256_parallel_worker_run(&workers[0]);
+
+	for(unsigned int c = 1; c < started; ++c){
+		pthread_join(workers[c].thread, NULL);
+	}
+
+	for(unsigned int c = 0; c < thread_count; ++c){
+		pthread_mutex_destroy(&deques[c].lock);
+	}
+
+	result = (long) count;
+
+error1:
+	free(workers);
+	free(deques);
+	free(messages);
+	return result;
+}
@@ -0,0 +1,299 @@
+#include "sha256_digest.h"
+
+//PBKDF2-HMAC-SHA256 (RFC 8018) on top of the HMAC key midstates. Every block of the derived key is
+//a chain of HMACs of 32 bytes messages, so each iteration is just two compressions of a hash plus
+//constant padding. Blocks (of one key or of many derivations) are run side by side on the lanes of the
+//multi-buffer engine, which keeps the chains in vector registers (see sha256_hmac_chain_lanes()).
+
+//Second half of the inner and outer blocks of an iteration: '1' bit, zeros and a length of 768 bits
+//(the 64 bytes key block plus the 32 bytes message)
+static const unsigned char sha256_pbkdf2_padding[32] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x03, 0x00};
+
+//Next block to derive, walking the jobs in order
+struct sha256_pbkdf2_cursor{
+	struct sha256_pbkdf2_job *jobs;
+	size_t count;
+	size_t job;	//Job of the next block
+	uint32_t block;	//Index of the next block in its key (from 1, as in the specification)
+	struct sha256_hmac_key key;	//HMAC key of jobs[job]
+};
+
+//Block being derived on a lane
+struct sha256_pbkdf2_lane{
+	struct sha256_pbkdf2_job *job;	//NULL = idle lane
+	uint32_t block;
+	uint64_t iterations_left;
+};
+
+//Runs iterations steps of one chain: u = HMAC(key, u), t ^= u
+static void sha256_pbkdf2_chain(const struct sha256_hmac_key *key, uint32_t u[8], uint32_t t[8], uint64_t iterations){
+	unsigned char block[64];
+	uint32_t inner[8];
+
+#if defined(__x86_64__) || defined(__i386__)
+	if(sha256_cpu_features() & SHA256_CPU_SHANI){
+		sha256_hmac_chain_shani(key, u, t, iterations);
+		return;
+	}
+#endif
+
+	memcpy(block + 32, sha256_pbkdf2_padding, 32);
+
+	for(uint64_t c = 0; c < iterations; ++c){
+		sha256_hash_values_to_bytes(u, block);
+		memcpy(inner, key->inner.hash_values, sizeof(inner));
+		sha256_compress_blocks(inner, block, 1);
+
+		sha256_hash_values_to_bytes(inner, block);
+		memcpy(u, key->outer.hash_values, 8*sizeof(uint32_t));
+		sha256_compress_blocks(u, block, 1);
+
+		for(int n = 0; n < 8; ++n){
+			t[n] ^= u[n];
+		}
+	}
+
+	sha256_wipe(block, sizeof(block));
+	sha256_wipe(inner, sizeof(inner));
+}
+
+//First HMAC of a block's chain: U1 = HMAC(password, salt || big-endian block index), as hash values
+static void sha256_pbkdf2_first(const struct sha256_hmac_key *key, const struct sha256_pbkdf2_job *job, uint32_t block, uint32_t u[8]){
+	struct sha256_hmac_context context;
+	unsigned char index[4] = {block >> 24, (block >> 16) & 0xFF, (block >> 8) & 0xFF, block & 0xFF};
+	unsigned char mac[32];
+
+	sha256_hmac_init(&context, key);
+	sha256_hmac_update(&context, job->salt, job->salt_length);
+	sha256_hmac_update(&context, index, sizeof(index));
+	sha256_hmac_final(&context, mac);
+
+	for(int n = 0; n < 8; ++n){
+		u[n] = (uint32_t) mac[n*4] << 24 | (uint32_t) mac[n*4 + 1] << 16 | (uint32_t) mac[n*4 + 2] << 8 | mac[n*4 + 3];
+	}
+	sha256_wipe(mac, sizeof(mac));
+	sha256_wipe(&context, sizeof(context));
+}
+
+//Writes the finished block t to its place in the job's key (the last block may be cut short)
+static void sha256_pbkdf2_output(struct sha256_pbkdf2_job *job, uint32_t block, const uint32_t t[8]){
+	unsigned char bytes[32];
+	size_t offset = (size_t) (block - 1)*32;
+	size_t length = job->key_length - offset < 32 ? job->key_length - offset : 32;
+
+	sha256_hash_values_to_bytes(t, bytes);
+	memcpy(job->key + offset, bytes, length);
+	sha256_wipe(bytes, sizeof(bytes));
+}
+
+//Hands out the next block, setting its job, index and U1. Returns 0 once there are no more blocks.
+static int sha256_pbkdf2_next(struct sha256_pbkdf2_cursor *cursor, struct sha256_pbkdf2_job **job, uint32_t *block, uint32_t u[8]){
+	while(cursor->job < cursor->count){
+		struct sha256_pbkdf2_job *current = &cursor->jobs[cursor->job];
+
+		if((uint64_t) (cursor->block - 1)*32 >= current->key_length){
+			++cursor->job;
+			cursor->block = 1;
+			continue;
+		}
+
+		//First block of the job: its key midstates
+		if(1 == cursor->block){
+			sha256_hmac_key_init(&cursor->key, current->password, current->password_length);
+		}
+
+		*job = current;
+		*block = cursor->block++;
+		sha256_pbkdf2_first(&cursor->key, current, *block, u);
+		return 1;
+	}
+
+	return 0;
+}
+
+//Puts the next block on lane l, or leaves it idle if there are no more blocks
+static void sha256_pbkdf2_lane_assign(struct sha256_pbkdf2_lane *lane, unsigned int l, struct sha256_hmac_lanes *lanes,
+	struct sha256_pbkdf2_cursor *cursor){
+	uint32_t u[8];
+
+	if(0 == sha256_pbkdf2_next(cursor, &lane->job, &lane->block, u)){
+		lane->job = NULL;
+		return;
+	}
+
+	lane->iterations_left = lane->job->iterations - 1;
+	for(int n = 0; n < 8; ++n){
+		lanes->inner[n][l] = cursor->key.inner.hash_values[n];
+		lanes->outer[n][l] = cursor->key.outer.hash_values[n];
+		lanes->u[n][l] = u[n];
+		lanes->t[n][l] = u[n];
+	}
+}
+
+//Derives the blocks on width lanes of the multi-buffer engine. The chains run in lockstep up to the
+//first one that finishes, whose lane then takes the next block.
+static void sha256_pbkdf2_run(struct sha256_pbkdf2_cursor *cursor, unsigned int width){
+	struct sha256_hmac_lanes lanes;
+	struct sha256_pbkdf2_lane lane[SHA256_MB_MAX_LANES];
+	unsigned int active = 0;
+	int more = 1;
+
+	memset(&lanes, 0, sizeof(lanes));
+
+	for(unsigned int l = 0; l < width; ++l){
+		sha256_pbkdf2_lane_assign(&lane[l], l, &lanes, cursor);
+		if(lane[l].job){
+			++active;
+		} else {
+			more = 0;
+		}
+	}
+
+	//Like the multi-buffer scheduler, the last few chains are finished one at a time
+	while(active > 0 && (more || active*4 > width)){
+		uint64_t steps = UINT64_MAX;
+
+		for(unsigned int l = 0; l < width; ++l){
+			if(lane[l].job && lane[l].iterations_left < steps){
+				steps = lane[l].iterations_left;
+			}
+		}
+
+		if(steps){
+			sha256_hmac_chain_lanes(&lanes, width, steps);
+		}
+
+		for(unsigned int l = 0; l < width; ++l){
+			if(NULL == lane[l].job){
+				continue;
+			}
+
+			lane[l].iterations_left -= steps;
+			if(0 == lane[l].iterations_left){
+				uint32_t t[8];
+
+				for(int n = 0; n < 8; ++n){
+					t[n] = lanes.t[n][l];
+				}
+				sha256_pbkdf2_output(lane[l].job, lane[l].block, t);
+
+				if(more){
+					sha256_pbkdf2_lane_assign(&lane[l], l, &lanes, cursor);
+				} else {
+					lane[l].job = NULL;
+				}
+				if(NULL == lane[l].job){
+					more = 0;
+					--active;
+				}
+			}
+		}
+	}
+
+	for(unsigned int l = 0; l < width; ++l){
+		if(lane[l].job){
+			struct sha256_hmac_key key;
+			uint32_t u[8], t[8];
+
+			for(int n = 0; n < 8; ++n){
+				key.inner.hash_values[n] = lanes.inner[n][l];
+				key.outer.hash_values[n] = lanes.outer[n][l];
+				u[n] = lanes.u[n][l];
+				t[n] = lanes.t[n][l];
+			}
+			sha256_pbkdf2_chain(&key, u, t, lane[l].iterations_left);
+			sha256_pbkdf2_output(lane[l].job, lane[l].block, t);
+			sha256_wipe(&key, sizeof(key));
+			sha256_wipe(u, sizeof(u));
+			sha256_wipe(t, sizeof(t));
+		}
+	}
+
+	sha256_wipe(&lanes, sizeof(lanes));
+}
+
+//Checks the jobs, returning the number of blocks to derive or -1 if a job is invalid
+static long long sha256_pbkdf2_blocks(const struct sha256_pbkdf2_job *jobs, size_t count){
+	long long blocks = 0;
+
+	for(size_t c = 0; c < count; ++c){
+		if(0 == jobs[c].iterations){
+			sha256_warning("PBKDF2 needs at least one iteration.");
+			return -1;
+		}
+		if((uint64_t) jobs[c].key_length > (uint64_t) UINT32_MAX*32){
+			sha256_warning("The derived key is too long for PBKDF2.");
+			return -1;
+		}
+		blocks += (long long) ((jobs[c].key_length + 31)/32);
+	}
+
+	return blocks;
+}
+
+//Derives the keys of count jobs on at most lanes lanes: 16 (AVX-512), 8 (AVX2) or 1 (one chain after
+//the other with the single-buffer kernel). The widest kernel the CPU supports within that limit is used.
+//Returns 0 if it went OK, -1 if a job is invalid (no key is derived then).
+int sha256_pbkdf2_lanes(struct sha256_pbkdf2_job *jobs, size_t count, unsigned int lanes){
+	struct sha256_pbkdf2_cursor cursor = {jobs, count, 0, 1, {{{0}, 0}, {{0}, 0}}};
+	long long blocks = sha256_pbkdf2_blocks(jobs, count);
+	unsigned int width = 1;
+
+	if(blocks < 0){
+		return -1;
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int features = sha256_cpu_features();
+
+	if(blocks > 1 && lanes >= 16 && (features & SHA256_CPU_AVX512)){
+		width = 16;
+	} else if(blocks > 1 && lanes >= 8 && (features & SHA256_CPU_AVX2)){
+		width = 8;
+	}
+#else
+	(void) lanes;
+#endif
+
+	if(width > 1){
+		sha256_pbkdf2_run(&cursor, width);
+	} else {
+		struct sha256_pbkdf2_job *job;
+		uint32_t block, u[8], t[8];
+
+		while(sha256_pbkdf2_next(&cursor, &job, &block, u)){
+			memcpy(t, u, sizeof(t));
+			sha256_pbkdf2_chain(&cursor.key, u, t, job->iterations - 1);
+			sha256_pbkdf2_output(job, block, t);
+		}
+		sha256_wipe(u, sizeof(u));
+		sha256_wipe(t, sizeof(t));
+	}
+
+	//Don't leave key material on the stack
+	sha256_wipe(&cursor.key, sizeof(cursor.key));
+
+	return 0;
+}
+
+//Derives the keys of count jobs (independent derivations, e.g. checking many credentials at once)
+int sha256_pbkdf2_batch(struct sha256_pbkdf2_job *jobs, size_t count){
+	unsigned int features = sha256_cpu_features();
+
+	//A single chain on the SHA extensions is faster than 8 AVX2 lanes, only AVX-512 beats it
+	if((features & SHA256_CPU_SHANI) && 0 == (features & SHA256_CPU_AVX512)){
+		return sha256_pbkdf2_lanes(jobs, count, 1);
+	}
+
+	return sha256_pbkdf2_lanes(jobs, count, SHA256_MB_MAX_LANES);
+}
+
+//Derives key_length bytes of key from the password and salt. The blocks of a long key are derived side
+//by side. Returns 0 if it went OK, -1 if the arguments are invalid.
+int sha256_pbkdf2(const void *password, size_t password_length, const void *salt, size_t salt_length, uint64_t iterations,
+	unsigned char *key, size_t key_length){
+	struct sha256_pbkdf2_job job = {password, password_length, salt, salt_length, iterations, key, key_length};
+
+	return sha256_pbkdf2_batch(&job, 1);
+}
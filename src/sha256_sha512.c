@@ -0,0 +1,557 @@
+#include "sha256_digest.h"
+
+//SHA-512 compression core (128 bytes blocks, 80 rounds on 64-bit words) and SHA-512/256, its variant
+//with its own initial hash values and the hash truncated to 32 bytes. On 64-bit cores without SHA-NI it
+//hashes more bytes per round than SHA-256, and its hash fits in the same places a SHA-256 hash does, so
+//a base can use it for all its messages and contexts (see sha256_base_set_algorithm()).
+//It has the same kernel tiers as SHA-256, except for SHA-NI: a scalar kernel and multi-buffer kernels
+//with 4 (AVX2) or 8 (AVX-512) jobs in the 64-bit lanes of the vector registers.
+
+//Maximum number of lanes of any kernel
+#define SHA512_MB_MAX_LANES 8
+
+//SHA-512 round constants (first 64 bits of the fractional part of the cube root of the first 80 primes)
+const uint64_t sha512_round_constants[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+
+//SHA-512/256 initial hash values (FIPS 180-4, 5.3.6.2)
+const uint64_t sha512_256_hash_values[8] = {0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL, 0x2393b86b6f53b151ULL,
+	0x963877195940eabdULL, 0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL, 0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL};
+
+//Makes every message and context of the base use the given SHA256_ALGORITHM_*. The base must not have
+//messages yet, and its cache (if any) is cleared, since the cached digests belong to the old algorithm.
+//Returns 0 if it went OK, -1 if any error occurred.
+int sha256_base_set_algorithm(struct sha256_base *base, int algorithm){
+	struct sha256_list *list;
+
+	if(SHA256_ALGORITHM_SHA256 != algorithm && SHA256_ALGORITHM_SHA512_256 != algorithm){
+		sha256_warning("Unknown algorithm.");
+		return -1;
+	}
+
+	for(unsigned int c = 0; NULL != (list = sha256_base_list(base, c)); ++c){
+		if(NULL != list->next){
+			sha256_warning("The algorithm can't be changed once the base has messages.");
+			return -1;
+		}
+	}
+
+	if(base->algorithm != algorithm){
+		base->algorithm = algorithm;
+		sha256_cache_clear(base);
+	}
+
+	return 0;
+}
+
+//SCALAR KERNEL:
+#define SHA512_ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define SHA512_CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define SHA512_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA512_SIGMA0(x) (SHA512_ROTR(x, 28) ^ SHA512_ROTR(x, 34) ^ SHA512_ROTR(x, 39))
+#define SHA512_SIGMA1(x) (SHA512_ROTR(x, 14) ^ SHA512_ROTR(x, 18) ^ SHA512_ROTR(x, 41))
+#define SHA512_LOWSIGMA0(x) (SHA512_ROTR(x, 1) ^ SHA512_ROTR(x, 8) ^ ((x) >> 7))
+#define SHA512_LOWSIGMA1(x) (SHA512_ROTR(x, 19) ^ SHA512_ROTR(x, 61) ^ ((x) >> 6))
+
+//One round, the same as SHA256_ROUND() (callers rotate the names of the working variables)
+#define SHA512_ROUND(a,b,c,d,e,f,g,h,kw) do{ \
+		uint64_t round_tmp = (h) + SHA512_SIGMA1(e) + SHA512_CH(e, f, g) + (kw); \
+		(d) += round_tmp; \
+		(h) = round_tmp + SHA512_SIGMA0(a) + SHA512_MAJ(a, b, c); \
+	} while(0)
+
+#define SHA512_ROUNDS_8(i, W) \
+	SHA512_ROUND(a, b, c, d, e, f, g, h, W((i) + 0)); \
+	SHA512_ROUND(h, a, b, c, d, e, f, g, W((i) + 1)); \
+	SHA512_ROUND(g, h, a, b, c, d, e, f, W((i) + 2)); \
+	SHA512_ROUND(f, g, h, a, b, c, d, e, W((i) + 3)); \
+	SHA512_ROUND(e, f, g, h, a, b, c, d, W((i) + 4)); \
+	SHA512_ROUND(d, e, f, g, h, a, b, c, W((i) + 5)); \
+	SHA512_ROUND(c, d, e, f, g, h, a, b, W((i) + 6)); \
+	SHA512_ROUND(b, c, d, e, f, g, h, a, W((i) + 7))
+
+static uint64_t sha512_load_word(const unsigned char *bytes){
+	uint64_t word = 0;
+
+	for(int c = 0; c < 8; ++c){
+		word = (word << 8) | bytes[c];
+	}
+
+	return word;
+}
+
+//Compresses number_of_blocks consecutive 1024-bit blocks (already padded) into the given hash values.
+//Unrolled like the SHA-256 scalar kernel, with the schedule on a ring of 16 words.
+void sha512_compress_blocks(uint64_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks){
+#define SCALAR_LOAD_KW(i) ((w[i] = sha512_load_word(block + (i)*8)) + sha512_round_constants[i])
+#define SCALAR_NEXT_KW(i) ((w[(i) & 15] += SHA512_LOWSIGMA1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] \
+	+ SHA512_LOWSIGMA0(w[((i) - 15) & 15])) + sha512_round_constants[i])
+
+	for(uint64_t chunk = 0; chunk < number_of_blocks; ++chunk){
+		const unsigned char *block = blocks + chunk*128;
+		uint64_t w[16];
+		uint64_t a = hash_values[0], b = hash_values[1], c = hash_values[2], d = hash_values[3];
+		uint64_t e = hash_values[4], f = hash_values[5], g = hash_values[6], h = hash_values[7];
+
+		SHA512_ROUNDS_8(0, SCALAR_LOAD_KW);
+		SHA512_ROUNDS_8(8, SCALAR_LOAD_KW);
+		SHA512_ROUNDS_8(16, SCALAR_NEXT_KW);
+		SHA512_ROUNDS_8(24, SCALAR_NEXT_KW);
+		SHA512_ROUNDS_8(32, SCALAR_NEXT_KW);
+		SHA512_ROUNDS_8(40, SCALAR_NEXT_KW);
+		SHA512_ROUNDS_8(48, SCALAR_NEXT_KW);
+		SHA512_ROUNDS_8(56, SCALAR_NEXT_KW);
+		SHA512_ROUNDS_8(64, SCALAR_NEXT_KW);
+		SHA512_ROUNDS_8(72, SCALAR_NEXT_KW);
+
+		hash_values[0] += a;
+		hash_values[1] += b;
+		hash_values[2] += c;
+		hash_values[3] += d;
+		hash_values[4] += e;
+		hash_values[5] += f;
+		hash_values[6] += g;
+		hash_values[7] += h;
+	}
+
+#undef SCALAR_LOAD_KW
+#undef SCALAR_NEXT_KW
+}
+
+//MULTI-BUFFER KERNELS:
+//Compresses one block per lane. state is transposed: state[word][lane].
+typedef void (*sha512_mb_kernel)(uint64_t state[8][SHA512_MB_MAX_LANES], const unsigned char *const blocks[SHA512_MB_MAX_LANES]);
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+//Reads the 16 big-endian words of the blocks of count lanes, transposed: words[t][lane]
+static void sha512_mb_load_words(uint64_t words[16][SHA512_MB_MAX_LANES], const unsigned char *const blocks[SHA512_MB_MAX_LANES], unsigned int count){
+	for(unsigned int l = 0; l < count; ++l){
+		for(int t = 0; t < 16; ++t){
+			uint64_t word;
+
+			memcpy(&word, blocks[l] + t*8, 8);
+			words[t][l] = __builtin_bswap64(word);
+		}
+	}
+}
+
+//AVX2 helpers (4 lanes)
+#define AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define AVX2_ADD(x, y) _mm256_add_epi64(x, y)
+#define AVX2_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define AVX2_CH(x, y, z) _mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define AVX2_MAJ(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)))
+#define AVX2_SIGMA0(x) AVX2_XOR3(AVX2_ROTR(x, 28), AVX2_ROTR(x, 34), AVX2_ROTR(x, 39))
+#define AVX2_SIGMA1(x) AVX2_XOR3(AVX2_ROTR(x, 14), AVX2_ROTR(x, 18), AVX2_ROTR(x, 41))
+#define AVX2_LOWSIGMA0(x) AVX2_XOR3(AVX2_ROTR(x, 1), AVX2_ROTR(x, 8), _mm256_srli_epi64(x, 7))
+#define AVX2_LOWSIGMA1(x) AVX2_XOR3(AVX2_ROTR(x, 19), AVX2_ROTR(x, 61), _mm256_srli_epi64(x, 6))
+
+#define AVX2_ROUND(a, b, c, d, e, f, g, h, j) \
+	if((j) >= 16){ \
+		w[(j) & 15] = AVX2_ADD(AVX2_ADD(AVX2_LOWSIGMA1(w[((j) - 2) & 15]), w[((j) - 7) & 15]), \
+			AVX2_ADD(AVX2_LOWSIGMA0(w[((j) - 15) & 15]), w[(j) & 15])); \
+	} \
+	tmp1 = AVX2_ADD(AVX2_ADD(AVX2_ADD(h, AVX2_SIGMA1(e)), AVX2_CH(e, f, g)), \
+		AVX2_ADD(_mm256_set1_epi64x((long long) sha512_round_constants[j]), w[(j) & 15])); \
+	tmp2 = AVX2_ADD(AVX2_SIGMA0(a), AVX2_MAJ(a, b, c)); \
+	d = AVX2_ADD(d, tmp1); \
+	h = AVX2_ADD(tmp1, tmp2)
+
+__attribute__((target("avx2")))
+static void sha512_mb_kernel_avx2(uint64_t state[8][SHA512_MB_MAX_LANES], const unsigned char *const blocks[SHA512_MB_MAX_LANES]){
+	uint64_t words[16][SHA512_MB_MAX_LANES];
+	__m256i w[16], tmp1, tmp2;
+	__m256i a, b, c, d, e, f, g, h;
+
+	sha512_mb_load_words(words, blocks, 4);
+	for(int t = 0; t < 16; ++t){
+		w[t] = _mm256_loadu_si256((const __m256i *) words[t]);
+	}
+
+	a = _mm256_loadu_si256((const __m256i *) state[0]);
+	b = _mm256_loadu_si256((const __m256i *) state[1]);
+	c = _mm256_loadu_si256((const __m256i *) state[2]);
+	d = _mm256_loadu_si256((const __m256i *) state[3]);
+	e = _mm256_loadu_si256((const __m256i *) state[4]);
+	f = _mm256_loadu_si256((const __m256i *) state[5]);
+	g = _mm256_loadu_si256((const __m256i *) state[6]);
+	h = _mm256_loadu_si256((const __m256i *) state[7]);
+
+	for(int j = 0; j < 80; j += 8){
+		AVX2_ROUND(a, b, c, d, e, f, g, h, j);
+		AVX2_ROUND(h, a, b, c, d, e, f, g, j + 1);
+		AVX2_ROUND(g, h, a, b, c, d, e, f, j + 2);
+		AVX2_ROUND(f, g, h, a, b, c, d, e, j + 3);
+		AVX2_ROUND(e, f, g, h, a, b, c, d, j + 4);
+		AVX2_ROUND(d, e, f, g, h, a, b, c, j + 5);
+		AVX2_ROUND(c, d, e, f, g, h, a, b, j + 6);
+		AVX2_ROUND(b, c, d, e, f, g, h, a, j + 7);
+	}
+
+	_mm256_storeu_si256((__m256i *) state[0], AVX2_ADD(a, _mm256_loadu_si256((const __m256i *) state[0])));
+	_mm256_storeu_si256((__m256i *) state[1], AVX2_ADD(b, _mm256_loadu_si256((const __m256i *) state[1])));
+	_mm256_storeu_si256((__m256i *) state[2], AVX2_ADD(c, _mm256_loadu_si256((const __m256i *) state[2])));
+	_mm256_storeu_si256((__m256i *) state[3], AVX2_ADD(d, _mm256_loadu_si256((const __m256i *) state[3])));
+	_mm256_storeu_si256((__m256i *) state[4], AVX2_ADD(e, _mm256_loadu_si256((const __m256i *) state[4])));
+	_mm256_storeu_si256((__m256i *) state[5], AVX2_ADD(f, _mm256_loadu_si256((const __m256i *) state[5])));
+	_mm256_storeu_si256((__m256i *) state[6], AVX2_ADD(g, _mm256_loadu_si256((const __m256i *) state[6])));
+	_mm256_storeu_si256((__m256i *) state[7], AVX2_ADD(h, _mm256_loadu_si256((const __m256i *) state[7])));
+}
+
+//AVX-512 helpers (8 lanes, native rotations and ternary logic)
+#define AVX512_ADD(x, y) _mm512_add_epi64(x, y)
+#define AVX512_XOR3(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0x96)
+#define AVX512_CH(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0xCA)
+#define AVX512_MAJ(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0xE8)
+#define AVX512_SIGMA0(x) AVX512_XOR3(_mm512_ror_epi64(x, 28), _mm512_ror_epi64(x, 34), _mm512_ror_epi64(x, 39))
+#define AVX512_SIGMA1(x) AVX512_XOR3(_mm512_ror_epi64(x, 14), _mm512_ror_epi64(x, 18), _mm512_ror_epi64(x, 41))
+#define AVX512_LOWSIGMA0(x) AVX512_XOR3(_mm512_ror_epi64(x, 1), _mm512_ror_epi64(x, 8), _mm512_srli_epi64(x, 7))
+#define AVX512_LOWSIGMA1(x) AVX512_XOR3(_mm512_ror_epi64(x, 19), _mm512_ror_epi64(x, 61), _mm512_srli_epi64(x, 6))
+
+#define AVX512_ROUND(a, b, c, d, e, f, g, h, j) \
+	if((j) >= 16){ \
+		w[(j) & 15] = AVX512_ADD(AVX512_ADD(AVX512_LOWSIGMA1(w[((j) - 2) & 15]), w[((j) - 7) & 15]), \
+			AVX512_ADD(AVX512_LOWSIGMA0(w[((j) - 15) & 15]), w[(j) & 15])); \
+	} \
+	tmp1 = AVX512_ADD(AVX512_ADD(AVX512_ADD(h, AVX512_SIGMA1(e)), AVX512_CH(e, f, g)), \
+		AVX512_ADD(_mm512_set1_epi64((long long) sha512_round_constants[j]), w[(j) & 15])); \
+	tmp2 = AVX512_ADD(AVX512_SIGMA0(a), AVX512_MAJ(a, b, c)); \
+	d = AVX512_ADD(d, tmp1); \
+	h = AVX512_ADD(tmp1, tmp2)
+
+__attribute__((target("avx512f")))
+static void sha512_mb_kernel_avx512(uint64_t state[8][SHA512_MB_MAX_LANES], const unsigned char *const blocks[SHA512_MB_MAX_LANES]){
+	uint64_t words[16][SHA512_MB_MAX_LANES];
+	__m512i w[16], tmp1, tmp2;
+	__m512i a, b, c, d, e, f, g, h;
+
+	sha512_mb_load_words(words, blocks, 8);
+	for(int t = 0; t < 16; ++t){
+		w[t] = _mm512_loadu_si512(words[t]);
+	}
+
+	a = _mm512_loadu_si512(state[0]);
+	b = _mm512_loadu_si512(state[1]);
+	c = _mm512_loadu_si512(state[2]);
+	d = _mm512_loadu_si512(state[3]);
+	e = _mm512_loadu_si512(state[4]);
+	f = _mm512_loadu_si512(state[5]);
+	g = _mm512_loadu_si512(state[6]);
+	h = _mm512_loadu_si512(state[7]);
+
+	for(int j = 0; j < 80; j += 8){
+		AVX512_ROUND(a, b, c, d, e, f, g, h, j);
+		AVX512_ROUND(h, a, b, c, d, e, f, g, j + 1);
+		AVX512_ROUND(g, h, a, b, c, d, e, f, j + 2);
+		AVX512_ROUND(f, g, h, a, b, c, d, e, j + 3);
+		AVX512_ROUND(e, f, g, h, a, b, c, d, j + 4);
+		AVX512_ROUND(d, e, f, g, h, a, b, c, j + 5);
+		AVX512_ROUND(c, d, e, f, g, h, a, b, j + 6);
+		AVX512_ROUND(b, c, d, e, f, g, h, a, j + 7);
+	}
+
+	_mm512_storeu_si512(state[0], AVX512_ADD(a, _mm512_loadu_si512(state[0])));
+	_mm512_storeu_si512(state[1], AVX512_ADD(b, _mm512_loadu_si512(state[1])));
+	_mm512_storeu_si512(state[2], AVX512_ADD(c, _mm512_loadu_si512(state[2])));
+	_mm512_storeu_si512(state[3], AVX512_ADD(d, _mm512_loadu_si512(state[3])));
+	_mm512_storeu_si512(state[4], AVX512_ADD(e, _mm512_loadu_si512(state[4])));
+	_mm512_storeu_si512(state[5], AVX512_ADD(f, _mm512_loadu_si512(state[5])));
+	_mm512_storeu_si512(state[6], AVX512_ADD(g, _mm512_loadu_si512(state[6])));
+	_mm512_storeu_si512(state[7], AVX512_ADD(h, _mm512_loadu_si512(state[7])));
+}
+#endif
+
+//Lane bookkeeping for the scheduler (see sha256_mb.c, this one is the same with SHA-512 jobs)
+struct sha512_mb_lane{
+	struct sha512_job *job;	//Job being compressed (NULL = idle lane)
+	const unsigned char *next_block;	//Next block to feed the lane
+	uint64_t data_blocks_left;	//Blocks left on job->blocks
+	unsigned int tail_blocks_left;	//Blocks left on job->tail
+};
+
+//Puts the next non-empty job on the lane, or leaves it idle if there are no more jobs
+static void sha512_mb_lane_assign(struct sha512_mb_lane *lane, unsigned int lane_index, uint64_t state[8][SHA512_MB_MAX_LANES],
+	struct sha512_job *jobs, size_t count, size_t *next_job){
+	lane->job = NULL;
+
+	while(*next_job < count){
+		struct sha512_job *job = &jobs[(*next_job)++];
+
+		if(0 == job->number_of_blocks && 0 == job->tail_blocks){
+			continue;
+		}
+
+		lane->job = job;
+		lane->next_block = job->blocks;
+		lane->data_blocks_left = job->number_of_blocks;
+		lane->tail_blocks_left = job->tail_blocks;
+		for(int n = 0; n < 8; ++n){
+			state[n][lane_index] = job->hash_values[n];
+		}
+		return;
+	}
+}
+
+//Runs the jobs through a multi-buffer kernel, lanes being refilled as soon as their job finishes
+static void sha512_mb_run(struct sha512_job *jobs, size_t count, unsigned int lanes, sha512_mb_kernel kernel){
+	static const unsigned char idle_block[128] = {0};
+	uint64_t state[8][SHA512_MB_MAX_LANES];
+	const unsigned char *blocks[SHA512_MB_MAX_LANES];
+	struct sha512_mb_lane lane[SHA512_MB_MAX_LANES];
+	unsigned int active = 0;
+	size_t next_job = 0;
+
+	memset(state, 0, sizeof(state));
+
+	for(unsigned int l = 0; l < lanes; ++l){
+		sha512_mb_lane_assign(&lane[l], l, state, jobs, count, &next_job);
+		if(lane[l].job){
+			++active;
+		}
+	}
+
+	//Once there are no more jobs and most lanes are idle, the scalar kernel takes the rest
+	while(active > 0 && (next_job < count || active*4 > lanes)){
+		for(unsigned int l = 0; l < lanes; ++l){
+			if(NULL == lane[l].job){
+				blocks[l] = idle_block;
+			} else if(lane[l].data_blocks_left){
+				blocks[l] = lane[l].next_block;
+				lane[l].next_block += 128;
+				--lane[l].data_blocks_left;
+			} else {
+				blocks[l] = lane[l].job->tail + (lane[l].job->tail_blocks - lane[l].tail_blocks_left)*128;
+				--lane[l].tail_blocks_left;
+			}
+		}
+
+		kernel(state, blocks);
+
+		for(unsigned int l = 0; l < lanes; ++l){
+			if(lane[l].job && 0 == lane[l].data_blocks_left && 0 == lane[l].tail_blocks_left){
+				for(int n = 0; n < 8; ++n){
+					lane[l].job->hash_values[n] = state[n][l];
+				}
+				sha512_mb_lane_assign(&lane[l], l, state, jobs, count, &next_job);
+				if(NULL == lane[l].job){
+					--active;
+				}
+			}
+		}
+	}
+
+	for(unsigned int l = 0; l < lanes; ++l){
+		if(lane[l].job){
+			struct sha512_job *job = lane[l].job;
+			unsigned int tail_done = job->tail_blocks - lane[l].tail_blocks_left;
+
+			for(int n = 0; n < 8; ++n){
+				job->hash_values[n] = state[n][l];
+			}
+			sha512_compress_blocks(job->hash_values, lane[l].next_block, lane[l].data_blocks_left);
+			sha512_compress_blocks(job->hash_values, job->tail + tail_done*128, lane[l].tail_blocks_left);
+		}
+	}
+}
+
+//Prepares a job to hash bits_length bits of data starting from the given hash values. Whole blocks are
+//read straight from data, only the last one(s) are padded (with a 128-bit length) in the job's tail.
+void sha512_job_init(struct sha512_job *job, const uint64_t hash_values[8], const void *data, uint64_t bits_length){
+	const unsigned char *data_pointer = data;
+	uint64_t remaining_bits = bits_length % 1024;
+
+	memcpy(job->hash_values, hash_values, sizeof(job->hash_values));
+	job->blocks = data_pointer;
+	job->number_of_blocks = bits_length/1024;
+
+	memset(job->tail, 0, sizeof(job->tail));
+	if(remaining_bits){
+		memcpy(job->tail, data_pointer + job->number_of_blocks*128, (size_t) ((remaining_bits + 7)/8));
+		//Remove the extra bits of a broken byte
+		if(remaining_bits % 8){
+			job->tail[remaining_bits/8] &= (unsigned char) (0xFF << (8 - remaining_bits % 8));
+		}
+	}
+
+	//Append the '1' bit and the length (its high 64 bits are always 0), using a second block if needed
+	job->tail[remaining_bits/8] |= (unsigned char) (0x80 >> (remaining_bits % 8));
+	job->tail_blocks = (remaining_bits + 129 > 1024) ? 2 : 1;
+
+	unsigned char *size_bytes = job->tail + job->tail_blocks*128 - 8;
+	for(int c = 0; c < 8; ++c){
+		size_bytes[c] = (bits_length >> (56 - c*8)) & 0xFF;
+	}
+}
+
+//Compresses the jobs with at most lanes lanes: 8 (AVX-512), 4 (AVX2) or 1 (scalar, one job after the
+//other). The widest kernel the CPU supports within that limit is used.
+void sha512_compress_jobs_lanes(struct sha512_job *jobs, size_t count, unsigned int lanes){
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int features = sha256_cpu_features();
+
+	if(count > 1 && lanes >= 8 && (features & SHA256_CPU_AVX512)){
+		sha512_mb_run(jobs, count, 8, sha512_mb_kernel_avx512);
+		return;
+	}
+	if(count > 1 && lanes >= 4 && (features & SHA256_CPU_AVX2)){
+		sha512_mb_run(jobs, count, 4, sha512_mb_kernel_avx2);
+		return;
+	}
+#else
+	(void) lanes;
+#endif
+
+	for(size_t c = 0; c < count; ++c){
+		sha512_compress_blocks(jobs[c].hash_values, jobs[c].blocks, jobs[c].number_of_blocks);
+		sha512_compress_blocks(jobs[c].hash_values, jobs[c].tail, jobs[c].tail_blocks);
+	}
+}
+
+//Compresses all the jobs with the widest kernel the CPU supports
+void sha512_compress_jobs(struct sha512_job *jobs, size_t count){
+	sha512_compress_jobs_lanes(jobs, count, SHA512_MB_MAX_LANES);
+}
+
+//Writes the first 4 hash values as the 32 bytes (big-endian) SHA-512/256 hash
+void sha512_256_hash_values_to_bytes(const uint64_t hash_values[8], unsigned char hash[32]){
+	for(int i = 0; i < 4; ++i){
+		for(int c = 0; c < 8; ++c){
+			hash[i*8 + c] = (hash_values[i] >> (56 - c*8)) & 0xFF;
+		}
+	}
+}
+
+//One-shot SHA-512/256 of length bytes of data, nothing is allocated
+void sha512_256(const void *data, size_t length, unsigned char hash[32]){
+	struct sha512_job job;
+
+	sha512_job_init(&job, sha512_256_hash_values, data, (uint64_t) length*8);
+	sha512_compress_blocks(job.hash_values, job.blocks, job.number_of_blocks);
+	sha512_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+	sha512_256_hash_values_to_bytes(job.hash_values, hash);
+}
+
+//Digests the messages of a SHA-512/256 base, a window at a time through the multi-buffer kernels.
+//Called by sha256_message_digest() and sha256_message_digest_batch() on those bases.
+void sha512_256_message_digest_batch(struct sha256_message **messages, size_t count){
+	struct sha512_job jobs[SHA256_BATCH_WINDOW];
+	struct sha256_message *window[SHA256_BATCH_WINDOW];
+	size_t index = 0;
+
+	while(index < count){
+		size_t jobs_count = 0;
+		SHA256_STATS_START(stats_start);
+
+		while(index < count && jobs_count < SHA256_BATCH_WINDOW){
+			struct sha256_message *message = messages[index++];
+
+			if(message->digested){
+				continue;
+			}
+
+			//Pre-processed messages were padded for SHA-512/256 already (see sha256_message_preprocess())
+			if(message->processed && message->preprocessed_msg){
+				memcpy(jobs[jobs_count].hash_values, sha512_256_hash_values, sizeof(jobs[jobs_count].hash_values));
+				jobs[jobs_count].blocks = message->preprocessed_msg;
+				jobs[jobs_count].number_of_blocks = message->preprocessed_bits_length/1024;
+				jobs[jobs_count].tail_blocks = 0;
+			} else {
+				sha512_job_init(&jobs[jobs_count], sha512_256_hash_values, message->msg, message->bits_length);
+			}
+
+			window[jobs_count++] = message;
+		}
+
+		sha512_compress_jobs(jobs, jobs_count);
+
+		for(size_t c = 0; c < jobs_count; ++c){
+			sha512_256_hash_values_to_bytes(jobs[c].hash_values, window[c]->hash);
+			window[c]->digested = 1;
+
+			SHA256_STATS_ADD(window[c]->base, bytes_hashed, (window[c]->bits_length + 7)/8);
+			SHA256_STATS_ADD(window[c]->base, blocks_compressed, jobs[c].number_of_blocks + jobs[c].tail_blocks);
+		}
+
+		if(jobs_count){
+			SHA256_STATS_END(window[0]->base, SHA256_PHASE_COMPRESS, stats_start);
+		}
+	}
+}
+
+//STREAMING (contexts initialized on a SHA-512/256 base, see sha256_context_update()):
+void sha512_256_context_update(struct sha256_context *context, const void *data, size_t length){
+	const unsigned char *data_pointer = data;
+
+	context->length += length;
+
+	if(context->buffered){
+		size_t missing = 128 - context->buffered;
+
+		if(length < missing){
+			memcpy(context->buffer + context->buffered, data_pointer, length);
+			context->buffered += length;
+			return;
+		}
+
+		memcpy(context->buffer + context->buffered, data_pointer, missing);
+		sha512_compress_blocks(context->wide_hash_values, context->buffer, 1);
+		context->buffered = 0;
+		data_pointer += missing;
+		length -= missing;
+	}
+
+	if(length >= 128){
+		sha512_compress_blocks(context->wide_hash_values, data_pointer, length/128);
+		data_pointer += length - length%128;
+		length %= 128;
+	}
+
+	if(length){
+		memcpy(context->buffer, data_pointer, length);
+		context->buffered = length;
+	}
+}
+
+void sha512_256_context_final(struct sha256_context *context, unsigned char hash[32]){
+	uint64_t bits_length = context->length * 8;
+
+	context->buffer[context->buffered++] = 0x80;
+
+	//Not enough room for the 128-bit length
+	if(context->buffered > 112){
+		memset(context->buffer + context->buffered, 0, 128 - context->buffered);
+		sha512_compress_blocks(context->wide_hash_values, context->buffer, 1);
+		context->buffered = 0;
+	}
+
+	memset(context->buffer + context->buffered, 0, 120 - context->buffered);
+
+	for(int c = 0; c < 8; ++c){
+		context->buffer[120 + c] = (bits_length >> (56 - c*8)) & 0xFF;
+	}
+
+	sha512_compress_blocks(context->wide_hash_values, context->buffer, 1);
+
+	sha512_256_hash_values_to_bytes(context->wide_hash_values, hash);
+}
@@ -0,0 +1,172 @@
+#include "sha256_digest.h"
+
+//Block compression using the Intel SHA extensions (sha256rnds2, sha256msg1 and sha256msg2).
+//Only built for x86, the dispatcher on sha256_digest.c only calls it if sha256_cpu_features()
+//reports SHA256_CPU_SHANI.
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+//Four rounds using the schedule words in msg (words 4*group to 4*group+3)
+#define SHANI_ROUNDS(msg, group) \
+	tmp = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i *) &sha256_default_round_constants[(group)*4])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, tmp); \
+	tmp = _mm_shuffle_epi32(tmp, 0x0E); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, tmp)
+
+//Finishes the schedule of the next group with the words of the current one
+#define SHANI_SCHEDULE(current, previous, next) \
+	next = _mm_add_epi32(next, _mm_alignr_epi8(current, previous, 4)); \
+	next = _mm_sha256msg2_epu32(next, current)
+
+//The instructions work with the state packed as ABEF/CDGH: from and to the ABCD/EFGH word order
+__attribute__((target("sha,sse4.1"), always_inline))
+static inline void sha256_shani_pack(__m128i *state0, __m128i *state1, __m128i abcd, __m128i efgh){
+	__m128i tmp = _mm_shuffle_epi32(abcd, 0xB1);	//CDAB
+
+	efgh = _mm_shuffle_epi32(efgh, 0x1B);	//EFGH
+	*state0 = _mm_alignr_epi8(tmp, efgh, 8);	//ABEF
+	*state1 = _mm_blend_epi16(efgh, tmp, 0xF0);	//CDGH
+}
+
+__attribute__((target("sha,sse4.1"), always_inline))
+static inline void sha256_shani_unpack(__m128i *abcd, __m128i *efgh, __m128i state0, __m128i state1){
+	__m128i tmp = _mm_shuffle_epi32(state0, 0x1B);	//FEBA
+
+	state1 = _mm_shuffle_epi32(state1, 0xB1);	//DCHG
+	*abcd = _mm_blend_epi16(tmp, state1, 0xF0);	//DCBA
+	*efgh = _mm_alignr_epi8(state1, tmp, 8);	//HGFE
+}
+
+//Compresses one block, given as its 16 words (msg0 holds words 0 to 3...), into the packed state
+__attribute__((target("sha,sse4.1"), always_inline))
+static inline void sha256_shani_block(__m128i *state0_pointer, __m128i *state1_pointer, __m128i msg0, __m128i msg1, __m128i msg2, __m128i msg3){
+	__m128i state0 = *state0_pointer, state1 = *state1_pointer, tmp;
+
+	SHANI_ROUNDS(msg0, 0);
+	SHANI_ROUNDS(msg1, 1);
+	msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+	SHANI_ROUNDS(msg2, 2);
+	msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+	SHANI_ROUNDS(msg3, 3);
+	SHANI_SCHEDULE(msg3, msg2, msg0);
+	msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+	//Groups 4 to 12 follow the same pattern, rotating the 4 registers
+	for(int group = 4; group < 12; group += 4){
+		SHANI_ROUNDS(msg0, group);
+		SHANI_SCHEDULE(msg0, msg3, msg1);
+		msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+		SHANI_ROUNDS(msg1, group + 1);
+		SHANI_SCHEDULE(msg1, msg0, msg2);
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+		SHANI_ROUNDS(msg2, group + 2);
+		SHANI_SCHEDULE(msg2, msg1, msg3);
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+		SHANI_ROUNDS(msg3, group + 3);
+		SHANI_SCHEDULE(msg3, msg2, msg0);
+		msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+	}
+
+	//Last groups: no more words to schedule after group 15
+	SHANI_ROUNDS(msg0, 12);
+	SHANI_SCHEDULE(msg0, msg3, msg1);
+	msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+	SHANI_ROUNDS(msg1, 13);
+	SHANI_SCHEDULE(msg1, msg0, msg2);
+	SHANI_ROUNDS(msg2, 14);
+	SHANI_SCHEDULE(msg2, msg1, msg3);
+	SHANI_ROUNDS(msg3, 15);
+
+	*state0_pointer = _mm_add_epi32(*state0_pointer, state0);
+	*state1_pointer = _mm_add_epi32(*state1_pointer, state1);
+}
+
+__attribute__((target("sha,sse4.1")))
+void sha256_compress_blocks_shani(uint32_t hash_values[8], const unsigned char *blocks, uint64_t number_of_blocks){
+	//Shuffles each 32-bit big-endian word of the message into the processor's little-endian
+	const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1;
+
+	sha256_shani_pack(&state0, &state1, _mm_loadu_si128((const __m128i *) &hash_values[0]),
+		_mm_loadu_si128((const __m128i *) &hash_values[4]));
+
+	for(uint64_t chunk = 0; chunk < number_of_blocks; ++chunk){
+		const unsigned char *chunk_pointer = blocks + chunk*64;
+
+		sha256_shani_block(&state0, &state1,
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (chunk_pointer)), byte_swap),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (chunk_pointer + 16)), byte_swap),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (chunk_pointer + 32)), byte_swap),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (chunk_pointer + 48)), byte_swap));
+	}
+
+	//Back to ABCD/EFGH
+	sha256_shani_unpack(&state0, &state1, state0, state1);
+
+	_mm_storeu_si128((__m128i *) &hash_values[0], state0);
+	_mm_storeu_si128((__m128i *) &hash_values[4], state1);
+}
+
+//One HMAC chain (PBKDF2), see sha256_hmac_chain_lanes(): iterations times u = HMAC(key, u), t ^= u. The
+//32 bytes messages are fed to the rounds straight from the registers, with constant padding.
+__attribute__((target("sha,sse4.1")))
+void sha256_hmac_chain_shani(const struct sha256_hmac_key *key, uint32_t u[8], uint32_t t[8], uint64_t iterations){
+	const __m128i padding0 = _mm_set_epi32(0, 0, 0, (int) 0x80000000), padding1 = _mm_set_epi32(768, 0, 0, 0);
+	__m128i inner0, inner1, outer0, outer1, state0, state1;
+	__m128i u0 = _mm_loadu_si128((const __m128i *) &u[0]), u1 = _mm_loadu_si128((const __m128i *) &u[4]);
+	__m128i t0 = _mm_loadu_si128((const __m128i *) &t[0]), t1 = _mm_loadu_si128((const __m128i *) &t[4]);
+
+	sha256_shani_pack(&inner0, &inner1, _mm_loadu_si128((const __m128i *) &key->inner.hash_values[0]),
+		_mm_loadu_si128((const __m128i *) &key->inner.hash_values[4]));
+	sha256_shani_pack(&outer0, &outer1, _mm_loadu_si128((const __m128i *) &key->outer.hash_values[0]),
+		_mm_loadu_si128((const __m128i *) &key->outer.hash_values[4]));
+
+	for(uint64_t c = 0; c < iterations; ++c){
+		state0 = inner0;
+		state1 = inner1;
+		sha256_shani_block(&state0, &state1, u0, u1, padding0, padding1);
+		sha256_shani_unpack(&u0, &u1, state0, state1);
+
+		state0 = outer0;
+		state1 = outer1;
+		sha256_shani_block(&state0, &state1, u0, u1, padding0, padding1);
+		sha256_shani_unpack(&u0, &u1, state0, state1);
+
+		t0 = _mm_xor_si128(t0, u0);
+		t1 = _mm_xor_si128(t1, u1);
+	}
+
+	_mm_storeu_si128((__m128i *) &u[0], u0);
+	_mm_storeu_si128((__m128i *) &u[4], u1);
+	_mm_storeu_si128((__m128i *) &t[0], t0);
+	_mm_storeu_si128((__m128i *) &t[4], t1);
+}
+
+//Compresses a block whose schedule (W[j] + K[j]) was already computed: only the round instructions
+__attribute__((target("sha,sse4.1")))
+void sha256_compress_prescheduled_shani(uint32_t hash_values[8], const uint32_t schedule[64]){
+	__m128i state0, state1, saved0, saved1, tmp;
+
+	sha256_shani_pack(&state0, &state1, _mm_loadu_si128((const __m128i *) &hash_values[0]),
+		_mm_loadu_si128((const __m128i *) &hash_values[4]));
+
+	saved0 = state0;
+	saved1 = state1;
+
+	for(int group = 0; group < 16; ++group){
+		tmp = _mm_loadu_si128((const __m128i *) &schedule[group*4]);
+		state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+		tmp = _mm_shuffle_epi32(tmp, 0x0E);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);
+	}
+
+	state0 = _mm_add_epi32(state0, saved0);
+	state1 = _mm_add_epi32(state1, saved1);
+
+	//Back to ABCD/EFGH
+	sha256_shani_unpack(&state0, &state1, state0, state1);
+
+	_mm_storeu_si128((__m128i *) &hash_values[0], state0);
+	_mm_storeu_si128((__m128i *) &hash_values[4], state1);
+}
+#endif
@@ -0,0 +1,123 @@
+#include "sha256_digest.h"
+#include <pthread.h>
+
+//Bases shared between threads. Once sha256_base_share() is called, every thread registers the messages
+//it creates on its own shard (a message list with its own lock), so threads creating and deleting
+//messages on the same base don't fight over a single list. A message can be deleted from any thread:
+//it knows its shard. The hash values and round constants are the library's read-only tables, so
+//there's nothing else in the base to protect.
+
+//Number of shards. Threads are spread round robin, past this many threads some of them share a shard.
+#define SHA256_SHARDS 64
+
+struct sha256_shard{
+	struct sha256_list messages_list_entry;	//next points to the first message and prev to the last one
+	pthread_mutex_t lock;
+} __attribute__((aligned(64)));	//A cache line each, so threads on different shards don't share lines
+
+//Next shard to hand out to a thread
+static unsigned int sha256_shard_next = 0;
+//Shard of the calling thread + 1 (0 = it didn't pick one yet)
+static __thread unsigned int sha256_thread_shard = 0;
+
+static unsigned int sha256_shard_of_thread(void){
+	if(0 == sha256_thread_shard){
+		sha256_thread_shard = __atomic_fetch_add(&sha256_shard_next, 1, __ATOMIC_RELAXED) % SHA256_SHARDS + 1;
+	}
+
+	return sha256_thread_shard - 1;
+}
+
+//Makes the base safe to use from several threads at once: creating, digesting and deleting messages.
+//It must be called before the base is handed to other threads. The messages already registered are
+//moved to the first shard. Bases with an arena can't be shared (the arena isn't thread-safe).
+//Returns 0 if it went OK, -1 if any error occurred.
+int sha256_base_share(struct sha256_base *base){
+	struct sha256_shard *shards;
+
+	if(base->shards){
+		sha256_warning("The base is already shared.");
+		return 0;
+	}
+	if(base->arena){
+		sha256_warning("A base with an arena can't be shared.");
+		return -1;
+	}
+
+	if(posix_memalign((void **) &shards, sizeof(struct sha256_shard), SHA256_SHARDS * sizeof(struct sha256_shard))){
+		sha256_error(MALLOC_ERROR);
+		return -1;
+	}
+
+	for(unsigned int c = 0; c < SHA256_SHARDS; ++c){
+		shards[c].messages_list_entry.next = NULL;
+		shards[c].messages_list_entry.prev = NULL;
+		pthread_mutex_init(&shards[c].lock, NULL);
+	}
+
+	//Hands the base's list over to the first shard
+	struct sha256_message *first = base->messages_list_entry.next;
+	if(NULL != first){
+		shards[0].messages_list_entry = base->messages_list_entry;
+		first->messages_list_entry.prev = &shards[0].messages_list_entry;
+
+		for(struct sha256_message *entry = first; NULL != entry; entry = entry->messages_list_entry.next){
+			entry->shard = 0;
+		}
+
+		base->messages_list_entry.next = NULL;
+		base->messages_list_entry.prev = NULL;
+	}
+
+	base->shards = shards;
+
+	return 0;
+}
+
+//Message lists of the base: index 0 is the base's own list, the shards (if the base is shared) come
+//next. Returns NULL past the last one.
+struct sha256_list *sha256_base_list(struct sha256_base *base, unsigned int index){
+	if(0 == index){
+		return &base->messages_list_entry;
+	}
+	if(NULL == base->shards || index > SHA256_SHARDS){
+		return NULL;
+	}
+
+	return &base->shards[index - 1].messages_list_entry;
+}
+
+//Registers a message on the calling thread's shard
+void sha256_shard_register(struct sha256_message *message, struct sha256_base *base){
+	unsigned int index = sha256_shard_of_thread();
+	struct sha256_shard *shard = &base->shards[index];
+
+	message->shard = index;
+
+	pthread_mutex_lock(&shard->lock);
+	sha256_message_link(message, &shard->messages_list_entry);
+	pthread_mutex_unlock(&shard->lock);
+}
+
+//Removes a message from its shard (whichever thread calls it)
+void sha256_shard_unlink(struct sha256_message *message, struct sha256_base *base){
+	struct sha256_shard *shard = &base->shards[message->shard];
+
+	pthread_mutex_lock(&shard->lock);
+	sha256_message_unlink(message, &shard->messages_list_entry);
+	pthread_mutex_unlock(&shard->lock);
+}
+
+//Frees the shards (their messages must be already gone). Called by sha256_free().
+void sha256_shard_destroy(struct sha256_base *base){
+	if(NULL == base->shards){
+		return;
+	}
+
+	for(unsigned int c = 0; c < SHA256_SHARDS; ++c){
+		pthread_mutex_destroy(&base->shards[c].lock);
+	}
+
+	free(base->shards);
+	base->shards = NULL;
+}
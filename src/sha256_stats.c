@@ -0,0 +1,69 @@
+#include "sha256_digest.h"
+#include <time.h>
+
+//Per base instrumentation counters. The hooks on the hot paths (SHA256_STATS_* macros) only exist when
+//the library is built with -DSHA256_STATS, the functions below are always there so the callers don't
+//need to be built differently.
+
+//Monotonic time in nanoseconds
+uint64_t sha256_stats_now(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+//Accounts a call to phase that started at start (from sha256_stats_now())
+void sha256_stats_record(struct sha256_base *base, unsigned int phase, uint64_t start){
+#ifdef SHA256_STATS
+	uint64_t elapsed = sha256_stats_now() - start;
+	unsigned int bucket = 0;
+
+	while(elapsed >> (bucket + 1) && bucket < SHA256_STATS_BUCKETS - 1){
+		++bucket;
+	}
+
+	__atomic_fetch_add(&base->stats.calls[phase], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&base->stats.nanoseconds[phase], elapsed, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&base->stats.histogram[phase][bucket], 1, __ATOMIC_RELAXED);
+#else
+	(void) base;
+	(void) phase;
+	(void) start;
+#endif
+}
+
+//Copies the base's counters to stats. Every counter is read atomically, but counters updated while
+//the snapshot is taken may be a few calls apart.
+//Returns 0 if it went OK, -1 if the library was built without SHA256_STATS (stats is zeroed).
+int sha256_stats_snapshot(struct sha256_base *base, struct sha256_stats *stats){
+#ifdef SHA256_STATS
+	const uint64_t *counters = (const uint64_t *) &base->stats;
+	uint64_t *copy = (uint64_t *) stats;
+
+	for(size_t c = 0; c < sizeof(struct sha256_stats)/sizeof(uint64_t); ++c){
+		copy[c] = __atomic_load_n(&counters[c], __ATOMIC_RELAXED);
+	}
+
+	return 0;
+#else
+	(void) base;
+	memset(stats, 0, sizeof(*stats));
+	sha256_warning("The library was built without SHA256_STATS.");
+	return -1;
+#endif
+}
+
+//Zeroes the base's counters
+void sha256_stats_reset(struct sha256_base *base){
+#ifdef SHA256_STATS
+	uint64_t *counters = (uint64_t *) &base->stats;
+
+	for(size_t c = 0; c < sizeof(struct sha256_stats)/sizeof(uint64_t); ++c){
+		__atomic_store_n(&counters[c], 0, __ATOMIC_RELAXED);
+	}
+#else
+	(void) base;
+#endif
+}
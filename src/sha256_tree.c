@@ -0,0 +1,216 @@
+#include "sha256_digest.h"
+#include <pthread.h>
+#include <unistd.h>
+
+//Chunked tree-hash mode. The input is split in chunks of chunk_size bytes (the last one may be shorter),
+//the chunks are hashed concurrently, and their digests (the manifest) are combined into a root with a
+//domain separated Merkle tree. The root also commits to the chunk size and the total length, so the same
+//bytes hashed with another chunk size give an unrelated root. This is NOT the SHA-256 of the input.
+
+//Prefixes of the Merkle tree built over the manifest, and of the final root
+#define SHA256_TREE_LEAF_PREFIX 0x00
+#define SHA256_TREE_NODE_PREFIX 0x01
+#define SHA256_TREE_ROOT_PREFIX 0x02
+
+//Chunks claimed at once by a thread (and handed together to the multi-buffer engine)
+#define SHA256_TREE_CLAIM 16
+
+struct sha256_tree_job{
+	const unsigned char *data;
+	uint64_t length;
+	size_t chunk_size;
+	size_t chunk_count;
+	unsigned char (*manifest)[32];
+
+	pthread_mutex_t lock;
+	size_t next_chunk;	//First chunk nobody claimed yet
+};
+
+//Number of chunks of an input of length bytes (an empty input still has one, empty, chunk)
+size_t sha256_tree_chunk_count(uint64_t length, size_t chunk_size){
+	if(0 == length){
+		return 1;
+	}
+	return (size_t) ((length + chunk_size - 1)/chunk_size);
+}
+
+//Hashes the chunks [first, last) of length bytes of data, writing their digests to digests[0, last - first)
+static void sha256_tree_hash_chunks(const unsigned char *data, uint64_t length, size_t chunk_size, size_t first, size_t last,
+	unsigned char (*digests)[32]){
+	struct sha256_job jobs[SHA256_TREE_CLAIM];
+
+	for(size_t start = first; start < last; start += SHA256_TREE_CLAIM){
+		size_t window = last - start < SHA256_TREE_CLAIM ? last - start : SHA256_TREE_CLAIM;
+
+		for(size_t c = 0; c < window; ++c){
+			uint64_t offset = (uint64_t) (start + c) * chunk_size;
+			uint64_t size = length - offset < chunk_size ? length - offset : chunk_size;
+
+			sha256_job_init(&jobs[c], sha256_default_hash_values, data + offset, size*8, 0);
+		}
+
+		sha256_compress_jobs(jobs, window);
+
+		for(size_t c = 0; c < window; ++c){
+			sha256_hash_values_to_bytes(jobs[c].hash_values, digests[start - first + c]);
+		}
+	}
+}
+
+static void *sha256_tree_worker_run(void *argument){
+	struct sha256_tree_job *job = argument;
+
+	for(;;){
+		pthread_mutex_lock(&job->lock);
+		size_t first = job->next_chunk;
+		size_t last = first + SHA256_TREE_CLAIM < job->chunk_count ? first + SHA256_TREE_CLAIM : job->chunk_count;
+		job->next_chunk = last;
+		pthread_mutex_unlock(&job->lock);
+
+		if(first >= last){
+			return NULL;
+		}
+
+		sha256_tree_hash_chunks(job->data, job->length, job->chunk_size, first, last, job->manifest + first);
+	}
+}
+
+//Computes the root from the manifest of an input of length bytes split in chunks of chunk_size bytes.
+//Returns 0 if it went OK, -1 otherwise.
+int sha256_tree_root(const unsigned char (*manifest)[32], uint64_t length, size_t chunk_size, unsigned int thread_count, unsigned char root[32]){
+	struct sha256_merkle_config config = {1, SHA256_TREE_LEAF_PREFIX, SHA256_TREE_NODE_PREFIX, thread_count};
+	size_t chunk_count = sha256_tree_chunk_count(length, chunk_size);
+	unsigned char input[1 + 8 + 8 + 32];
+	struct sha256_job job;
+
+	if(sha256_merkle_build((const unsigned char *) manifest, 32, chunk_count, &config, NULL, input + 17)){
+		return -1;
+	}
+
+	//Root = H(0x02 || chunk_size || length || Merkle root), sizes big endian
+	input[0] = SHA256_TREE_ROOT_PREFIX;
+	for(int c = 0; c < 8; ++c){
+		input[1 + c] = ((uint64_t) chunk_size >> (56 - c*8)) & 0xFF;
+		input[9 + c] = (length >> (56 - c*8)) & 0xFF;
+	}
+
+	sha256_job_init(&job, sha256_default_hash_values, input, sizeof(input)*8, 0);
+	sha256_compress_blocks(job.hash_values, job.blocks, job.number_of_blocks);
+	sha256_compress_blocks(job.hash_values, job.tail, job.tail_blocks);
+	sha256_hash_values_to_bytes(job.hash_values, root);
+
+	return 0;
+}
+
+//Tree-hashes length bytes of data in chunks of chunk_size bytes, using thread_count threads (0 = one per
+//online CPU). If manifest isn't NULL it must hold sha256_tree_chunk_count(length, chunk_size) digests and
+//it will hold the digest of every chunk. The root is written to root.
+//Returns 0 if it went OK, -1 if any error occurred.
+int sha256_tree_digest(const void *data, uint64_t length, size_t chunk_size, unsigned int thread_count, unsigned char (*manifest)[32],
+	unsigned char root[32]){
+	struct sha256_tree_job job;
+	pthread_t *workers = NULL;
+	unsigned int started;
+	int result = -1;
+
+	if(0 == chunk_size){
+		sha256_warning("The chunk size can't be 0");
+		return -1;
+	}
+
+	job.data = data;
+	job.length = length;
+	job.chunk_size = chunk_size;
+	job.chunk_count = sha256_tree_chunk_count(length, chunk_size);
+	job.manifest = manifest;
+	job.next_chunk = 0;
+
+	//The caller only wants the root, we still need the chunk digests
+	if(NULL == job.manifest){
+		job.manifest = malloc(job.chunk_count * 32);
+		if(NULL == job.manifest){
+			sha256_error(MALLOC_ERROR);
+			return -1;
+		}
+	}
+
+	if(0 == thread_count){
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = online > 0 ? (unsigned int) online : 1;
+	}
+	if((job.chunk_count + SHA256_TREE_CLAIM - 1)/SHA256_TREE_CLAIM < thread_count){
+		thread_count = (unsigned int) ((job.chunk_count + SHA256_TREE_CLAIM - 1)/SHA256_TREE_CLAIM);
+	}
+
+	workers = malloc(thread_count * sizeof(*workers));
+	if(NULL == workers){
+		sha256_error(MALLOC_ERROR);
+		goto error1;
+	}
+
+	pthread_mutex_init(&job.lock, NULL);
+
+	//The calling thread works too, a thread that can't be started only means less parallelism
+	for(started = 1; started < thread_count; ++started){
+		if(pthread_create(&workers[started], NULL, sha256_tree_worker_run, &job)){
+			sha256_error(THREAD_ERROR);
+			break;
+		}
+	}
+
+	sha256_tree_worker_run(&job);
+
+	for(unsigned int c = 1; c < started; ++c){
+		pthread_join(workers[c], NULL);
+	}
+
+	pthread_mutex_destroy(&job.lock);
+	free(workers);
+
+	result = sha256_tree_root((const unsigned char (*)[32]) job.manifest, length, chunk_size, thread_count, root);
+
+error1:
+	if(job.manifest != manifest){
+		free(job.manifest);
+	}
+	return result;
+}
+
+//Checks range_length bytes of data, found at offset of the whole input, against the manifest of the
+//whole input (length bytes in chunks of chunk_size bytes). offset must be at a chunk boundary, and the
+//range must end at a chunk boundary or at the end of the input.
+//Returns the number of chunks that don't match the manifest, or -1 if the range isn't aligned to chunks.
+long sha256_tree_verify_range(const void *data, uint64_t offset, uint64_t range_length, uint64_t length, size_t chunk_size,
+	const unsigned char (*manifest)[32]){
+	unsigned char digests[SHA256_TREE_CLAIM][32];
+	size_t first, last;
+	long mismatches = 0;
+
+	if(0 == chunk_size || offset % chunk_size || offset + range_length > length ||
+		(range_length % chunk_size && offset + range_length != length)){
+		sha256_warning("The range isn't aligned to the chunks");
+		return -1;
+	}
+
+	//An empty range has no chunk to check, unless the whole input is empty (it has one empty chunk)
+	if(0 == range_length && 0 != length){
+		return 0;
+	}
+
+	first = (size_t) (offset/chunk_size);
+	last = first + sha256_tree_chunk_count(range_length, chunk_size);
+
+	//data holds the chunks [first, last) of the input, as chunks [0, last - first) of its own
+	for(size_t start = 0; start < last - first; start += SHA256_TREE_CLAIM){
+		size_t window = last - first - start < SHA256_TREE_CLAIM ? last - first - start : SHA256_TREE_CLAIM;
+
+		sha256_tree_hash_chunks(data, range_length, chunk_size, start, start + window, digests);
+		for(size_t c = 0; c < window; ++c){
+			if(memcmp(digests[c], manifest[first + start + c], 32)){
+				++mismatches;
+			}
+		}
+	}
+
+	return mismatches;
+}